@@ -0,0 +1,156 @@
+# Compiles and optimizes one GLSL shader, through a content hash keyed cache.
+# Run with cmake -P from vipu_add_shaders(), see vipu_shaders.cmake.
+#
+# The cache key covers the contents of the source and of the files it
+# included when it was last compiled, defines, include directories, target
+# environment, and the tool binaries. Cache entries are written to a
+# temporary file and renamed, so that parallel builds can share the cache
+# directory.
+#
+# Input variables:
+#   GLSLANG             glslangValidator
+#   SPIRV_OPT           spirv-opt
+#   SOURCE              GLSL source
+#   OUTPUT              optimized SPIR-V
+#   DEPFILE             make style dependency file for the build system
+#   CACHE_DIR           cache directory
+#   TARGET_ENV          for example vulkan1.1
+#   DEFINES             comma separated NAME or NAME=VALUE
+#   INCLUDE_DIRECTORIES comma separated
+
+cmake_minimum_required(VERSION 3.12)
+
+foreach (variable GLSLANG SPIRV_OPT SOURCE OUTPUT DEPFILE CACHE_DIR TARGET_ENV)
+  if ("${${variable}}" STREQUAL "")
+    message(FATAL_ERROR "vipu_compile_shader: ${variable} not set")
+  endif()
+endforeach()
+
+string(REPLACE "," ";" DEFINES             "${DEFINES}")
+string(REPLACE "," ";" INCLUDE_DIRECTORIES "${INCLUDE_DIRECTORIES}")
+
+get_filename_component(name ${SOURCE} NAME)
+
+# Includes of the previous compile of this source. Kept in the cache
+# directory, so that cache lookups after a clean build still cover them.
+get_filename_component(source_path ${SOURCE} ABSOLUTE)
+string(SHA256 source_id "${source_path}")
+set(dependency_list_file "${CACHE_DIR}/sources/${source_id}.deps")
+
+function(vipu_now_us result)
+  if (CMAKE_VERSION VERSION_GREATER_EQUAL 3.23)
+    string(TIMESTAMP value "%s%f")
+  else()
+    string(TIMESTAMP seconds "%s")
+    math(EXPR value "${seconds} * 1000000")
+  endif()
+  set(${result} ${value} PARENT_SCOPE)
+endfunction()
+
+# Hash of everything which affects the output. Dependencies are the files
+# the source included when it was last compiled. If the set of includes
+# changes, some file in the previous set has changed, so the key changes.
+function(vipu_shader_key dependencies result)
+  file(TIMESTAMP ${GLSLANG}   glslang_time   "%Y%m%d%H%M%S" UTC)
+  file(TIMESTAMP ${SPIRV_OPT} spirv_opt_time "%Y%m%d%H%M%S" UTC)
+  file(SHA256 ${SOURCE} source_hash)
+  set(text "vipu-shader-1\n${TARGET_ENV}\n${DEFINES}\n${INCLUDE_DIRECTORIES}\n${glslang_time}\n${spirv_opt_time}\n${name}:${source_hash}\n")
+  foreach (dependency ${dependencies})
+    if (EXISTS ${dependency})
+      file(SHA256 ${dependency} dependency_hash)
+    else()
+      set(dependency_hash "missing")
+    endif()
+    string(APPEND text "${dependency}:${dependency_hash}\n")
+  endforeach()
+  string(SHA256 key "${text}")
+  set(${result} ${key} PARENT_SCOPE)
+endfunction()
+
+function(vipu_write_dependencies dependencies)
+  string(REPLACE ";" "\n" list_text "${dependencies}")
+  file(WRITE ${dependency_list_file} "${list_text}")  # creates directories
+  string(REPLACE ";" " " depfile_text "${dependencies}")
+  file(WRITE ${DEPFILE} "${OUTPUT}: ${SOURCE} ${depfile_text}\n")
+endfunction()
+
+vipu_now_us(start_us)
+
+set(previous_dependencies "")
+if (EXISTS ${dependency_list_file})
+  file(STRINGS ${dependency_list_file} previous_dependencies)
+endif()
+vipu_shader_key("${previous_dependencies}" key)
+
+set(cache_spirv        "${CACHE_DIR}/${key}.spv")
+set(cache_dependencies "${CACHE_DIR}/${key}.deps")
+if (EXISTS ${cache_spirv} AND EXISTS ${cache_dependencies})
+  file(STRINGS ${cache_dependencies} dependencies)
+  configure_file(${cache_spirv} ${OUTPUT} COPYONLY)
+  vipu_write_dependencies("${dependencies}")
+  message(STATUS "Shader ${name}: cached")
+  return()
+endif()
+
+set(arguments -V -g --target-env ${TARGET_ENV})
+foreach (define ${DEFINES})
+  list(APPEND arguments "-D${define}")
+endforeach()
+foreach (directory ${INCLUDE_DIRECTORIES})
+  list(APPEND arguments "-I${directory}")
+endforeach()
+
+set(unoptimized      "${OUTPUT}.unoptimized.spv")
+set(glslang_depfile  "${OUTPUT}.glslang.d")
+execute_process(
+  COMMAND ${GLSLANG} ${arguments} --depfile ${glslang_depfile} -o ${unoptimized} ${SOURCE}
+  RESULT_VARIABLE result
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE  output
+)
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "Shader ${name}: glslangValidator failed\n${output}")
+endif()
+
+execute_process(
+  COMMAND ${SPIRV_OPT} -O --target-env=${TARGET_ENV} --validate-after-all ${unoptimized} -o ${OUTPUT}
+  RESULT_VARIABLE result
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE  output
+)
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "Shader ${name}: spirv-opt failed\n${output}")
+endif()
+
+# glslangValidator depfile is "output: source includes...", with line
+# continuations. Paths with spaces are not supported.
+set(dependencies "")
+if (EXISTS ${glslang_depfile})
+  file(READ ${glslang_depfile} depfile_text)
+  string(REPLACE "\\\n" " " depfile_text "${depfile_text}")
+  string(REGEX REPLACE "^[^:]*:[ \t]" "" depfile_text "${depfile_text}")
+  string(REGEX REPLACE "[ \t\r\n]+" ";" depfile_text "${depfile_text}")
+  foreach (dependency ${depfile_text})
+    get_filename_component(dependency_path ${dependency} ABSOLUTE)
+    if (NOT dependency STREQUAL "" AND NOT dependency_path STREQUAL source_path)
+      list(APPEND dependencies ${dependency_path})
+    endif()
+  endforeach()
+  list(REMOVE_DUPLICATES dependencies)
+endif()
+file(REMOVE ${unoptimized} ${glslang_depfile})
+vipu_write_dependencies("${dependencies}")
+
+# Stored under the key for the dependencies of this compile
+vipu_shader_key("${dependencies}" key)
+file(MAKE_DIRECTORY ${CACHE_DIR})
+string(RANDOM LENGTH 8 suffix)
+configure_file(${OUTPUT} "${CACHE_DIR}/${key}.spv.${suffix}" COPYONLY)
+string(REPLACE ";" "\n" list_text "${dependencies}")
+file(WRITE "${CACHE_DIR}/${key}.deps.${suffix}" "${list_text}")
+file(RENAME "${CACHE_DIR}/${key}.deps.${suffix}" "${CACHE_DIR}/${key}.deps")
+file(RENAME "${CACHE_DIR}/${key}.spv.${suffix}"  "${CACHE_DIR}/${key}.spv")
+
+vipu_now_us(end_us)
+math(EXPR elapsed_ms "(${end_us} - ${start_us}) / 1000")
+message(STATUS "Shader ${name}: compiled in ${elapsed_ms} ms")
@@ -0,0 +1,50 @@
+# Writes a header with SPIR-V as a constexpr uint32_t array.
+# Run with cmake -P from vipu_add_shaders(), see vipu_shaders.cmake.
+#
+# Input variables:
+#   SPIRV       SPIR-V binary
+#   OUTPUT      header to write
+#   IDENTIFIER  array name, in namespace vipu::embedded_shaders
+
+cmake_minimum_required(VERSION 3.12)
+
+foreach (variable SPIRV OUTPUT IDENTIFIER)
+  if ("${${variable}}" STREQUAL "")
+    message(FATAL_ERROR "vipu_embed_spirv: ${variable} not set")
+  endif()
+endforeach()
+
+file(READ ${SPIRV} hex HEX)
+string(LENGTH "${hex}" hex_length)
+math(EXPR remainder "${hex_length} % 8")
+if (hex_length EQUAL 0 OR NOT remainder EQUAL 0)
+  message(FATAL_ERROR "vipu_embed_spirv: ${SPIRV} is not a sequence of 32-bit words")
+endif()
+
+# SPIR-V words are little endian
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " words "${hex}")
+# Eight words per line. CMake regular expressions have no {n} repetition.
+set(word "0x[0-9a-f]+u,")
+string(REGEX REPLACE "(${word} ${word} ${word} ${word} ${word} ${word} ${word} ${word}) " "\\1\n    " words "${words}")
+string(REGEX REPLACE "[ \n]+$" "" words "${words}")
+
+get_filename_component(spirv_name ${SPIRV} NAME)
+string(TOUPPER "${IDENTIFIER}" guard)
+file(WRITE ${OUTPUT}
+"// Generated from ${spirv_name} by vipu_embed_spirv.cmake, do not edit
+#ifndef ${guard}_hpp_vipu_embedded_shaders
+#define ${guard}_hpp_vipu_embedded_shaders
+
+#include <cstdint>
+
+namespace vipu::embedded_shaders
+{
+
+constexpr uint32_t ${IDENTIFIER}[] = {
+    ${words}
+};
+
+} // namespace vipu::embedded_shaders
+
+#endif // ${guard}_hpp_vipu_embedded_shaders
+")
@@ -0,0 +1,189 @@
+# vipu_add_shaders(<target>
+#                  SOURCES <glsl files...>
+#                  [OUTPUT_DIRECTORY <dir>]     default ${CMAKE_CURRENT_BINARY_DIR}/shaders
+#                  [TARGET_ENV <env>]           default vulkan1.1
+#                  [DEFINES <NAME[=VALUE]>...]
+#                  [INCLUDE_DIRECTORIES <dir>...]
+#                  [EMBED_TARGET <target>])
+#
+# Adds a target which compiles each source to <name>.spv in the output
+# directory with glslangValidator, and optimizes it with spirv-opt. Uses the
+# glslangValidator and spirv-opt targets when the subprojects are built, and
+# installed tools otherwise. Compiled shaders are kept in a content hash
+# keyed cache in VIPU_SHADER_CACHE_DIR, so that only changed shaders are
+# compiled, also after a clean build.
+#
+# With EMBED_TARGET, each compiled shader is also written to <name>.spv.hpp
+# as a constexpr uint32_t array, and a generated embedded_shaders.cpp which
+# defines vipu::get_embedded_shaders() (see src/graphics/shader_library.hpp)
+# is added to the sources of the embed target.
+
+set(VIPU_COMPILE_SHADER_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/vipu_compile_shader.cmake")
+set(VIPU_EMBED_SPIRV_SCRIPT    "${CMAKE_CURRENT_LIST_DIR}/vipu_embed_spirv.cmake")
+
+set(VIPU_SHADER_CACHE_DIR "${CMAKE_BINARY_DIR}/shader_cache" CACHE PATH "Content hash keyed cache of compiled shaders")
+
+function(vipu_find_shader_tool result_tool result_target)
+  foreach (name ${ARGN})
+    if (TARGET ${name})
+      set(${result_tool}   "$<TARGET_FILE:${name}>" PARENT_SCOPE)
+      set(${result_target} ${name} PARENT_SCOPE)
+      return()
+    endif()
+  endforeach()
+  list(GET ARGN 0 program_name)
+  string(MAKE_C_IDENTIFIER "VIPU_${program_name}" variable)
+  string(TOUPPER ${variable} variable)
+  find_program(${variable} NAMES ${ARGN})
+  if (${variable})
+    set(${result_tool} ${${variable}} PARENT_SCOPE)
+  else()
+    set(${result_tool} "" PARENT_SCOPE)
+  endif()
+  set(${result_target} "" PARENT_SCOPE)
+endfunction()
+
+# Writes embedded_shaders.cpp, with a table of the embedded shader arrays.
+# Only touches the file when its contents change.
+function(vipu_write_embedded_shader_table output_directory names)
+  set(includes "")
+  set(entries  "")
+  foreach (name ${names})
+    string(MAKE_C_IDENTIFIER "${name}" identifier)
+    string(APPEND includes "#include \"${name}.spv.hpp\"\n")
+    string(APPEND entries  "    Embedded_shader{\"${name}\", embedded_shaders::${identifier}, std::size(embedded_shaders::${identifier})},\n")
+  endforeach()
+
+  if (names)
+    set(table "constexpr Embedded_shader s_embedded_shaders[] = {\n${entries}};\n")
+    set(result "s_embedded_shaders")
+  else()
+    set(table "")
+    set(result "std::span<const Embedded_shader>{}")
+  endif()
+
+  file(WRITE "${output_directory}/embedded_shaders.cpp.tmp"
+"// Generated by vipu_shaders.cmake, do not edit
+#include <iterator>
+
+#include \"graphics/shader_library.hpp\"
+${includes}
+namespace vipu
+{
+
+namespace
+{
+
+${table}
+} // anonymous namespace
+
+auto get_embedded_shaders()
+-> std::span<const Embedded_shader>
+{
+    return ${result};
+}
+
+} // namespace vipu
+")
+  configure_file("${output_directory}/embedded_shaders.cpp.tmp" "${output_directory}/embedded_shaders.cpp" COPYONLY)
+endfunction()
+
+function(vipu_add_shaders target)
+  cmake_parse_arguments(ARG "" "OUTPUT_DIRECTORY;TARGET_ENV;EMBED_TARGET" "SOURCES;DEFINES;INCLUDE_DIRECTORIES" ${ARGN})
+  if (NOT ARG_OUTPUT_DIRECTORY)
+    set(ARG_OUTPUT_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}/shaders")
+  endif()
+  if (NOT ARG_TARGET_ENV)
+    set(ARG_TARGET_ENV vulkan1.1)
+  endif()
+
+  vipu_find_shader_tool(glslang   glslang_target   glslangValidator glslang-standalone)
+  vipu_find_shader_tool(spirv_opt spirv_opt_target spirv-opt)
+  if (NOT glslang OR NOT spirv_opt)
+    message(WARNING "glslangValidator or spirv-opt not found, shaders of ${target} are not compiled")
+    add_custom_target(${target})
+    if (ARG_EMBED_TARGET)
+      vipu_write_embedded_shader_table(${ARG_OUTPUT_DIRECTORY} "")
+      target_sources(${ARG_EMBED_TARGET} PRIVATE "${ARG_OUTPUT_DIRECTORY}/embedded_shaders.cpp")
+    endif()
+    return()
+  endif()
+
+  # Make style depfiles of custom commands need Ninja, or CMake 3.20
+  set(use_depfile OFF)
+  if (CMAKE_GENERATOR MATCHES "Ninja" OR CMAKE_VERSION VERSION_GREATER_EQUAL 3.20)
+    set(use_depfile ON)
+  endif()
+
+  string(REPLACE ";" "," defines "${ARG_DEFINES}")
+  set(include_directories "")
+  foreach (directory ${ARG_INCLUDE_DIRECTORIES})
+    get_filename_component(directory ${directory} ABSOLUTE)
+    list(APPEND include_directories ${directory})
+  endforeach()
+  string(REPLACE ";" "," include_directories "${include_directories}")
+
+  set(outputs "")
+  set(names   "")
+  set(headers "")
+  foreach (source ${ARG_SOURCES})
+    get_filename_component(source ${source} ABSOLUTE)
+    get_filename_component(name ${source} NAME)
+    set(output  "${ARG_OUTPUT_DIRECTORY}/${name}.spv")
+    set(depfile "${ARG_OUTPUT_DIRECTORY}/${name}.d")
+
+    set(depfile_arguments "")
+    if (use_depfile)
+      set(depfile_arguments DEPFILE ${depfile})
+    endif()
+
+    add_custom_command(
+      OUTPUT ${output}
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${ARG_OUTPUT_DIRECTORY}
+      COMMAND ${CMAKE_COMMAND}
+              -DGLSLANG=${glslang}
+              -DSPIRV_OPT=${spirv_opt}
+              -DSOURCE=${source}
+              -DOUTPUT=${output}
+              -DDEPFILE=${depfile}
+              -DCACHE_DIR=${VIPU_SHADER_CACHE_DIR}
+              -DTARGET_ENV=${ARG_TARGET_ENV}
+              -DDEFINES=${defines}
+              -DINCLUDE_DIRECTORIES=${include_directories}
+              -P ${VIPU_COMPILE_SHADER_SCRIPT}
+      DEPENDS ${source} ${VIPU_COMPILE_SHADER_SCRIPT} ${glslang_target} ${spirv_opt_target}
+      ${depfile_arguments}
+      VERBATIM
+    )
+    list(APPEND outputs ${output})
+
+    if (ARG_EMBED_TARGET)
+      string(MAKE_C_IDENTIFIER "${name}" identifier)
+      set(header "${ARG_OUTPUT_DIRECTORY}/${name}.spv.hpp")
+      add_custom_command(
+        OUTPUT ${header}
+        COMMAND ${CMAKE_COMMAND}
+                -DSPIRV=${output}
+                -DOUTPUT=${header}
+                -DIDENTIFIER=${identifier}
+                -P ${VIPU_EMBED_SPIRV_SCRIPT}
+        DEPENDS ${output} ${VIPU_EMBED_SPIRV_SCRIPT}
+        VERBATIM
+      )
+      list(APPEND names   ${name})
+      list(APPEND headers ${header})
+    endif()
+  endforeach()
+
+  add_custom_target(${target} ALL DEPENDS ${outputs} ${headers})
+
+  if (ARG_EMBED_TARGET)
+    file(MAKE_DIRECTORY ${ARG_OUTPUT_DIRECTORY})
+    vipu_write_embedded_shader_table(${ARG_OUTPUT_DIRECTORY} "${names}")
+    set(table "${ARG_OUTPUT_DIRECTORY}/embedded_shaders.cpp")
+    set_source_files_properties(${table} PROPERTIES OBJECT_DEPENDS "${headers}")
+    target_sources(${ARG_EMBED_TARGET} PRIVATE ${table} ${headers})
+    target_include_directories(${ARG_EMBED_TARGET} PRIVATE ${ARG_OUTPUT_DIRECTORY})
+    add_dependencies(${ARG_EMBED_TARGET} ${target})
+  endif()
+endfunction()
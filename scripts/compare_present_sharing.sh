@@ -0,0 +1,22 @@
+#!/bin/bash
+# Runs executable with each present sharing mode and prints average frame
+# times reported in log.txt. Only meaningful on devices where graphics and
+# present queue families differ. Usage:
+#   scripts/compare_present_sharing.sh [runs per mode]
+
+RUNS=${1:-5}
+
+for SHARING in concurrent ownership-transfer; do
+    for RUN in $(seq 1 "$RUNS"); do
+        rm -f log.txt
+        VIPU_VALIDATION=off VIPU_PRESENT_SHARING=$SHARING build/executable >/dev/null 2>&1
+        grep -h -o -E "average frame time [0-9.]+ ms|present sharing [a-z-]+" log.txt
+    done | awk -v requested="$SHARING" '
+        /^average frame time/ { frame += $4; frame_count++ }
+        /^present sharing/    { used = $3 }
+        END {
+            printf "%-20s used %-20s", requested, used
+            if (frame_count > 0) printf "   frame %9.3f ms", frame / frame_count
+            printf "\n"
+        }'
+done
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Runs executable with each validation profile and prints startup and
+# average frame times reported in log.txt. Usage:
+#   scripts/compare_validation_profiles.sh [runs per profile]
+
+RUNS=${1:-5}
+LAYERS=build/subprojects/Vulkan-ValidationLayers/layers
+
+for PROFILE in off core sync gpu-assisted best-practices; do
+    for RUN in $(seq 1 "$RUNS"); do
+        rm -f log.txt
+        VIPU_VALIDATION=$PROFILE VK_LAYER_PATH=$LAYERS LD_LIBRARY_PATH=$LAYERS build/executable >/dev/null 2>&1
+        grep -h -o -E "Startup [0-9.]+ ms|average frame time [0-9.]+ ms" log.txt
+    done | awk -v profile="$PROFILE" '
+        /^Startup/            { startup += $2; startup_count++ }
+        /^average frame time/ { frame += $4; frame_count++ }
+        END {
+            printf "%-15s startup %9.3f ms", profile, (startup_count > 0) ? startup / startup_count : 0
+            if (frame_count > 0) printf "   frame %9.3f ms", frame / frame_count
+            printf "\n"
+        }'
+done
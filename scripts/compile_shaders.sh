@@ -1,31 +1,34 @@
 #!/usr/bin/env bash
 
+# Shaders are compiled by the shaders build target, through the content
+# hash keyed cache, see cmake/vipu_shaders.cmake. This builds that target,
+# and optionally writes disassembly (--dis) and reflection (--reflect) of
+# the results to build/shaders.
+
 set -e
 
-printf "Locating tools\n"
-compiler=$(readlink -e "build/subprojects/glslang/StandAlone/glslangValidator")
-optimizer=$(readlink -e "build/subprojects/SPIRV-Tools/tools/spirv-opt")
-dis=$(readlink -e "build/subprojects/SPIRV-Tools/tools/spirv-dis")
-cross=$(readlink -e "build/subprojects/SPIRV-Cross/spirv-cross")
-printf "\tcompiler  = ${compiler}\n"
-printf "\toptimizer = ${optimizer}\n"
-printf "\tdis       = ${dis}\n"
-printf "\tcross     = ${cross}\n"
-#${compiler} --help
-#${optimizer} --help
-(
-    cd "res/shaders" || exit
-    printf "Compiling\n"
-    ${compiler} -V -g simple.frag -o simple.frag.spv --target-env vulkan1.1
-    ${compiler} -V -g simple.vert -o simple.vert.spv --target-env vulkan1.1
-    printf "Optimizing\n"
-    ${optimizer} -O simple.frag.spv -o simple.frag.opt.spv --target-env=vulkan1.1 --validate-after-all
-    ${optimizer} -O simple.vert.spv -o simple.vert.opt.spv --target-env=vulkan1.1 --validate-after-all
-    printf "Disassembly\n"
-    ${dis} simple.frag.opt.spv
-    ${dis} simple.vert.opt.spv
-    printf "Reflection\n"
-    ${cross} simple.frag.opt.spv -V --reflect --remove-unused-variables --output simple.frag.opt.json
-    ${cross} simple.vert.opt.spv -V --reflect --remove-unused-variables --output simple.vert.opt.json
-    printf "Done\n"
-)
+dis_enabled=0
+reflect_enabled=0
+for argument in "$@"; do
+    case "${argument}" in
+        --dis)     dis_enabled=1 ;;
+        --reflect) reflect_enabled=1 ;;
+        *)         printf "usage: %s [--dis] [--reflect]\n" "$0"; exit 1 ;;
+    esac
+done
+
+cmake --build build --target shaders
+
+if [ ${dis_enabled} -eq 1 ]; then
+    dis=$(readlink -e "build/subprojects/SPIRV-Tools/tools/spirv-dis")
+    for spirv in build/shaders/*.spv; do
+        ${dis} "${spirv}" -o "${spirv%.spv}.spvasm"
+    done
+fi
+
+if [ ${reflect_enabled} -eq 1 ]; then
+    cross=$(readlink -e "build/subprojects/SPIRV-Cross/spirv-cross")
+    for spirv in build/shaders/*.spv; do
+        ${cross} "${spirv}" -V --reflect --remove-unused-variables --output "${spirv%.spv}.json"
+    done
+fi
@@ -0,0 +1,128 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "memory/linear_allocator.hpp"
+#include "memory/tlsf_allocator.hpp"
+
+using Linear_allocator = vipu::Linear_allocator;
+using Tlsf_allocator   = vipu::Tlsf_allocator;
+
+namespace
+{
+
+constexpr uint64_t block_size{256ull * 1024 * 1024};
+
+// Resource sized requests: log-uniform from 256 bytes to 4 MiB, buffer
+// (256) or image (4 KiB, 64 KiB) alignments
+struct Request
+{
+    uint64_t size;
+    uint64_t alignment;
+};
+
+auto make_requests(size_t count, uint32_t seed)
+-> std::vector<Request>
+{
+    std::mt19937_64                        random{seed};
+    std::uniform_real_distribution<double> log_size{8.0, 22.0};
+    std::uniform_int_distribution<int>     alignment_choice{0, 9};
+
+    std::vector<Request> requests(count);
+    for (auto &request : requests)
+    {
+        request.size = static_cast<uint64_t>(std::exp2(log_size(random)));
+        const int choice = alignment_choice(random);
+        request.alignment = (choice < 6) ? 256 : (choice < 9) ? 4096 : 65536;
+    }
+    return requests;
+}
+
+template <typename Function>
+auto measure_seconds(Function function)
+-> double
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+} // anonymous namespace
+
+// Long-lived pattern: keeps a live set, and replaces a random allocation
+// each step. Fragmentation is 1 - largest free block / total free size,
+// sampled at the end.
+int main(int argc, const char **argv)
+{
+    static_cast<void>(argc);
+    static_cast<void>(argv);
+
+    constexpr size_t live_count{400};
+    constexpr size_t step_count{2000000};
+
+    const auto requests = make_requests(step_count + live_count, 1);
+
+    Tlsf_allocator                     tlsf{block_size};
+    std::vector<Tlsf_allocator::Allocation> live(live_count);
+    std::mt19937                       random{2};
+    std::uniform_int_distribution<size_t> pick{0, live_count - 1};
+    size_t failed_count{0};
+
+    for (size_t i = 0; i < live_count; ++i)
+    {
+        live[i] = tlsf.allocate(requests[i].size, requests[i].alignment);
+    }
+
+    double tlsf_seconds = measure_seconds([&]()
+    {
+        for (size_t i = 0; i < step_count; ++i)
+        {
+            auto &slot = live[pick(random)];
+            tlsf.free(slot);
+            const auto &request = requests[live_count + i];
+            slot = tlsf.allocate(request.size, request.alignment);
+            if (!slot.is_valid())
+            {
+                ++failed_count;
+            }
+        }
+    });
+
+    const uint64_t free_size    = tlsf.get_size() - tlsf.get_used_size();
+    const uint64_t largest_free = tlsf.get_largest_free_size();
+    const double   fragmentation = (free_size > 0) ? 1.0 - static_cast<double>(largest_free) / static_cast<double>(free_size) : 0.0;
+
+    // Transient pattern: allocate per frame, then reset
+    constexpr size_t frame_allocation_count{200};
+    Linear_allocator linear{block_size};
+    size_t linear_failed_count{0};
+    double linear_seconds = measure_seconds([&]()
+    {
+        for (size_t i = 0; i < step_count; ++i)
+        {
+            if ((i % frame_allocation_count) == 0)
+            {
+                linear.reset();
+            }
+            const auto &request = requests[i];
+            if (linear.allocate(request.size, request.alignment) == Linear_allocator::invalid_offset)
+            {
+                ++linear_failed_count;
+            }
+        }
+    });
+
+    fprintf(stderr, "tlsf   free + allocate %12.0f pairs/s, failed %zu\n", static_cast<double>(step_count) / tlsf_seconds, failed_count);
+    fprintf(stderr, "tlsf   used %6.1f MiB, %u allocations, %u free blocks, fragmentation %.3f\n",
+            static_cast<double>(tlsf.get_used_size()) / (1024.0 * 1024.0),
+            tlsf.get_allocation_count(),
+            tlsf.get_free_block_count(),
+            fragmentation);
+    fprintf(stderr, "linear allocate        %12.0f allocations/s, failed %zu\n", static_cast<double>(step_count) / linear_seconds, linear_failed_count);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "log/log.hpp"
+
+using Log = vipu::Log;
+
+namespace
+{
+
+Log::Category log_benchmark{"benchmark", Log::Color::CYAN, Log::Color::GRAY, Log::Level::LEVEL_TRACE};
+
+template <typename Function>
+auto measure_ns_per_call(int iterations, Function function)
+-> double
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        function(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return static_cast<double>(ns) / static_cast<double>(iterations);
+}
+
+} // anonymous namespace
+
+int main(int argc, const char **argv)
+{
+    static_cast<void>(argc);
+    static_cast<void>(argv);
+
+    constexpr int suppressed_iterations{10000000};
+    constexpr int emitted_iterations   {50000};
+
+    Log::console_init();
+
+    // Runtime suppressed: category level is above the call level
+    log_benchmark.set_level(Log::Level::LEVEL_WARN);
+    double suppressed_ns = measure_ns_per_call(suppressed_iterations, [](int i)
+    {
+        log_benchmark.trace("frame {} submit {} took {} ns\n", i, i * 3, 1.5 * i);
+    });
+
+    // Emitted synchronously
+    log_benchmark.set_level(Log::Level::LEVEL_TRACE);
+    double emitted_sync_ns = measure_ns_per_call(emitted_iterations, [](int i)
+    {
+        log_benchmark.trace("frame {} submit {} took {} ns\n", i, i * 3, 1.5 * i);
+    });
+
+    // Emitted through the async writer; the ring is large enough to hold
+    // every record, so this measures the cost on the calling thread only
+    Log::start_async(1u << 16, Log::Overflow_policy::block);
+    double emitted_async_ns = measure_ns_per_call(emitted_iterations, [](int i)
+    {
+        log_benchmark.trace("frame {} submit {} took {} ns\n", i, i * 3, 1.5 * i);
+    });
+    Log::stop_async();
+
+    // Deferred formatting into memory mapped file
+    double emitted_binary_ns{0.0};
+    if (vipu::Binary_log::open("log_benchmark.blog", 64 * 1024 * 1024))
+    {
+        log_benchmark.set_binary(true);
+        emitted_binary_ns = measure_ns_per_call(emitted_iterations, [](int i)
+        {
+            log_benchmark.trace("frame {} submit {} took {} ns\n", i, i * 3, 1.5 * i);
+        });
+        log_benchmark.set_binary(false);
+        vipu::Binary_log::close();
+    }
+
+    fprintf(stderr, "compile time min level    %d\n", Log::min_level);
+    fprintf(stderr, "suppressed call           %8.2f ns\n", suppressed_ns);
+    fprintf(stderr, "emitted call, sync        %8.2f ns\n", emitted_sync_ns);
+    fprintf(stderr, "emitted call, async       %8.2f ns\n", emitted_async_ns);
+    fprintf(stderr, "emitted call, binary      %8.2f ns\n", emitted_binary_ns);
+
+    return 0;
+}
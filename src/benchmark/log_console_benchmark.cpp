@@ -0,0 +1,147 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "log/log.hpp"
+
+using Log = vipu::Log;
+
+namespace
+{
+
+Log::Category log_benchmark{"benchmark", Log::Color::GREEN, Log::Color::GRAY, Log::Level::LEVEL_TRACE};
+
+const std::array<const char *, 4> lines{
+    "Device name = llvmpipe (LLVM 12.0.0, 256 bits), type = Cpu, vendorID = 10005, deviceID = 0\n",
+    "Driver: id = MesaLlvmpipe, name = llvmpipe, info = Mesa 21.0.3 (LLVM 12.0.0), conformanceVersion = 1.0.0.0\n",
+    "severity Warning, types Validation, id UNASSIGNED-BestPractices-vkCreateDevice (5a3d2e1f), message ...\n",
+    "    minImageCount           : 3\n"
+};
+
+// Console writer as it was before records were built in a single buffer:
+// each span is written and flushed separately, with color escapes between.
+void legacy_write(const std::array<int, 2> &color, const std::string &text, FILE *log_file)
+{
+    const char *p;
+    const char *span;
+    size_t span_len;
+    char c;
+    char next;
+
+    Log::set_text_color(color[0]);
+    p = span = text.data();
+    span_len = 0;
+    char prev = 0;
+    for (;;)
+    {
+        c = p[0];
+        next = (c != '\0') ? p[1] : '\0';
+        if (c == '(' || (c == ':' && next != ':' && prev != ':'))
+        {
+            fwrite(span, 1, span_len + 1, stdout);
+            fflush(stdout);
+            prev = c;
+            ++p;
+            ++span_len;
+            span = p;
+            span_len = 0;
+            Log::set_text_color(color[1]);
+        }
+        else if (c == ')')
+        {
+            if (span_len > 1)
+            {
+                fwrite(span, 1, span_len, stdout);
+                fflush(stdout);
+            }
+            Log::set_text_color(color[0]);
+            span = p;
+            ++p;
+            span_len = 1;
+        }
+        else if (c == 0)
+        {
+            fputs(span, stdout);
+            fflush(stdout);
+            Log::set_text_color(color[1]);
+            break;
+        }
+        else
+        {
+            prev = c;
+            ++p;
+            ++span_len;
+        }
+    }
+    Log::set_text_color(Log::Color::GRAY);
+
+    fputs(text.data(), log_file);
+    fflush(log_file);
+}
+
+template <typename Function>
+auto measure_lines_per_second(int iterations, Function function)
+-> double
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        function(i);
+    }
+    auto end     = std::chrono::steady_clock::now();
+    auto seconds = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(iterations) / seconds;
+}
+
+} // anonymous namespace
+
+// Run with stdout on the terminal to be measured, for example over SSH.
+// Results are printed to stderr.
+int main(int argc, const char **argv)
+{
+    static_cast<void>(argc);
+    static_cast<void>(argv);
+
+    constexpr int iterations{100000};
+
+    Log::console_init();
+    Log::set_print_color(true);
+
+    FILE *legacy_log_file = fopen("log_legacy.txt", "wb");
+    if (legacy_log_file == nullptr)
+    {
+        return EXIT_FAILURE;
+    }
+
+    const std::array<int, 2> color{Log::Color::GREEN, Log::Color::GRAY};
+    double legacy_lines_per_second = measure_lines_per_second(iterations, [&](int i)
+    {
+        legacy_write(color, lines[i % lines.size()], legacy_log_file);
+    });
+    fclose(legacy_log_file);
+
+    double single_write_lines_per_second = measure_lines_per_second(iterations, [](int i)
+    {
+        log_benchmark.write_text(Log::Level::LEVEL_INFO, lines[i % lines.size()]);
+    });
+
+    // Includes draining the ring, so this is writer thread throughput
+    Log::start_async(1u << 14, Log::Overflow_policy::block);
+    double async_lines_per_second = measure_lines_per_second(iterations, [](int i)
+    {
+        log_benchmark.write_text(Log::Level::LEVEL_INFO, lines[i % lines.size()]);
+        if (i == iterations - 1)
+        {
+            Log::flush();
+        }
+    });
+    Log::stop_async();
+
+    fprintf(stderr, "span writes, sync    %12.0f lines/s\n", legacy_lines_per_second);
+    fprintf(stderr, "single write, sync   %12.0f lines/s\n", single_write_lines_per_second);
+    fprintf(stderr, "single write, async  %12.0f lines/s\n", async_lines_per_second);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <filesystem>
+
+#include "graphics/atomic_file.hpp"
+#include "graphics/log.hpp"
+
+#if defined _WIN32
+#    include <process.h>
+#else
+#    include <unistd.h>
+#endif
+
+namespace vipu
+{
+
+namespace
+{
+
+auto get_process_id()
+-> long
+{
+#if defined _WIN32
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(getpid());
+#endif
+}
+
+} // anonymous namespace
+
+auto write_file_atomically(const std::string                             &path,
+                           std::initializer_list<std::span<const uint8_t>> parts,
+                           const char                                     *description)
+-> bool
+{
+    const std::string temporary_path = fmt::format("{}.{}.tmp", path, get_process_id());
+    FILE *file = fopen(temporary_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        log_vulkan.warn("Could not write {} {}\n", description, temporary_path);
+        return false;
+    }
+    bool written{true};
+    for (const auto &part : parts)
+    {
+        written = written && (fwrite(part.data(), 1, part.size(), file) == part.size());
+    }
+    if ((fclose(file) != 0) || !written)
+    {
+        remove(temporary_path.c_str());
+        log_vulkan.warn("Could not write {} {}\n", description, temporary_path);
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error)
+    {
+        remove(temporary_path.c_str());
+        log_vulkan.warn("Could not write {} {}: {}\n", description, path, error.message());
+        return false;
+    }
+    return true;
+}
+
+} // namespace vipu
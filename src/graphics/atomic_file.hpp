@@ -0,0 +1,24 @@
+#ifndef atomic_file_hpp_vipu_graphics
+#define atomic_file_hpp_vipu_graphics
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+
+namespace vipu
+{
+
+// Writes parts, in order, to a temporary file and renames it to path, so
+// that a crash or a concurrently starting process never sees a partial
+// file. Temporary file name is per process, so concurrent writers do not
+// write the same file; the last rename wins. Failures are logged as
+// "Could not write <description> <path>", and return false.
+auto write_file_atomically(const std::string                             &path,
+                           std::initializer_list<std::span<const uint8_t>> parts,
+                           const char                                     *description)
+-> bool;
+
+} // namespace vipu
+
+#endif // atomic_file_hpp_vipu_graphics
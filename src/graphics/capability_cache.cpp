@@ -0,0 +1,541 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include <type_traits>
+
+#include "graphics/capability_cache.hpp"
+#include "graphics/atomic_file.hpp"
+#include "graphics/log.hpp"
+
+#if defined _WIN32
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace vipu
+{
+
+namespace
+{
+
+constexpr uint32_t absent{0xffffffffu};
+
+struct File_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t environment_hash;
+    uint32_t layer_count;            // absent if layers were not stored
+    uint32_t global_extension_count; // absent if global extensions were not stored
+    uint32_t device_count;
+    uint32_t reserved;
+};
+
+class Hash
+{
+public:
+    void add(const void *data, size_t size)
+    {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_value = (m_value ^ bytes[i]) * 0x100000001b3ull; // FNV-1a
+        }
+    }
+
+    void add(std::string_view text)
+    {
+        add(text.data(), text.size());
+        add("", 1);
+    }
+
+    template <typename T>
+    void add_value(const T &value)
+    {
+        add(&value, sizeof(value));
+    }
+
+    auto get() const
+    -> uint64_t
+    {
+        return m_value;
+    }
+
+private:
+    uint64_t m_value{0xcbf29ce484222325ull};
+};
+
+// Manifest file path, size and modification time. Directory iteration
+// order is not specified, so entries are hashed independently and combined
+// with a commutative operation.
+void hash_manifest_directory(Hash &hash, const std::filesystem::path &directory)
+{
+    std::error_code error;
+    uint64_t        combined{0};
+    uint64_t        count   {0};
+    for (auto i = std::filesystem::directory_iterator(directory, error);
+         !error && (i != std::filesystem::directory_iterator());
+         i.increment(error))
+    {
+        std::error_code entry_error;
+        Hash entry_hash;
+        entry_hash.add(i->path().string());
+        entry_hash.add_value(static_cast<uint64_t>(i->file_size(entry_error)));
+        entry_hash.add_value(static_cast<int64_t>(i->last_write_time(entry_error).time_since_epoch().count()));
+        combined += entry_hash.get();
+        ++count;
+    }
+    hash.add(directory.string());
+    hash.add_value(combined);
+    hash.add_value(count);
+}
+
+void hash_manifest_file(Hash &hash, const std::filesystem::path &file)
+{
+    std::error_code error;
+    hash.add(file.string());
+    hash.add_value(static_cast<uint64_t>(std::filesystem::file_size(file, error)));
+    hash.add_value(static_cast<int64_t>(std::filesystem::last_write_time(file, error).time_since_epoch().count()));
+}
+
+// Calls function for each element of a ':' separated path list
+template <typename Function>
+void for_each_path(const char *list, Function function)
+{
+    if (list == nullptr)
+    {
+        return;
+    }
+#if defined _WIN32
+    constexpr char separator{';'};
+#else
+    constexpr char separator{':'};
+#endif
+    std::string_view paths{list};
+    while (!paths.empty())
+    {
+        auto end = paths.find(separator);
+        auto path = paths.substr(0, end);
+        if (!path.empty())
+        {
+            function(std::filesystem::path{path});
+        }
+        if (end == std::string_view::npos)
+        {
+            break;
+        }
+        paths.remove_prefix(end + 1);
+    }
+}
+
+class Reader
+{
+public:
+    Reader(const uint8_t *data, size_t size)
+        : m_p  {data}
+        , m_end{data + size}
+    {
+    }
+
+    template <typename T>
+    auto read(T &value)
+    -> bool
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (static_cast<size_t>(m_end - m_p) < sizeof(T))
+        {
+            return false;
+        }
+        memcpy(&value, m_p, sizeof(T));
+        m_p += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    auto read_array(std::vector<T> &values, uint32_t count)
+    -> bool
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (static_cast<size_t>(m_end - m_p) / sizeof(T) < count)
+        {
+            return false;
+        }
+        values.resize(count);
+        memcpy(values.data(), m_p, count * sizeof(T));
+        m_p += count * sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    auto read_array(std::vector<T> &values)
+    -> bool
+    {
+        uint32_t count;
+        return read(count) && read_array(values, count);
+    }
+
+private:
+    const uint8_t *m_p;
+    const uint8_t *m_end;
+};
+
+class Writer
+{
+public:
+    template <typename T>
+    void write(const T &value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+        m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    void write_array(const std::vector<T> &values)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(static_cast<uint32_t>(values.size()));
+        const auto *bytes = reinterpret_cast<const uint8_t *>(values.data());
+        m_data.insert(m_data.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    auto data() const
+    -> const std::vector<uint8_t> &
+    {
+        return m_data;
+    }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+// Calls function(data, size) with file contents. Memory mapped where
+// available.
+template <typename Function>
+auto with_file_contents(const std::string &path, Function function)
+-> bool
+{
+#if defined _WIN32
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t  count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return function(data.data(), data.size());
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat file_stat;
+    if ((fstat(fd, &file_stat) != 0) || (file_stat.st_size <= 0))
+    {
+        ::close(fd);
+        return false;
+    }
+    const auto size = static_cast<size_t>(file_stat.st_size);
+    void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+    bool result = function(static_cast<const uint8_t *>(base), size);
+    munmap(base, size);
+    return result;
+#endif
+}
+
+auto same_device(const vk::PhysicalDeviceProperties &a, const vk::PhysicalDeviceProperties &b)
+-> bool
+{
+    return (a.vendorID      == b.vendorID)      &&
+           (a.deviceID      == b.deviceID)      &&
+           (a.driverVersion == b.driverVersion) &&
+           (a.apiVersion    == b.apiVersion)    &&
+           (a.pipelineCacheUUID == b.pipelineCacheUUID);
+}
+
+} // anonymous namespace
+
+auto Capability_cache::get_default_path()
+-> std::string
+{
+    const char *path = getenv("VIPU_CAPABILITY_CACHE");
+    return (path != nullptr) ? std::string{path} : std::string{"capability_cache.bin"};
+}
+
+auto Capability_cache::get_environment_hash(uint32_t loader_version)
+-> uint64_t
+{
+    Hash hash;
+    hash.add_value(version);
+    hash.add_value(loader_version);
+
+    // Loader manifest search paths
+    std::vector<std::filesystem::path> directories;
+    for (const char *prefix : {"/etc/vulkan", "/usr/share/vulkan", "/usr/local/share/vulkan", "/usr/local/etc/vulkan"})
+    {
+        directories.emplace_back(prefix);
+    }
+    for_each_path(getenv("XDG_DATA_DIRS"), [&directories](const std::filesystem::path &path)
+    {
+        directories.push_back(path / "vulkan");
+    });
+    if (const char *home = getenv("HOME"); home != nullptr)
+    {
+        directories.push_back(std::filesystem::path{home} / ".local/share/vulkan");
+    }
+    for (const auto &directory : directories)
+    {
+        for (const char *kind : {"icd.d", "implicit_layer.d", "explicit_layer.d"})
+        {
+            hash_manifest_directory(hash, directory / kind);
+        }
+    }
+
+    // Environment overrides
+    for (const char *name : {"VK_ICD_FILENAMES", "VK_DRIVER_FILES", "VK_ADD_DRIVER_FILES"})
+    {
+        const char *value = getenv(name);
+        hash.add((value != nullptr) ? value : "");
+        for_each_path(value, [&hash](const std::filesystem::path &path)
+        {
+            hash_manifest_file(hash, path);
+        });
+    }
+    for (const char *name : {"VK_LAYER_PATH", "VK_ADD_LAYER_PATH", "VK_INSTANCE_LAYERS"})
+    {
+        const char *value = getenv(name);
+        hash.add((value != nullptr) ? value : "");
+        for_each_path(value, [&hash](const std::filesystem::path &path)
+        {
+            hash_manifest_directory(hash, path);
+        });
+    }
+
+    return hash.get();
+}
+
+auto Capability_cache::load(const std::string &path, uint64_t environment_hash)
+-> bool
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_path             = path;
+    m_environment_hash = environment_hash;
+    m_have_layers            = false;
+    m_have_global_extensions = false;
+    m_dirty            = false;
+    m_layers.clear();
+    m_global_extensions.clear();
+    m_devices.clear();
+
+    if (path.empty())
+    {
+        return false;
+    }
+
+    bool loaded = with_file_contents(path, [this](const uint8_t *data, size_t size)
+    {
+        Reader      reader{data, size};
+        File_header header;
+        if (!reader.read(header) ||
+            (header.magic            != magic) ||
+            (header.version          != version) ||
+            (header.header_size      != sizeof(File_header)) ||
+            (header.environment_hash != m_environment_hash))
+        {
+            return false;
+        }
+
+        std::vector<Layer>                   layers;
+        std::vector<vk::ExtensionProperties> global_extensions;
+        std::vector<Device>                  devices;
+        if (header.layer_count != absent)
+        {
+            layers.resize(header.layer_count);
+            for (auto &layer : layers)
+            {
+                if (!reader.read(layer.properties) || !reader.read_array(layer.extensions))
+                {
+                    return false;
+                }
+            }
+        }
+        if ((header.global_extension_count != absent) &&
+            !reader.read_array(global_extensions, header.global_extension_count))
+        {
+            return false;
+        }
+        devices.resize(header.device_count);
+        for (auto &device : devices)
+        {
+            if (!reader.read(device.properties)           ||
+                !reader.read(device.driver_properties)    ||
+                !reader.read(device.id_properties)        ||
+                !reader.read_array(device.extensions)     ||
+                !reader.read_array(device.queue_families) ||
+                !reader.read(device.features)             ||
+                !reader.read(device.memory_properties))
+            {
+                return false;
+            }
+            device.driver_properties.pNext = nullptr;
+            device.id_properties.pNext     = nullptr;
+        }
+
+        m_have_layers            = header.layer_count != absent;
+        m_have_global_extensions = header.global_extension_count != absent;
+        m_layers                 = std::move(layers);
+        m_global_extensions      = std::move(global_extensions);
+        m_devices                = std::move(devices);
+        return true;
+    });
+
+    log_vulkan.info("Capability cache {} {}\n", path, loaded ? "loaded" : "missing or stale");
+    return loaded;
+}
+
+void Capability_cache::save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_dirty || m_path.empty())
+    {
+        return;
+    }
+
+    File_header header{};
+    header.magic                  = magic;
+    header.version                = version;
+    header.header_size            = sizeof(File_header);
+    header.environment_hash       = m_environment_hash;
+    header.layer_count            = m_have_layers ? static_cast<uint32_t>(m_layers.size()) : absent;
+    header.global_extension_count = m_have_global_extensions ? static_cast<uint32_t>(m_global_extensions.size()) : absent;
+    header.device_count           = static_cast<uint32_t>(m_devices.size());
+
+    Writer writer;
+    writer.write(header);
+    for (const auto &layer : m_layers)
+    {
+        writer.write(layer.properties);
+        writer.write_array(layer.extensions);
+    }
+    for (const auto &extension : m_global_extensions)
+    {
+        writer.write(extension);
+    }
+    for (const auto &device : m_devices)
+    {
+        vk::PhysicalDeviceDriverProperties driver_properties = device.driver_properties;
+        vk::PhysicalDeviceIDProperties     id_properties     = device.id_properties;
+        driver_properties.pNext = nullptr;
+        id_properties.pNext     = nullptr;
+        writer.write(device.properties);
+        writer.write(driver_properties);
+        writer.write(id_properties);
+        writer.write_array(device.extensions);
+        writer.write_array(device.queue_families);
+        writer.write(device.features);
+        writer.write(device.memory_properties);
+    }
+
+    // A concurrently starting process never maps a partial file
+    const auto &data = writer.data();
+    if (!write_file_atomically(m_path, {data}, "capability cache"))
+    {
+        return;
+    }
+
+    m_dirty = false;
+    log_vulkan.info("Capability cache {} written, {} bytes\n", m_path, data.size());
+}
+
+auto Capability_cache::get_layers() const
+-> const std::vector<Layer> *
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_have_layers ? &m_layers : nullptr;
+}
+
+auto Capability_cache::get_global_extensions() const
+-> const std::vector<vk::ExtensionProperties> *
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_have_global_extensions ? &m_global_extensions : nullptr;
+}
+
+void Capability_cache::set_layers(const std::vector<Layer> &layers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_layers      = layers;
+    m_have_layers = true;
+    m_dirty       = true;
+}
+
+void Capability_cache::set_global_extensions(const std::vector<vk::ExtensionProperties> &extensions)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_global_extensions      = extensions;
+    m_have_global_extensions = true;
+    m_dirty                  = true;
+}
+
+auto Capability_cache::find_device(const vk::PhysicalDeviceProperties   &properties,
+                                   const vk::PhysicalDeviceIDProperties &id_properties,
+                                   Device                               &device) const
+-> bool
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto &cached : m_devices)
+    {
+        if ((cached.id_properties.deviceUUID == id_properties.deviceUUID) &&
+            same_device(cached.properties, properties))
+        {
+            device = cached;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Capability_cache::store_device(const Device &device)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &cached : m_devices)
+    {
+        // Replaces entry from previous driver version of the same device.
+        // Identical GPUs have different device UUIDs, and get entries of
+        // their own.
+        if (cached.id_properties.deviceUUID == device.id_properties.deviceUUID)
+        {
+            cached = device;
+            cached.driver_properties.pNext = nullptr;
+            cached.id_properties.pNext     = nullptr;
+            m_dirty = true;
+            return;
+        }
+    }
+    m_devices.push_back(device);
+    m_devices.back().driver_properties.pNext = nullptr;
+    m_devices.back().id_properties.pNext     = nullptr;
+    m_dirty = true;
+}
+
+} // namespace vipu
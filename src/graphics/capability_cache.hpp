@@ -0,0 +1,99 @@
+#ifndef capability_cache_hpp_vipu_graphics
+#define capability_cache_hpp_vipu_graphics
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+// On-disk cache of instance layer, instance extension and physical device
+// capabilities, so that warm starts do not need to enumerate (and log)
+// each of them.
+//
+// The whole file is discarded when the loader version, or the set,
+// modification time or size of any ICD or layer manifest file changes.
+// Device entries are keyed by deviceUUID, so that identical GPUs get
+// entries of their own, and are additionally checked against vendorID,
+// deviceID, driverVersion and pipelineCacheUUID, so a driver update
+// invalidates its entry even if manifests are untouched. These are read
+// with the cheap vkGetPhysicalDeviceProperties2 call.
+class Capability_cache
+{
+public:
+    static constexpr uint64_t magic  {0x50414342'55504956ull}; // "VIPUBCAP"
+    static constexpr uint32_t version{2};
+
+    struct Layer
+    {
+        vk::LayerProperties                  properties;
+        std::vector<vk::ExtensionProperties> extensions;
+    };
+
+    struct Device
+    {
+        vk::PhysicalDeviceProperties         properties;
+        vk::PhysicalDeviceDriverProperties   driver_properties;
+        vk::PhysicalDeviceIDProperties       id_properties;
+        std::vector<vk::ExtensionProperties> extensions;
+        std::vector<vk::QueueFamilyProperties> queue_families;
+        vk::PhysicalDeviceFeatures           features;
+        vk::PhysicalDeviceMemoryProperties   memory_properties;
+    };
+
+    // Path from environment variable VIPU_CAPABILITY_CACHE, or
+    // capability_cache.bin. Empty path disables the cache.
+    static auto get_default_path()
+    -> std::string;
+
+    // Hash of loader version and ICD and layer manifest files
+    static auto get_environment_hash(uint32_t loader_version)
+    -> uint64_t;
+
+    // Maps file, and keeps contents if header matches environment_hash.
+    // Returns false if the file is missing, corrupt or stale.
+    auto load(const std::string &path, uint64_t environment_hash)
+    -> bool;
+
+    // Writes the cache if anything was added since load()
+    void save();
+
+    auto get_layers() const
+    -> const std::vector<Layer> *;
+
+    auto get_global_extensions() const
+    -> const std::vector<vk::ExtensionProperties> *;
+
+    void set_layers(const std::vector<Layer> &layers);
+
+    void set_global_extensions(const std::vector<vk::ExtensionProperties> &extensions);
+
+    // Thread safe. Returns false if there is no entry with matching
+    // deviceUUID, vendorID, deviceID, driverVersion and pipelineCacheUUID.
+    auto find_device(const vk::PhysicalDeviceProperties   &properties,
+                     const vk::PhysicalDeviceIDProperties &id_properties,
+                     Device                               &device) const
+    -> bool;
+
+    // Thread safe. Replaces the entry with the same deviceUUID, if any.
+    void store_device(const Device &device);
+
+private:
+    mutable std::mutex                   m_mutex;
+    std::string                          m_path;
+    uint64_t                             m_environment_hash{0};
+    bool                                 m_have_layers{false};
+    bool                                 m_have_global_extensions{false};
+    bool                                 m_dirty{false};
+    std::vector<Layer>                   m_layers;
+    std::vector<vk::ExtensionProperties> m_global_extensions;
+    std::vector<Device>                  m_devices;
+};
+
+} // namespace vipu
+
+#endif // capability_cache_hpp_vipu_graphics
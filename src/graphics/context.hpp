@@ -4,7 +4,10 @@
 #include <limits>
 #include <cstdint>
 #include "graphics/vulkan.hpp"
+#include "graphics/device_features.hpp"
+#include "graphics/present_sharing.hpp"
 #include "graphics/surface.hpp"
+#include "graphics/validation_profile.hpp"
 
 namespace vipu
 {
@@ -12,9 +15,19 @@ namespace vipu
 class Device;
 class Display;
 class Instance;
+class Memory_allocator;
+class Memory_budget;
 class Physical_device;
+class Pipeline_cache;
+class Pipeline_factory;
+class Pipeline_layout_cache;
+class Queue;
+class Shader_library;
+class Startup_timeline;
+class Submit_service;
 class Surface;
 class Swapchain;
+class Upload_engine;
 
 struct Context
 {
@@ -25,21 +38,40 @@ struct Context
     vk::SurfaceKHR     vk_surface;
     vk::DisplayKHR     vk_display;
     vk::SwapchainKHR   vk_swapchain;
+    vk::PipelineCache  vk_pipeline_cache;
 
     Device            *device               {nullptr};
     Display           *display              {nullptr};
     Instance          *instance             {nullptr};
+    Memory_allocator  *memory_allocator     {nullptr};
+    Memory_budget     *memory_budget        {nullptr};
     Physical_device   *physical_device      {nullptr};
+    Pipeline_cache    *pipeline_cache       {nullptr};
+    Pipeline_factory  *pipeline_factory     {nullptr};
+    Pipeline_layout_cache *pipeline_layout_cache{nullptr};
+    Shader_library    *shader_library       {nullptr};
     Surface           *surface              {nullptr};
     Swapchain         *swapchain            {nullptr};
+    Startup_timeline  *startup_timeline     {nullptr}; // only set during startup
+    Queue             *graphics_queue       {nullptr};
+    Queue             *present_queue        {nullptr}; // may be same as graphics_queue
+    Queue             *compute_queue        {nullptr}; // may be same as graphics_queue
+    Queue             *transfer_queue       {nullptr}; // may be same as compute_queue or graphics_queue
+    Submit_service    *graphics_submit_service{nullptr};
+    Upload_engine     *upload_engine        {nullptr}; // nullptr without timeline semaphores
     uint32_t           graphics_queue_family_index{std::numeric_limits<uint32_t>::max()};
     uint32_t           present_queue_family_index {std::numeric_limits<uint32_t>::max()};
+    uint32_t           compute_queue_family_index {std::numeric_limits<uint32_t>::max()};
+    uint32_t           transfer_queue_family_index{std::numeric_limits<uint32_t>::max()};
 
     uint64_t           frame_number{0};
     bool               quit        {false};
     bool               pause       {false};
 
     Surface::Type      surface_type{Surface::Type::eNone};
+    Validation_profile validation_profile{default_validation_profile};
+    Device_features    device_features; // enabled device features, set after device creation
+    Present_sharing    present_sharing{Present_sharing::exclusive};
 };
 
 } // namespace vipu
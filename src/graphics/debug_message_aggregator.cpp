@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include "graphics/debug_message_aggregator.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+Debug_message_aggregator::Debug_message_aggregator(const Debug_messenger_config &config)
+    : m_max_logged_per_id{config.max_logged_per_id}
+    , m_summary_interval {config.summary_interval}
+    , m_last_summary     {std::chrono::steady_clock::now()}
+{
+}
+
+auto Debug_message_aggregator::on_message(int32_t     message_id_number,
+                                          const char *message_id_name,
+                                          const char *message)
+-> bool
+{
+    // Loader and general messages often have no ID number, key those by text
+    uint64_t key = static_cast<uint32_t>(message_id_number);
+    if (message_id_number == 0)
+    {
+        const char *text = (message_id_name != nullptr) ? message_id_name : message;
+        key = (uint64_t{1} << 32) | static_cast<uint32_t>(std::hash<std::string_view>{}((text != nullptr) ? text : ""));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto &counter = m_counters[key];
+    ++counter.count;
+    if (counter.name.empty())
+    {
+        counter.name = (message_id_name != nullptr) ? message_id_name : fmt::format("{:x}", message_id_number);
+    }
+
+    const bool log_message = counter.count <= m_max_logged_per_id;
+    if (!log_message)
+    {
+        ++counter.suppressed_since_summary;
+        ++m_suppressed_since_summary;
+    }
+
+    if ((m_summary_interval.count() > 0) && (m_suppressed_since_summary > 0))
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - m_last_summary >= m_summary_interval)
+        {
+            log_summary_locked();
+            m_last_summary = now;
+        }
+    }
+
+    if (counter.count == m_max_logged_per_id + 1)
+    {
+        log_vulkan.info("Debug message {} repeated {} times, further messages are only counted\n",
+                        counter.name, m_max_logged_per_id);
+    }
+
+    return log_message;
+}
+
+void Debug_message_aggregator::log_summary()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    log_summary_locked();
+}
+
+void Debug_message_aggregator::log_summary_locked()
+{
+    if (m_suppressed_since_summary == 0)
+    {
+        return;
+    }
+
+    std::vector<const Message_counter *> counters;
+    for (const auto &i : m_counters)
+    {
+        if (i.second.suppressed_since_summary > 0)
+        {
+            counters.push_back(&i.second);
+        }
+    }
+    std::sort(counters.begin(), counters.end(), [](const Message_counter *lhs, const Message_counter *rhs)
+    {
+        return lhs->suppressed_since_summary > rhs->suppressed_since_summary;
+    });
+
+    log_vulkan.info("Debug messages not logged since last summary: {}\n", m_suppressed_since_summary);
+    for (const auto *counter : counters)
+    {
+        log_vulkan.info("    {:>8} (total {:>8}) {}\n",
+                        counter->suppressed_since_summary,
+                        counter->count,
+                        counter->name);
+    }
+
+    for (auto &i : m_counters)
+    {
+        i.second.suppressed_since_summary = 0;
+    }
+    m_suppressed_since_summary = 0;
+}
+
+} // namespace vipu
@@ -0,0 +1,71 @@
+#ifndef debug_message_aggregator_hpp_vipu_graphics
+#define debug_message_aggregator_hpp_vipu_graphics
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+struct Debug_messenger_config
+{
+    vk::DebugUtilsMessageSeverityFlagsEXT severity{
+        vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose |
+        vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo    |
+        vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning |
+        vk::DebugUtilsMessageSeverityFlagBitsEXT::eError
+    };
+    vk::DebugUtilsMessageTypeFlagsEXT types{
+        vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral    |
+        vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation |
+        vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance
+    };
+
+    uint32_t             max_logged_per_id{5};   // later messages with same ID are only counted
+    std::chrono::seconds summary_interval {10};  // zero disables periodic summaries
+    bool                 log_labels       {true}; // queue, command buffer and object labels
+};
+
+// Counts debug messenger messages per message ID. Only the first
+// max_logged_per_id messages of each ID are logged in full; the rest are
+// reported as counts in periodic summaries, so that a message which repeats
+// every frame costs a map lookup instead of formatting.
+class Debug_message_aggregator
+{
+public:
+    explicit Debug_message_aggregator(const Debug_messenger_config &config);
+
+    // Counts message. Returns true if the message should be logged.
+    // Logs a summary first if summary interval has passed.
+    auto on_message(int32_t message_id_number, const char *message_id_name, const char *message)
+    -> bool;
+
+    // Logs per ID counts of messages which were not logged since last summary
+    void log_summary();
+
+private:
+    struct Message_counter
+    {
+        std::string name;
+        uint64_t    count{0};
+        uint64_t    suppressed_since_summary{0};
+    };
+
+    void log_summary_locked();
+
+    std::mutex                                    m_mutex;
+    std::unordered_map<uint64_t, Message_counter> m_counters;
+    uint32_t                                      m_max_logged_per_id;
+    std::chrono::steady_clock::duration           m_summary_interval;
+    std::chrono::steady_clock::time_point         m_last_summary;
+    uint64_t                                      m_suppressed_since_summary{0};
+};
+
+} // namespace vipu
+
+#endif // debug_message_aggregator_hpp_vipu_graphics
@@ -1,10 +1,18 @@
+#include <array>
+#include <map>
+#include <vector>
+
 #include "fmt/format.h"
 #include "gsl/gsl"
 
 #include "graphics/device.hpp"
 #include "graphics/context.hpp"
+#include "graphics/device_features.hpp"
 #include "graphics/log.hpp"
 #include "graphics/physical_device.hpp"
+#include "graphics/pipeline_cache.hpp"
+#include "graphics/present_sharing.hpp"
+#include "graphics/queue.hpp"
 #include "graphics/surface.hpp"
 #include "graphics/vulkan.hpp"
 
@@ -20,61 +28,84 @@ Device::Device(Context &context)
 
     m_queue_family_indices = context.physical_device->choose_queue_family_indices(context);
 
-    std::array<const float, 1> priorities {0.0f};
-
-    vk::DeviceQueueCreateInfo device_queue_create_info{
-        vk::DeviceQueueCreateFlags(),
+    // One queue per role. Roles in the same family get separate queues while
+    // the family has them, and share the last one after that. Present uses
+    // the graphics queue when it is in the graphics family.
+    const std::array<uint32_t, 4> role_families{
         m_queue_family_indices.graphics,
-        1,
-        priorities.data()
+        m_queue_family_indices.present,
+        m_queue_family_indices.compute,
+        m_queue_family_indices.transfer
     };
+    constexpr std::array<const char *, 4> role_names      {"graphics", "present", "compute", "transfer"};
+    constexpr std::array<float, 4>        role_priorities {1.0f, 1.0f, 0.5f, 0.5f};
+    std::array<uint32_t, 4>               role_queue_indices{};
+
+    const auto &queue_family_properties = context.physical_device->get_queue_family_properties();
+    std::map<uint32_t, std::vector<float>> family_priorities;
+    for (size_t role = 0; role < role_families.size(); ++role)
+    {
+        const uint32_t family_index = role_families[role];
+        const uint32_t queue_count  = queue_family_properties[family_index].queueFamilyProperties.queueCount;
+        auto &priorities = family_priorities[family_index];
+        if ((role == 1) && (family_index == role_families[0]))
+        {
+            role_queue_indices[role] = role_queue_indices[0];
+        }
+        else if (priorities.size() < queue_count)
+        {
+            role_queue_indices[role] = static_cast<uint32_t>(priorities.size());
+            priorities.push_back(role_priorities[role]);
+        }
+        else
+        {
+            role_queue_indices[role] = static_cast<uint32_t>(priorities.size() - 1);
+        }
+    }
+
+    std::vector<vk::DeviceQueueCreateInfo> device_queue_create_infos;
+    for (const auto &[family_index, priorities] : family_priorities)
+    {
+        device_queue_create_infos.emplace_back(
+            vk::DeviceQueueCreateFlags(),
+            family_index,
+            static_cast<uint32_t>(priorities.size()),
+            priorities.data()
+        );
+    }
+
+    // Core features which are not listed stay disabled.
+    // GPU-Assisted validation needs stores and atomics.
+    Device_features required;
+    required.stores_and_atomics = needs_shader_stores_and_atomics(context.validation_profile);
 
-    vk::PhysicalDeviceFeatures features;
-    features.setRobustBufferAccess                     (VK_FALSE);
-    features.setFullDrawIndexUint32                    (VK_FALSE);
-    features.setImageCubeArray                         (VK_FALSE);
-    features.setIndependentBlend                       (VK_FALSE);
-    features.setGeometryShader                         (VK_FALSE);
-    features.setTessellationShader                     (VK_FALSE);
-    features.setSampleRateShading                      (VK_FALSE);
-    features.setDualSrcBlend                           (VK_FALSE);
-    features.setLogicOp                                (VK_FALSE);
-    features.setMultiDrawIndirect                      (VK_FALSE);
-    features.setDrawIndirectFirstInstance              (VK_FALSE);
-    features.setDepthClamp                             (VK_FALSE);
-    features.setDepthBiasClamp                         (VK_FALSE);
-    features.setFillModeNonSolid                       (VK_FALSE);
-    features.setDepthBounds                            (VK_FALSE);
-    features.setWideLines                              (VK_FALSE);
-    features.setLargePoints                            (VK_FALSE);
-    features.setAlphaToOne                             (VK_FALSE);
-    features.setMultiViewport                          (VK_FALSE);
-    features.setSamplerAnisotropy                      (VK_FALSE);
-    features.setTextureCompressionETC2                 (VK_FALSE); // Not supported by NVIDIA
-    features.setTextureCompressionASTC_LDR             (VK_FALSE); // Not supported by NVIDIA
-    features.setTextureCompressionBC                   (VK_FALSE);
-    features.setOcclusionQueryPrecise                  (VK_FALSE);
-
-    // Fort GPU-Assisted validation:
-    features.setFragmentStoresAndAtomics      (VK_TRUE);
-    features.setVertexPipelineStoresAndAtomics(VK_TRUE);
+    Device_features optional;
+    optional.timeline_semaphore    = true;
+    optional.descriptor_indexing   = true;
+    optional.buffer_device_address = true;
+    optional.scalar_block_layout   = true;
+    optional.host_query_reset      = true;
+    optional.synchronization2      = true;
+    optional.memory_budget         = true;
+
+    Device_feature_negotiation feature_negotiation{*context.physical_device, required, optional};
+    m_features = feature_negotiation.get_enabled();
+
+    // Not yet negotiated:
     // -    VkPhysicalDeviceCooperativeMatrixFeaturesNV
     // -    VkPhysicalDeviceCornerSampledImageFeaturesNV
     // -    VkPhysicalDeviceCoverageReductionModeFeaturesNV
     // -    VkPhysicalDeviceCustomBorderColorFeaturesEXT
     // - NV VkPhysicalDeviceDedicatedAllocationImageAliasingFeaturesNV
     // -    VkPhysicalDeviceDepthClipEnableFeaturesEXT
-    // -    VkPhysicalDeviceDescriptorIndexingFeatures
     // -    VkPhysicalDeviceDeviceGeneratedCommandsFeaturesNV
     // -    VkPhysicalDeviceDiagnosticsConfigFeaturesNV
     // -    VkPhysicalDeviceExclusiveScissorFeaturesNV
     // -    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT
-    // -    VkPhysicalDeviceFeatures2
     // -    VkPhysicalDeviceFragmentDensityMap2FeaturesEXT
     // -    VkPhysicalDeviceFragmentDensityMapFeaturesEXT
     // -    VkPhysicalDeviceFragmentShaderBarycentricFeaturesNV
     // -    VkPhysicalDeviceFragmentShaderInterlockFeaturesEXT
-    // -    VkPhysicalDeviceHostQueryResetFeatures
     // -    VkPhysicalDeviceImagelessFramebufferFeatures
     // -    VkPhysicalDeviceIndexTypeUint8FeaturesEXT
     // -    VkPhysicalDeviceInlineUniformBlockFeaturesEXT
@@ -91,7 +122,6 @@ Device::Device(Context &context)
     // -    VkPhysicalDeviceRepresentativeFragmentTestFeaturesNV
     // -    VkPhysicalDeviceRobustness2FeaturesEXT
     // -    VkPhysicalDeviceSamplerYcbcrConversionFeatures
-    // -    VkPhysicalDeviceScalarBlockLayoutFeatures
     // -    VkPhysicalDeviceSeparateDepthStencilLayoutsFeatures
     // -    VkPhysicalDeviceShaderAtomicInt64Features
     // -    VkPhysicalDeviceShaderClockFeaturesKHR
@@ -106,49 +136,85 @@ Device::Device(Context &context)
     // -    VkPhysicalDeviceSubgroupSizeControlFeaturesEXT
     // -    VkPhysicalDeviceTexelBufferAlignmentFeaturesEXT
     // -    VkPhysicalDeviceTextureCompressionASTCHDRFeaturesEXT
-    // -    VkPhysicalDeviceTimelineSemaphoreFeatures
     // -    VkPhysicalDeviceTransformFeedbackFeaturesEXT
     // -    VkPhysicalDeviceUniformBufferStandardLayoutFeatures
     // -    VkPhysicalDeviceVariablePointersFeatures
     // -    VkPhysicalDeviceVertexAttributeDivisorFeaturesEXT
     // -    VkPhysicalDeviceVulkanMemoryModelFeatures
     // -    VkPhysicalDeviceYcbcrImageArraysFeaturesEXT
-    std::array<char const *, 2> device_extension_names = {
+    std::vector<char const *> device_extension_names = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME
     };
+    for (const char *extension_name : feature_negotiation.get_extension_names())
+    {
+        device_extension_names.push_back(extension_name);
+    }
 
-    std::array<char const *, 1> layer_names = {
-        "VK_LAYER_KHRONOS_validation"
-    };
+    // Device layers are deprecated, but older loaders still use them
+    std::vector<char const *> layer_names;
+    if (context.validation_profile != Validation_profile::off)
+    {
+        layer_names.emplace_back(validation_layer_name);
+    }
 
     vk::DeviceCreateInfo device_create_info{
         vk::DeviceCreateFlags(),
-        1,
-        &device_queue_create_info,
-        layer_names.size(),
+        static_cast<uint32_t>(device_queue_create_infos.size()),
+        device_queue_create_infos.data(),
+        static_cast<uint32_t>(layer_names.size()),
         layer_names.data(),
-        device_extension_names.size(),
+        static_cast<uint32_t>(device_extension_names.size()),
         device_extension_names.data(),
-        &features
+        nullptr // features are in pNext chain
     };
+    device_create_info.setPNext(&feature_negotiation.get_create_info_chain());
 
     m_vk_device = context.vk_physical_device.createDeviceUnique(device_create_info);
 
-    vk::DeviceQueueInfo2 queue_info{
-        vk::DeviceQueueCreateFlags(),
-        m_queue_family_indices.graphics,
-        0
-    };
-
     VULKAN_HPP_DEFAULT_DISPATCHER.init(m_vk_device.get());
 
-    m_vk_queue = m_vk_device->getQueue2(queue_info);
+    std::array<Queue *, 4> role_queues{};
+    for (size_t role = 0; role < role_families.size(); ++role)
+    {
+        for (const auto &queue : m_queues)
+        {
+            if ((queue->get_family_index() == role_families[role]) &&
+                (queue->get_queue_index() == role_queue_indices[role]))
+            {
+                role_queues[role] = queue.get();
+            }
+        }
+        if (role_queues[role] == nullptr)
+        {
+            m_queues.push_back(std::make_unique<Queue>(m_vk_device.get(),
+                                                       role_families[role],
+                                                       role_queue_indices[role],
+                                                       queue_family_properties[role_families[role]].queueFamilyProperties.queueFlags,
+                                                       role_names[role]));
+            role_queues[role] = m_queues.back().get();
+        }
+    }
+    m_graphics_queue = role_queues[0];
+    m_present_queue  = role_queues[1];
+    m_compute_queue  = role_queues[2];
+    m_transfer_queue = role_queues[3];
+
+    m_present_sharing = choose_present_sharing(context.physical_device->get_properties(),
+                                               m_queue_family_indices.graphics,
+                                               m_queue_family_indices.present);
+
+    m_pipeline_cache = std::make_unique<Pipeline_cache>(m_vk_device.get(),
+                                                        context.physical_device->get_properties(),
+                                                        Pipeline_cache::get_default_path());
 
     log_vulkan.trace("{} completed\n", __func__);
 
     Ensures(m_vk_device);
-    Ensures(m_vk_queue);
+    Ensures(m_graphics_queue != nullptr);
+    Ensures(m_present_queue  != nullptr);
+    Ensures(m_compute_queue  != nullptr);
+    Ensures(m_transfer_queue != nullptr);
 }
 
 auto Device::get()
@@ -163,11 +229,52 @@ auto Device::get_queue_family_indices()
     return m_queue_family_indices;
 }
 
+auto Device::get_features() const
+-> const Device_features &
+{
+    return m_features;
+}
+
+auto Device::get_pipeline_cache()
+-> Pipeline_cache &
+{
+    return *m_pipeline_cache;
+}
+
 auto Device::get_queue()
 -> vk::Queue
 {
-    return m_vk_queue;
+    return m_graphics_queue->get();
+}
+
+auto Device::get_graphics_queue()
+-> Queue &
+{
+    return *m_graphics_queue;
+}
+
+auto Device::get_present_queue()
+-> Queue &
+{
+    return *m_present_queue;
 }
 
+auto Device::get_present_sharing() const
+-> Present_sharing
+{
+    return m_present_sharing;
+}
+
+auto Device::get_compute_queue()
+-> Queue &
+{
+    return *m_compute_queue;
+}
+
+auto Device::get_transfer_queue()
+-> Queue &
+{
+    return *m_transfer_queue;
+}
 
 } // namespace vipu
@@ -2,8 +2,13 @@
 #define device_hpp_vipu_graphics
 
 #include <memory>
+#include <vector>
 
+#include "graphics/device_features.hpp"
 #include "graphics/physical_device.hpp"
+#include "graphics/pipeline_cache.hpp"
+#include "graphics/present_sharing.hpp"
+#include "graphics/queue.hpp"
 #include "graphics/vulkan.hpp"
 
 namespace vipu
@@ -22,13 +27,54 @@ public:
     auto get_queue_family_indices()
     -> const Queue_family_indices &;
 
+    // Graphics queue
     auto get_queue()
     -> vk::Queue;
 
+    // Families come from Physical_device::choose_queue_family_indices().
+    // Within a family, graphics, present, compute and transfer get queues
+    // 0, 1, 2... in that order while the family has them, and later roles
+    // share the last queue after that. Present always shares the graphics
+    // queue when it is in the graphics family.
+    auto get_graphics_queue()
+    -> Queue &;
+
+    // Same as graphics queue if present family is graphics family
+    auto get_present_queue()
+    -> Queue &;
+
+    auto get_present_sharing() const
+    -> Present_sharing;
+
+    // In a dedicated compute family if there is one. Otherwise in the
+    // graphics family: a second queue there when queueCount allows, else
+    // the graphics queue.
+    auto get_compute_queue()
+    -> Queue &;
+
+    // In a dedicated transfer family if there is one. Otherwise in the
+    // compute family: another queue there when queueCount allows, else the
+    // last queue of that family, which may be the compute or graphics queue.
+    auto get_transfer_queue()
+    -> Queue &;
+
+    auto get_features() const
+    -> const Device_features &;
+
+    auto get_pipeline_cache()
+    -> Pipeline_cache &;
+
 private:
-    vk::UniqueDevice     m_vk_device;
-    vk::Queue            m_vk_queue;
-    Queue_family_indices m_queue_family_indices;
+    vk::UniqueDevice                    m_vk_device;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    Queue                              *m_graphics_queue{nullptr};
+    Queue                              *m_present_queue {nullptr};
+    Queue                              *m_compute_queue {nullptr};
+    Queue                              *m_transfer_queue{nullptr};
+    std::unique_ptr<Pipeline_cache>     m_pipeline_cache; // destroyed, and saved, before m_vk_device
+    Queue_family_indices                m_queue_family_indices;
+    Device_features                     m_features;
+    Present_sharing                     m_present_sharing{Present_sharing::exclusive};
 };
 
 } // namespace vipu
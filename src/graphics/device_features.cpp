@@ -0,0 +1,243 @@
+#include "graphics/device_features.hpp"
+#include "graphics/log.hpp"
+#include "graphics/physical_device.hpp"
+
+namespace vipu
+{
+
+auto operator|(const Device_features &lhs, const Device_features &rhs)
+-> Device_features
+{
+    Device_features result;
+    result.stores_and_atomics    = lhs.stores_and_atomics    || rhs.stores_and_atomics;
+    result.timeline_semaphore    = lhs.timeline_semaphore    || rhs.timeline_semaphore;
+    result.descriptor_indexing   = lhs.descriptor_indexing   || rhs.descriptor_indexing;
+    result.buffer_device_address = lhs.buffer_device_address || rhs.buffer_device_address;
+    result.scalar_block_layout   = lhs.scalar_block_layout   || rhs.scalar_block_layout;
+    result.host_query_reset      = lhs.host_query_reset      || rhs.host_query_reset;
+    result.synchronization2      = lhs.synchronization2      || rhs.synchronization2;
+    result.memory_budget         = lhs.memory_budget         || rhs.memory_budget;
+    return result;
+}
+
+auto operator&(const Device_features &lhs, const Device_features &rhs)
+-> Device_features
+{
+    Device_features result;
+    result.stores_and_atomics    = lhs.stores_and_atomics    && rhs.stores_and_atomics;
+    result.timeline_semaphore    = lhs.timeline_semaphore    && rhs.timeline_semaphore;
+    result.descriptor_indexing   = lhs.descriptor_indexing   && rhs.descriptor_indexing;
+    result.buffer_device_address = lhs.buffer_device_address && rhs.buffer_device_address;
+    result.scalar_block_layout   = lhs.scalar_block_layout   && rhs.scalar_block_layout;
+    result.host_query_reset      = lhs.host_query_reset      && rhs.host_query_reset;
+    result.synchronization2      = lhs.synchronization2      && rhs.synchronization2;
+    result.memory_budget         = lhs.memory_budget         && rhs.memory_budget;
+    return result;
+}
+
+Device_feature_negotiation::Device_feature_negotiation(Physical_device       &physical_device,
+                                                       const Device_features &required,
+                                                       const Device_features &optional)
+{
+    query_available(physical_device);
+
+    const auto check_required = [](bool is_required, bool is_available, const char *name)
+    {
+        if (is_required && !is_available)
+        {
+            FATAL("Required device feature {} is not supported\n", name);
+        }
+    };
+    check_required(required.stores_and_atomics,    m_available.stores_and_atomics,    "stores and atomics");
+    check_required(required.timeline_semaphore,    m_available.timeline_semaphore,    "timeline semaphore");
+    check_required(required.descriptor_indexing,   m_available.descriptor_indexing,   "descriptor indexing");
+    check_required(required.buffer_device_address, m_available.buffer_device_address, "buffer device address");
+    check_required(required.scalar_block_layout,   m_available.scalar_block_layout,   "scalar block layout");
+    check_required(required.host_query_reset,      m_available.host_query_reset,      "host query reset");
+    check_required(required.synchronization2,      m_available.synchronization2,      "synchronization2");
+    check_required(required.memory_budget,         m_available.memory_budget,         "memory budget");
+
+    m_enabled = (required | optional) & m_available;
+
+    build_enabled_chain();
+
+    log_vulkan.info("Device features (available / enabled):\n");
+    const auto log_feature = [](const char *name, bool available, bool enabled)
+    {
+        log_vulkan.info("    {:<22} {:<3} / {}\n", name, available ? "yes" : "no", enabled ? "yes" : "no");
+    };
+    log_feature("stores and atomics",    m_available.stores_and_atomics,    m_enabled.stores_and_atomics);
+    log_feature("timeline semaphore",    m_available.timeline_semaphore,    m_enabled.timeline_semaphore);
+    log_feature("descriptor indexing",   m_available.descriptor_indexing,   m_enabled.descriptor_indexing);
+    log_feature("buffer device address", m_available.buffer_device_address, m_enabled.buffer_device_address);
+    log_feature("scalar block layout",   m_available.scalar_block_layout,   m_enabled.scalar_block_layout);
+    log_feature("host query reset",      m_available.host_query_reset,      m_enabled.host_query_reset);
+    log_feature("synchronization2",      m_available.synchronization2,      m_enabled.synchronization2);
+    log_feature("memory budget",         m_available.memory_budget,         m_enabled.memory_budget);
+}
+
+void Device_feature_negotiation::query_available(Physical_device &physical_device)
+{
+    // Structures of extensions which the device does not support must not be
+    // chained, not even for queries
+    Feature_chain chain;
+    const bool has_timeline_semaphore    = physical_device.has_extension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    const bool has_descriptor_indexing   = physical_device.has_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    const bool has_buffer_device_address = physical_device.has_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+    const bool has_scalar_block_layout   = physical_device.has_extension(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
+    const bool has_host_query_reset      = physical_device.has_extension(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+    const bool has_synchronization2      = physical_device.has_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    if (!has_timeline_semaphore)
+    {
+        chain.unlink<vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+    }
+    if (!has_descriptor_indexing)
+    {
+        chain.unlink<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+    }
+    if (!has_buffer_device_address)
+    {
+        chain.unlink<vk::PhysicalDeviceBufferDeviceAddressFeatures>();
+    }
+    if (!has_scalar_block_layout)
+    {
+        chain.unlink<vk::PhysicalDeviceScalarBlockLayoutFeatures>();
+    }
+    if (!has_host_query_reset)
+    {
+        chain.unlink<vk::PhysicalDeviceHostQueryResetFeatures>();
+    }
+    if (!has_synchronization2)
+    {
+        chain.unlink<vk::PhysicalDeviceSynchronization2FeaturesKHR>();
+    }
+
+    physical_device.get().getFeatures2(&chain.get<vk::PhysicalDeviceFeatures2>());
+
+    const auto &features              = chain.get<vk::PhysicalDeviceFeatures2>().features;
+    const auto &timeline_semaphore    = chain.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+    const auto &descriptor_indexing   = chain.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+    const auto &buffer_device_address = chain.get<vk::PhysicalDeviceBufferDeviceAddressFeatures>();
+    const auto &scalar_block_layout   = chain.get<vk::PhysicalDeviceScalarBlockLayoutFeatures>();
+    const auto &host_query_reset      = chain.get<vk::PhysicalDeviceHostQueryResetFeatures>();
+    const auto &synchronization2      = chain.get<vk::PhysicalDeviceSynchronization2FeaturesKHR>();
+
+    // Unlinked structures keep their zero initialized feature bits
+    m_available.stores_and_atomics    = features.fragmentStoresAndAtomics && features.vertexPipelineStoresAndAtomics;
+    m_available.timeline_semaphore    = timeline_semaphore.timelineSemaphore;
+    m_available.descriptor_indexing   = descriptor_indexing.runtimeDescriptorArray &&
+                                        descriptor_indexing.descriptorBindingPartiallyBound &&
+                                        descriptor_indexing.descriptorBindingVariableDescriptorCount &&
+                                        descriptor_indexing.descriptorBindingSampledImageUpdateAfterBind &&
+                                        descriptor_indexing.shaderSampledImageArrayNonUniformIndexing;
+    m_available.buffer_device_address = buffer_device_address.bufferDeviceAddress;
+    m_available.scalar_block_layout   = scalar_block_layout.scalarBlockLayout;
+    m_available.host_query_reset      = host_query_reset.hostQueryReset;
+    m_available.synchronization2      = synchronization2.synchronization2;
+    m_available.memory_budget         = physical_device.has_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+}
+
+void Device_feature_negotiation::build_enabled_chain()
+{
+    auto &features = m_enabled_chain.get<vk::PhysicalDeviceFeatures2>().features;
+    features.setFragmentStoresAndAtomics      (m_enabled.stores_and_atomics ? VK_TRUE : VK_FALSE);
+    features.setVertexPipelineStoresAndAtomics(m_enabled.stores_and_atomics ? VK_TRUE : VK_FALSE);
+
+    m_extension_names.clear();
+
+    if (m_enabled.timeline_semaphore)
+    {
+        m_enabled_chain.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>().setTimelineSemaphore(VK_TRUE);
+        m_extension_names.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+    else
+    {
+        m_enabled_chain.unlink<vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+    }
+
+    if (m_enabled.descriptor_indexing)
+    {
+        m_enabled_chain.get<vk::PhysicalDeviceDescriptorIndexingFeatures>()
+            .setRuntimeDescriptorArray                      (VK_TRUE)
+            .setDescriptorBindingPartiallyBound             (VK_TRUE)
+            .setDescriptorBindingVariableDescriptorCount    (VK_TRUE)
+            .setDescriptorBindingSampledImageUpdateAfterBind(VK_TRUE)
+            .setShaderSampledImageArrayNonUniformIndexing   (VK_TRUE);
+        m_extension_names.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    }
+    else
+    {
+        m_enabled_chain.unlink<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+    }
+
+    if (m_enabled.buffer_device_address)
+    {
+        m_enabled_chain.get<vk::PhysicalDeviceBufferDeviceAddressFeatures>().setBufferDeviceAddress(VK_TRUE);
+        m_extension_names.push_back(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+    }
+    else
+    {
+        m_enabled_chain.unlink<vk::PhysicalDeviceBufferDeviceAddressFeatures>();
+    }
+
+    if (m_enabled.scalar_block_layout)
+    {
+        m_enabled_chain.get<vk::PhysicalDeviceScalarBlockLayoutFeatures>().setScalarBlockLayout(VK_TRUE);
+        m_extension_names.push_back(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
+    }
+    else
+    {
+        m_enabled_chain.unlink<vk::PhysicalDeviceScalarBlockLayoutFeatures>();
+    }
+
+    if (m_enabled.host_query_reset)
+    {
+        m_enabled_chain.get<vk::PhysicalDeviceHostQueryResetFeatures>().setHostQueryReset(VK_TRUE);
+        m_extension_names.push_back(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+    }
+    else
+    {
+        m_enabled_chain.unlink<vk::PhysicalDeviceHostQueryResetFeatures>();
+    }
+
+    if (m_enabled.synchronization2)
+    {
+        m_enabled_chain.get<vk::PhysicalDeviceSynchronization2FeaturesKHR>().setSynchronization2(VK_TRUE);
+        m_extension_names.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    }
+    else
+    {
+        m_enabled_chain.unlink<vk::PhysicalDeviceSynchronization2FeaturesKHR>();
+    }
+
+    if (m_enabled.memory_budget)
+    {
+        m_extension_names.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+}
+
+auto Device_feature_negotiation::get_available() const
+-> const Device_features &
+{
+    return m_available;
+}
+
+auto Device_feature_negotiation::get_enabled() const
+-> const Device_features &
+{
+    return m_enabled;
+}
+
+auto Device_feature_negotiation::get_create_info_chain() const
+-> const vk::PhysicalDeviceFeatures2 &
+{
+    return m_enabled_chain.get<vk::PhysicalDeviceFeatures2>();
+}
+
+auto Device_feature_negotiation::get_extension_names() const
+-> const std::vector<const char *> &
+{
+    return m_extension_names;
+}
+
+} // namespace vipu
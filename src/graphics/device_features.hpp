@@ -0,0 +1,81 @@
+#ifndef device_features_hpp_vipu_graphics
+#define device_features_hpp_vipu_graphics
+
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+class Physical_device;
+
+// Capability set negotiated at device creation. Each member covers the
+// feature bits and device extension needed by one fast path.
+// The features were promoted to core in Vulkan 1.2 (synchronization2 in
+// 1.3), but the instance targets 1.1, so they are always enabled through
+// their extensions.
+struct Device_features
+{
+    bool stores_and_atomics   {false}; // fragment and vertex pipeline stores and atomics
+    bool timeline_semaphore   {false}; // VK_KHR_timeline_semaphore
+    bool descriptor_indexing  {false}; // VK_EXT_descriptor_indexing, bindless sampled images
+    bool buffer_device_address{false}; // VK_KHR_buffer_device_address
+    bool scalar_block_layout  {false}; // VK_EXT_scalar_block_layout
+    bool host_query_reset     {false}; // VK_EXT_host_query_reset
+    bool synchronization2     {false}; // VK_KHR_synchronization2
+    bool memory_budget        {false}; // VK_EXT_memory_budget, extension only
+};
+
+auto operator|(const Device_features &lhs, const Device_features &rhs)
+-> Device_features;
+
+auto operator&(const Device_features &lhs, const Device_features &rhs)
+-> Device_features;
+
+// Queries features of physical device, and intersects them with required
+// and optional feature sets. Required features which are not available
+// are FATAL.
+class Device_feature_negotiation
+{
+public:
+    using Feature_chain = vk::StructureChain<vk::PhysicalDeviceFeatures2,
+                                             vk::PhysicalDeviceTimelineSemaphoreFeatures,
+                                             vk::PhysicalDeviceDescriptorIndexingFeatures,
+                                             vk::PhysicalDeviceBufferDeviceAddressFeatures,
+                                             vk::PhysicalDeviceScalarBlockLayoutFeatures,
+                                             vk::PhysicalDeviceHostQueryResetFeatures,
+                                             vk::PhysicalDeviceSynchronization2FeaturesKHR>;
+
+    Device_feature_negotiation(Physical_device       &physical_device,
+                               const Device_features &required,
+                               const Device_features &optional);
+
+    auto get_available() const
+    -> const Device_features &;
+
+    auto get_enabled() const
+    -> const Device_features &;
+
+    // For VkDeviceCreateInfo::pNext; pEnabledFeatures must be nullptr
+    auto get_create_info_chain() const
+    -> const vk::PhysicalDeviceFeatures2 &;
+
+    // Extensions needed by enabled features
+    auto get_extension_names() const
+    -> const std::vector<const char *> &;
+
+private:
+    void query_available(Physical_device &physical_device);
+
+    void build_enabled_chain();
+
+    Feature_chain             m_enabled_chain;
+    Device_features           m_available;
+    Device_features           m_enabled;
+    std::vector<const char *> m_extension_names;
+};
+
+} // namespace vipu
+
+#endif // device_features_hpp_vipu_graphics
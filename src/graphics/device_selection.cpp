@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <tuple>
+
+#include "graphics/device_selection.hpp"
+#include "graphics/physical_device.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+auto get_device_type_tier(vk::PhysicalDeviceType device_type)
+-> int32_t
+{
+    switch (device_type)
+    {
+        case vk::PhysicalDeviceType::eDiscreteGpu:   return 4;
+        case vk::PhysicalDeviceType::eIntegratedGpu: return 3;
+        case vk::PhysicalDeviceType::eVirtualGpu:    return 2;
+        case vk::PhysicalDeviceType::eCpu:           return 1;
+        default:                                     return 0;
+    }
+}
+
+auto to_lower(std::string_view text)
+-> std::string
+{
+    std::string result{text};
+    std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c)
+    {
+        return static_cast<char>(std::tolower(c));
+    });
+    return result;
+}
+
+} // anonymous namespace
+
+auto format_uuid(const uint8_t *uuid)
+-> std::string
+{
+    std::string result;
+    for (size_t i = 0; i < VK_UUID_SIZE; ++i)
+    {
+        if ((i == 4) || (i == 6) || (i == 8) || (i == 10))
+        {
+            result.push_back('-');
+        }
+        result += fmt::format("{:02x}", uuid[i]);
+    }
+    return result;
+}
+
+auto score_physical_device(const Physical_device &physical_device, const Device_requirements &requirements)
+-> Device_score
+{
+    Device_score result;
+    result.suitable = true;
+
+    const auto reject = [&result](const std::string &reason)
+    {
+        result.suitable = false;
+        result.reasons += (result.reasons.empty() ? "" : ", ") + reason;
+    };
+    const auto add = [&result](int64_t score, const std::string &reason)
+    {
+        result.score += score;
+        result.reasons += fmt::format("{}{} {:+}", result.reasons.empty() ? "" : ", ", reason, score);
+    };
+
+    const auto &properties = physical_device.get_properties();
+    if (properties.apiVersion < requirements.api_version)
+    {
+        reject(fmt::format("api version {}.{} too old",
+                           VK_VERSION_MAJOR(properties.apiVersion),
+                           VK_VERSION_MINOR(properties.apiVersion)));
+    }
+    for (const char *extension_name : requirements.extensions)
+    {
+        if (!physical_device.has_extension(extension_name))
+        {
+            reject(fmt::format("missing {}", extension_name));
+        }
+    }
+
+    bool graphics_queue{false};
+    bool dedicated_compute_queue{false};
+    bool dedicated_transfer_queue{false};
+    for (const auto &queue_family : physical_device.get_queue_family_properties())
+    {
+        const vk::QueueFlags flags = queue_family.queueFamilyProperties.queueFlags;
+        const bool graphics = (flags & vk::QueueFlagBits::eGraphics) == vk::QueueFlagBits::eGraphics;
+        const bool compute  = (flags & vk::QueueFlagBits::eCompute ) == vk::QueueFlagBits::eCompute;
+        const bool transfer = (flags & vk::QueueFlagBits::eTransfer) == vk::QueueFlagBits::eTransfer;
+        graphics_queue           = graphics_queue           || graphics;
+        dedicated_compute_queue  = dedicated_compute_queue  || (compute && !graphics);
+        dedicated_transfer_queue = dedicated_transfer_queue || (transfer && !graphics && !compute);
+    }
+    if (!graphics_queue)
+    {
+        reject("no graphics queue");
+    }
+    if (!result.suitable)
+    {
+        return result;
+    }
+
+    result.tier    = get_device_type_tier(properties.deviceType);
+    result.reasons = fmt::format("{} tier {}", vk::to_string(properties.deviceType), result.tier);
+
+    // Largest device local heap, in MiB. Integrated GPUs and CPU devices
+    // often report most of system memory, which is why type is a tier.
+    const auto &memory_properties = physical_device.get_memory_properties();
+    vk::DeviceSize device_local_size{0};
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i)
+    {
+        const auto &heap = memory_properties.memoryHeaps[i];
+        if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+        {
+            device_local_size = std::max(device_local_size, heap.size);
+        }
+    }
+    add(static_cast<int64_t>(device_local_size / (1024 * 1024)), "device local MiB");
+
+    if (dedicated_compute_queue)
+    {
+        add(1000, "dedicated compute queue");
+    }
+    if (dedicated_transfer_queue)
+    {
+        add(1000, "dedicated transfer queue");
+    }
+
+    add(properties.limits.maxImageDimension2D / 16, "maxImageDimension2D");
+
+    return result;
+}
+
+auto is_better_device_score(const Device_score &lhs, const Device_score &rhs)
+-> bool
+{
+    return std::tie(lhs.tier, lhs.score) > std::tie(rhs.tier, rhs.score);
+}
+
+auto get_device_override()
+-> std::string
+{
+    const char *text = getenv("VIPU_DEVICE");
+    return (text != nullptr) ? std::string{text} : std::string{};
+}
+
+auto matches_device_override(const Physical_device &physical_device, std::string_view device_override)
+-> bool
+{
+    if (device_override.empty())
+    {
+        return false;
+    }
+
+    // UUID, compared without dashes
+    std::string hex;
+    for (char c : device_override)
+    {
+        if (c != '-')
+        {
+            hex.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+    }
+    if ((hex.size() == 2 * VK_UUID_SIZE) && std::all_of(hex.begin(), hex.end(), [](unsigned char c) { return std::isxdigit(c) != 0; }))
+    {
+        std::string uuid = format_uuid(physical_device.get_id_properties().deviceUUID.data());
+        uuid.erase(std::remove(uuid.begin(), uuid.end(), '-'), uuid.end());
+        if (uuid == hex)
+        {
+            return true;
+        }
+    }
+
+    return to_lower(physical_device.get_name()).find(to_lower(device_override)) != std::string::npos;
+}
+
+} // namespace vipu
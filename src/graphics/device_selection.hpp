@@ -0,0 +1,60 @@
+#ifndef device_selection_hpp_vipu_graphics
+#define device_selection_hpp_vipu_graphics
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+class Physical_device;
+
+// Hard requirements; devices which do not meet them are rejected
+struct Device_requirements
+{
+    uint32_t                  api_version{VK_API_VERSION_1_1};
+    std::vector<const char *> extensions{
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME
+    };
+};
+
+// Device type tier is compared first, and score only between devices of the
+// same tier, so that no amount of memory or limits outweighs device type.
+struct Device_score
+{
+    bool        suitable{false};
+    int32_t     tier    {0};  // from device type, higher is better
+    int64_t     score   {0};
+    std::string reasons;      // why device was rejected, or what contributed to score
+};
+
+// Scores device type, device local heap size, queue family capabilities and
+// limits. Presentation support is checked later, when the surface exists.
+auto score_physical_device(const Physical_device &physical_device, const Device_requirements &requirements)
+-> Device_score;
+
+// Compares tier, then score
+auto is_better_device_score(const Device_score &lhs, const Device_score &rhs)
+-> bool;
+
+// Device name (case insensitive substring) or UUID
+// (32 hex digits, dashes optional) from environment variable VIPU_DEVICE
+auto get_device_override()
+-> std::string;
+
+// Returns true if device name contains device_override, or device UUID
+// equals device_override
+auto matches_device_override(const Physical_device &physical_device, std::string_view device_override)
+-> bool;
+
+auto format_uuid(const uint8_t *uuid)
+-> std::string;
+
+} // namespace vipu
+
+#endif // device_selection_hpp_vipu_graphics
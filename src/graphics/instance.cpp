@@ -1,8 +1,12 @@
+#include <optional>
+
 #include "gsl/gsl"
 
 #include "graphics/instance.hpp"
 #include "graphics/context.hpp"
+#include "graphics/device_selection.hpp"
 #include "graphics/log.hpp"
+#include "graphics/startup_timeline.hpp"
 
 namespace vipu
 {
@@ -61,6 +65,7 @@ void Instance::debug_report_callback(
     log_vulkan.trace("flags {}, objectType {}, object {:x}, location {}, code {:x}, layer prefix {}, message {}\n\\",
                      vk::to_string(flags),
                      vk::to_string(objectType),
+                     object,
                      location,
                      messageCode,
                      pLayerPrefix,
@@ -71,12 +76,24 @@ void Instance::debug_utils_messenger_callback(vk::DebugUtilsMessageSeverityFlags
                                               vk::DebugUtilsMessageTypeFlagsEXT             messageTypes,
                                               const vk::DebugUtilsMessengerCallbackDataEXT *pCallbackData)
 {
+    if (m_debug_message_aggregator &&
+        !m_debug_message_aggregator->on_message(pCallbackData->messageIdNumber,
+                                                pCallbackData->pMessageIdName,
+                                                pCallbackData->pMessage))
+    {
+        return;
+    }
+
     log_vulkan.trace("severity {}, types {}, id {} ({:x}), message {}\n",
                      vk::to_string(messageSeverity),
                      vk::to_string(messageTypes),
                      (pCallbackData->pMessageIdName != nullptr) ? pCallbackData->pMessageIdName : "",
                      pCallbackData->messageIdNumber,
                      (pCallbackData->pMessage != nullptr) ? pCallbackData->pMessage : "");
+    if (!m_log_debug_message_labels)
+    {
+        return;
+    }
     if (pCallbackData->queueLabelCount > 0)
     {
         log_vulkan.trace("    queues ({})\n", pCallbackData->queueLabelCount);
@@ -119,7 +136,7 @@ void Instance::debug_utils_messenger_callback(vk::DebugUtilsMessageSeverityFlags
     }
 }
 
-Instance::Instance(Context &context)
+Instance::Instance(Context &context, const Debug_messenger_config &debug_messenger_config)
 {
     Expects(context.instance == nullptr);
 
@@ -136,21 +153,57 @@ Instance::Instance(Context &context)
                     VK_VERSION_MINOR(api_version),
                     VK_VERSION_PATCH(api_version));
 
-    scan_instance_layers();
-    scan_global_instance_extensions();
-    create_instance(context);
+    // Phases are timed when run from the startup orchestrator
+    Startup_timeline  local_timeline;
+    Startup_timeline &timeline = (context.startup_timeline != nullptr) ? *context.startup_timeline
+                                                                       : local_timeline;
+
+    timeline.run("capability cache", [this, api_version]()
+    {
+        m_capability_cache.load(Capability_cache::get_default_path(),
+                                Capability_cache::get_environment_hash(api_version));
+    });
+
+    // Layer and extension queries are independent loader calls
+    auto layer_scan = timeline.run_async("instance layers", [this]()
+    {
+        scan_instance_layers();
+    });
+    timeline.run("instance extensions", [this]()
+    {
+        scan_global_instance_extensions();
+    });
+    layer_scan.get();
+
+    timeline.run("create instance", [this, &context]()
+    {
+        create_instance(context);
+    });
 
     VULKAN_HPP_DEFAULT_DISPATCHER.init(m_vk_instance.get());
 
     context.vk_instance = get();
 
-    register_debug_report_callback();
+    if (context.validation_profile != Validation_profile::off)
+    {
+        register_debug_report_callback(debug_messenger_config);
+    }
     scan_physical_devices(context);
+    m_capability_cache.save();
 
     Ensures(context.vk_instance);
     Ensures(context.instance);
 }
 
+Instance::~Instance()
+{
+    m_vk_debug_utils_messenger.reset();
+    if (m_debug_message_aggregator)
+    {
+        m_debug_message_aggregator->log_summary();
+    }
+}
+
 auto Instance::get()
 -> vk::Instance
 {
@@ -160,8 +213,22 @@ auto Instance::get()
 
 void Instance::scan_instance_layers()
 {
+    if (const auto *layers = m_capability_cache.get_layers(); layers != nullptr)
+    {
+        m_instance_layer_properties.clear();
+        m_instance_layer_info.clear();
+        for (const auto &layer : *layers)
+        {
+            m_instance_layer_properties.push_back(layer.properties);
+            m_instance_layer_info.push_back(Layer_info{layer.extensions});
+        }
+        log_vulkan.trace("Using {} cached instance layers\n", layers->size());
+        return;
+    }
+
     m_instance_layer_properties = vk::enumerateInstanceLayerProperties();
     m_instance_layer_info.resize(m_instance_layer_properties.size());
+    std::vector<Capability_cache::Layer> cache_layers;
     for (size_t i = 0; i < m_instance_layer_properties.size(); ++i)
     {
         auto &layer = m_instance_layer_properties[i];
@@ -174,17 +241,27 @@ void Instance::scan_instance_layers()
             std::string extensionName(extension.extensionName.data());
             log_vulkan.trace("\tInstance layer extension {}\n", extensionName);
         }
+        cache_layers.push_back(Capability_cache::Layer{layer, info.extension_properties});
     }
+    m_capability_cache.set_layers(cache_layers);
 }
 
 void Instance::scan_global_instance_extensions()
 {
+    if (const auto *extensions = m_capability_cache.get_global_extensions(); extensions != nullptr)
+    {
+        m_global_extension_properties = *extensions;
+        log_vulkan.trace("Using {} cached global extensions\n", extensions->size());
+        return;
+    }
+
     m_global_extension_properties = vk::enumerateInstanceExtensionProperties();
     for (auto &extension : m_global_extension_properties)
     {
         std::string extensionName(extension.extensionName.data());
         log_vulkan.trace("Global extension {}\n", extensionName);
     }
+    m_capability_cache.set_global_extensions(m_global_extension_properties);
 }
 
 void Instance::create_instance(Context &context)
@@ -197,16 +274,44 @@ void Instance::create_instance(Context &context)
         VK_MAKE_VERSION(1, 1, 0) // TODO 1.2
     };
 
-    std::array<char const *, 1> layer_names = {
-        "VK_LAYER_KHRONOS_validation"
-    };
+    if (context.validation_profile != Validation_profile::off)
+    {
+        bool layer_found{false};
+        for (auto &layer : m_instance_layer_properties)
+        {
+            if (std::string_view{layer.layerName.data()} == validation_layer_name)
+            {
+                layer_found = true;
+                break;
+            }
+        }
+        if (!layer_found)
+        {
+            log_vulkan.warn("{} not found, validation profile {} changed to off\n",
+                            validation_layer_name,
+                            c_str(context.validation_profile));
+            context.validation_profile = Validation_profile::off;
+        }
+    }
+    log_vulkan.info("Validation profile {}\n", c_str(context.validation_profile));
+
+    const bool use_validation{context.validation_profile != Validation_profile::off};
+
+    std::vector<const char*> layer_names;
+    if (use_validation)
+    {
+        layer_names.emplace_back(validation_layer_name);
+    }
 
     // Promoted to Vulkan 1.1:
     //  - VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2
 
     std::vector<const char*> instance_extension_names;
-    instance_extension_names.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-    instance_extension_names.emplace_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+    if (use_validation)
+    {
+        instance_extension_names.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        instance_extension_names.emplace_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+    }
     instance_extension_names.emplace_back(VK_KHR_SURFACE_EXTENSION_NAME);
     instance_extension_names.emplace_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
 
@@ -258,60 +363,34 @@ void Instance::create_instance(Context &context)
 #endif
 
     // VK_EXT_validation_features
-    std::array<vk::ValidationFeatureEnableEXT, 3> validation_feature_enable{
-        // GPU-assisted validation is enabled. Activating this feature
-        // instruments shader programs to generate additional diagnostic data.
-        vk::ValidationFeatureEnableEXT::eGpuAssisted,
-
-        // The validation layers reserve a descriptor set binding slot for
-        // their own use. The layer reports a value for
-        // VkPhysicalDeviceLimits::maxBoundDescriptorSets that is one less
-        // than the value reported by the device. If the device supports the
-        // binding of only one descriptor set, the validation layer does not
-        // perform GPU-assisted validation.
-        vk::ValidationFeatureEnableEXT::eGpuAssistedReserveBindingSlot,
-
-        // Vulkan best-practices validation is enabled. Activating this feature
-        // enables the output of warnings related to common misuse of the API,
-        // but which are not explicitly prohibited by the specification.
-        vk::ValidationFeatureEnableEXT::eBestPractices
-
-        // The layers will process debugPrintfEXT operations in shaders and
-        // send the resulting output to the debug callback.
-        //vk::ValidationFeatureEnableEXT::eDebugPrintf
-    };
+    std::vector<vk::ValidationFeatureEnableEXT> validation_feature_enable = get_validation_feature_enables(context.validation_profile);
+
     vk::StructureChain<vk::InstanceCreateInfo,
                        vk::ValidationFeaturesEXT
     > instance_create_info_chain {
         vk::InstanceCreateInfo{
             vk::InstanceCreateFlags(),
             &application_info,
-            layer_names.size(),
+            static_cast<uint32_t>(layer_names.size()),
             layer_names.data(),
             static_cast<uint32_t>(instance_extension_names.size()),
             instance_extension_names.data()
         },
         vk::ValidationFeaturesEXT{
-            validation_feature_enable.size(),
+            static_cast<uint32_t>(validation_feature_enable.size()),
             validation_feature_enable.data(),
             0,
             nullptr
         }
     };
 
-    vk::InstanceCreateInfo instance_create_info_basic {
-        vk::InstanceCreateFlags(),
-        &application_info,
-        layer_names.size(),
-        layer_names.data(),
-        static_cast<uint32_t>(instance_extension_names.size()),
-        instance_extension_names.data()
-    };
-
-    bool use_validation_features{true};
+    bool use_validation_features{!validation_feature_enable.empty()};
+    if (!use_validation_features)
+    {
+        instance_create_info_chain.unlink<vk::ValidationFeaturesEXT>();
+    }
 
-    vk::InstanceCreateInfo &instance_create_info = use_validation_features ? instance_create_info_chain.get<vk::InstanceCreateInfo>()
-                                                                           : instance_create_info_basic;
+    vk::InstanceCreateInfo &instance_create_info = instance_create_info_chain.get<vk::InstanceCreateInfo>();
     m_vk_instance = vk::createInstanceUnique(instance_create_info);
 
     log_vulkan.trace("{} completed\n", __func__);
@@ -319,7 +398,7 @@ void Instance::create_instance(Context &context)
     Ensures(m_vk_instance);
 }
 
-void Instance::register_debug_report_callback()
+void Instance::register_debug_report_callback(const Debug_messenger_config &config)
 {
 #if 0 // Does not link
     vk::DebugReportCallbackCreateInfoEXT create_info {
@@ -386,16 +465,20 @@ void Instance::register_debug_report_callback()
         VERIFY(result == VK_SUCCESS);
     }
 #endif
+    if (!config.severity || !config.types)
+    {
+        return;
+    }
+
+    // Created before the messenger, which may call back immediately
+    m_debug_message_aggregator = std::make_unique<Debug_message_aggregator>(config);
+    m_log_debug_message_labels = config.log_labels;
+
     vk::DebugUtilsMessengerCreateInfoEXT create_info
     {
-        {},                                                  // flags
-        vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose | // messageSeverity
-        vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo    |
-        vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning |
-        vk::DebugUtilsMessageSeverityFlagBitsEXT::eError,
-        vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral     | // messageType
-        vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation  |
-        vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance,
+        {},                                    // flags
+        config.severity,                       // messageSeverity
+        config.types,                          // messageType
         vipu::debug_utils_messenger_callback,
         this
     };
@@ -414,14 +497,29 @@ void Instance::scan_physical_devices(Context &context)
 
     log_vulkan.trace("Found {} physical devices\n", physical_devices.size());
 
-    // Scan all physical devices
+    // Scan all physical devices, each on its own thread. Each thread writes
+    // only its own element, and m_physical_devices is not resized meanwhile.
+    Startup_timeline  local_timeline;
+    Startup_timeline &timeline = (context.startup_timeline != nullptr) ? *context.startup_timeline
+                                                                       : local_timeline;
     m_physical_devices.resize(physical_devices.size());
+    std::vector<std::future<void>> probes;
+    probes.reserve(physical_devices.size());
     for (size_t physical_device_index = 0;
          physical_device_index < physical_devices.size();
          ++physical_device_index)
     {
-        m_physical_devices[physical_device_index] = Physical_device(context,
-                                                                    physical_devices[physical_device_index]);
+        probes.push_back(
+            timeline.run_async("physical device", [this, &context, &physical_devices, physical_device_index]()
+            {
+                m_physical_devices[physical_device_index] = Physical_device(context,
+                                                                            physical_devices[physical_device_index]);
+            })
+        );
+    }
+    for (auto &probe : probes)
+    {
+        probe.get();
     }
 
     log_vulkan.trace("{} completed\n", __func__);
@@ -429,14 +527,69 @@ void Instance::scan_physical_devices(Context &context)
     Ensures(m_physical_devices.size() > 0);
 }
 
-auto Instance::choose_physical_device()
+auto Instance::get_capability_cache()
+-> Capability_cache &
+{
+    return m_capability_cache;
+}
+
+auto Instance::choose_physical_device(std::string_view device_override, const Device_requirements &requirements)
 -> Physical_device &
 {
     Expects(!m_physical_devices.empty());
 
-    size_t physical_device_index = 0; // TODO
     log_vulkan.info("Found {} physical devices\n", m_physical_devices.size());
-    log_vulkan.info("Chose physical device {}\n", physical_device_index);
+
+    std::optional<size_t> best_index;
+    std::optional<size_t> override_index;
+    Device_score          best_score;
+    for (size_t physical_device_index = 0; physical_device_index < m_physical_devices.size(); ++physical_device_index)
+    {
+        const auto &physical_device = m_physical_devices[physical_device_index];
+        const auto  score           = score_physical_device(physical_device, requirements);
+        log_vulkan.info("    {} {} uuid {}: {} {} ({})\n",
+                        physical_device_index,
+                        physical_device.get_name(),
+                        format_uuid(physical_device.get_id_properties().deviceUUID.data()),
+                        score.suitable ? "score" : "rejected",
+                        score.suitable ? fmt::format("{}/{}", score.tier, score.score) : std::string{"-"},
+                        score.reasons);
+        if (!score.suitable)
+        {
+            if (matches_device_override(physical_device, device_override))
+            {
+                log_vulkan.warn("Device {} matches override {} but is not suitable\n",
+                                physical_device.get_name(),
+                                device_override);
+            }
+            continue;
+        }
+        if (!override_index.has_value() && matches_device_override(physical_device, device_override))
+        {
+            override_index = physical_device_index;
+        }
+        if (!best_index.has_value() || is_better_device_score(score, best_score))
+        {
+            best_index = physical_device_index;
+            best_score = score;
+        }
+    }
+
+    if (!device_override.empty() && !override_index.has_value())
+    {
+        log_vulkan.warn("No suitable device matches override {}\n", device_override);
+    }
+
+    if (!best_index.has_value())
+    {
+        FATAL("No suitable physical device\n");
+    }
+
+    const size_t physical_device_index = override_index.has_value() ? override_index.value() : best_index.value();
+    log_vulkan.info("Chose physical device {} {}, {}\n",
+                    physical_device_index,
+                    m_physical_devices[physical_device_index].get_name(),
+                    override_index.has_value() ? "matches override" : "highest score");
 
     return m_physical_devices[physical_device_index];
 }
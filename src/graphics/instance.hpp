@@ -2,8 +2,12 @@
 #define instance_hpp_vipu_graphics
 
 #include <memory>
+#include <string_view>
 
 #include "graphics/vulkan.hpp"
+#include "graphics/capability_cache.hpp"
+#include "graphics/debug_message_aggregator.hpp"
+#include "graphics/device_selection.hpp"
 #include "graphics/physical_device.hpp"
 
 namespace vipu
@@ -15,14 +19,22 @@ class Device;
 class Instance
 {
 public:
-    Instance(Context &context);
+    Instance(Context &context, const Debug_messenger_config &debug_messenger_config = {});
+
+    ~Instance();
 
     auto get()
     -> vk::Instance;
 
-    auto choose_physical_device()
+    // Chooses suitable device with highest score, or a suitable device which
+    // matches device_override (name substring or UUID)
+    auto choose_physical_device(std::string_view device_override = {}, const Device_requirements &requirements = {})
     -> Physical_device &;
 
+    // Used by Physical_device, thread safe
+    auto get_capability_cache()
+    -> Capability_cache &;
+
     void debug_report_callback(
         vk::DebugReportFlagsEXT      flags,
         vk::DebugReportObjectTypeEXT objectType,
@@ -45,21 +57,25 @@ private:
 
     void scan_physical_devices(Context &context);
 
-    void register_debug_report_callback();
+    void register_debug_report_callback(const Debug_messenger_config &config);
+
     struct Layer_info
     {
         std::vector<vk::ExtensionProperties> extension_properties;
     };
 
-    vk::DynamicLoader                    m_dl;
-    std::vector<vk::LayerProperties>     m_instance_layer_properties;
-    std::vector<Layer_info>              m_instance_layer_info;
-    std::vector<vk::ExtensionProperties> m_global_extension_properties;
-    vk::UniqueInstance                   m_vk_instance;
-    std::vector<Physical_device>         m_physical_devices;
-    //vk::UniqueDebugReportCallbackEXT     m_vk_debug_report_callback;
-    VkDebugReportCallbackEXT             m_vk_debug_report_callback;
-    vk::UniqueDebugUtilsMessengerEXT     m_vk_debug_utils_messenger;
+    vk::DynamicLoader                         m_dl;
+    std::vector<vk::LayerProperties>          m_instance_layer_properties;
+    std::vector<Layer_info>                   m_instance_layer_info;
+    std::vector<vk::ExtensionProperties>      m_global_extension_properties;
+    Capability_cache                          m_capability_cache;
+    vk::UniqueInstance                        m_vk_instance;
+    std::vector<Physical_device>              m_physical_devices;
+    //vk::UniqueDebugReportCallbackEXT        m_vk_debug_report_callback;
+    VkDebugReportCallbackEXT                  m_vk_debug_report_callback;
+    vk::UniqueDebugUtilsMessengerEXT          m_vk_debug_utils_messenger;
+    std::unique_ptr<Debug_message_aggregator> m_debug_message_aggregator;
+    bool                                      m_log_debug_message_labels{true};
 };
 
 } // namespace vipu
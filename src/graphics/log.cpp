@@ -3,6 +3,7 @@
 namespace vipu
 {
 
-Log::Category log_vulkan{Log::Color::GREEN, Log::Color::GRAY, Log::Level::LEVEL_TRACE};
+Log::Category log_vulkan{"vulkan", Log::Color::GREEN, Log::Color::GRAY, Log::Level::LEVEL_TRACE};
+Log::Category log_shader{"shader", Log::Color::CYAN,  Log::Color::GRAY, Log::Level::LEVEL_TRACE, Log::Colorizer::glsl};
 
 } // namespace vipu;
@@ -7,6 +7,7 @@ namespace vipu
 {
 
 extern Log::Category log_vulkan;
+extern Log::Category log_shader;  // GLSL compiler messages
 
 };
 
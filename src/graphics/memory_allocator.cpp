@@ -0,0 +1,636 @@
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+
+#include "gsl/gsl"
+
+#include "graphics/memory_allocator.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+#include "graphics/physical_device.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+constexpr uint64_t large_heap_size  {1024ull * 1024 * 1024};
+constexpr uint64_t large_block_size {256ull * 1024 * 1024};
+constexpr uint32_t invalid_block    {std::numeric_limits<uint32_t>::max()};
+
+// Direct write types are not preferred once this share of the heap is used
+constexpr uint64_t direct_write_heap_usage_numerator  {3};
+constexpr uint64_t direct_write_heap_usage_denominator{4};
+
+auto to_mib(uint64_t bytes)
+-> double
+{
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+auto get_physical_device(const Context &context)
+-> const Physical_device &
+{
+    Expects(context.physical_device != nullptr);
+    return *context.physical_device;
+}
+
+} // anonymous namespace
+
+auto c_str(Memory_usage usage)
+-> const char *
+{
+    switch (usage)
+    {
+        case Memory_usage::gpu_only:   return "gpu-only";
+        case Memory_usage::cpu_to_gpu: return "cpu-to-gpu";
+        case Memory_usage::staging:    return "staging";
+        case Memory_usage::gpu_to_cpu: return "gpu-to-cpu";
+        case Memory_usage::gpu_upload: return "gpu-upload";
+        default:                       return "?";
+    }
+}
+
+auto get_memory_type_candidates(const vk::PhysicalDeviceMemoryProperties &memory_properties,
+                                uint32_t                                  memory_type_bits,
+                                Memory_usage                              usage)
+-> std::vector<uint32_t>
+{
+    using Flags = vk::MemoryPropertyFlagBits;
+
+    vk::MemoryPropertyFlags required;
+    vk::MemoryPropertyFlags preferred;
+    vk::MemoryPropertyFlags avoided;
+    switch (usage)
+    {
+        case Memory_usage::gpu_only:
+        {
+            required  = Flags::eDeviceLocal;
+            avoided   = Flags::eHostVisible;
+            break;
+        }
+        case Memory_usage::cpu_to_gpu:
+        {
+            required  = Flags::eHostVisible | Flags::eHostCoherent;
+            preferred = Flags::eDeviceLocal;
+            break;
+        }
+        case Memory_usage::staging:
+        {
+            // Uncached is write-combined, which is best for sequential writes
+            required  = Flags::eHostVisible | Flags::eHostCoherent;
+            avoided   = Flags::eDeviceLocal | Flags::eHostCached;
+            break;
+        }
+        case Memory_usage::gpu_to_cpu:
+        {
+            required  = Flags::eHostVisible | Flags::eHostCoherent;
+            preferred = Flags::eHostCached;
+            break;
+        }
+        case Memory_usage::gpu_upload:
+        {
+            required  = Flags::eDeviceLocal;
+            preferred = Flags::eHostVisible | Flags::eHostCoherent;
+            break;
+        }
+    }
+    const vk::MemoryPropertyFlags excluded = Flags::eLazilyAllocated | Flags::eProtected;
+
+    struct Candidate
+    {
+        uint32_t memory_type_index;
+        int      cost;
+    };
+    std::vector<Candidate> candidates;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+    {
+        const vk::MemoryPropertyFlags flags = memory_properties.memoryTypes[i].propertyFlags;
+        if (((memory_type_bits & (1u << i)) == 0) ||
+            ((flags & required) != required) ||
+            (flags & excluded))
+        {
+            continue;
+        }
+        const int cost = std::popcount(static_cast<VkMemoryPropertyFlags>(preferred & ~flags)) +
+                         std::popcount(static_cast<VkMemoryPropertyFlags>(avoided & flags));
+        candidates.push_back(Candidate{i, cost});
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &lhs, const Candidate &rhs)
+    {
+        return lhs.cost < rhs.cost;
+    });
+
+    std::vector<uint32_t> result;
+    for (const auto &candidate : candidates)
+    {
+        result.push_back(candidate.memory_type_index);
+    }
+    return result;
+}
+
+Memory_allocator::Memory_allocator(Context &context)
+    : Memory_allocator{context.vk_device,
+                       get_physical_device(context).get_memory_properties(),
+                       get_physical_device(context).get_properties().limits.bufferImageGranularity}
+{
+}
+
+Memory_allocator::Memory_allocator(vk::Device                                vk_device,
+                                   const vk::PhysicalDeviceMemoryProperties &memory_properties,
+                                   uint64_t                                  buffer_image_granularity)
+{
+    Expects(vk_device);
+
+    m_vk_device         = vk_device;
+    m_memory_properties = memory_properties;
+
+    m_separate_tiling = buffer_image_granularity > 1;
+
+    for (uint32_t i = 0; i < m_memory_properties.memoryHeapCount; ++i)
+    {
+        log_vulkan.trace("Memory heap {}: {:.0f} MiB, {}, block size {:.0f} MiB\n",
+                         i,
+                         to_mib(m_memory_properties.memoryHeaps[i].size),
+                         vk::to_string(m_memory_properties.memoryHeaps[i].flags),
+                         to_mib(get_block_size(i)));
+    }
+    log_vulkan.trace("bufferImageGranularity {}, {} blocks for linear and optimal tiling\n",
+                     buffer_image_granularity,
+                     m_separate_tiling ? "separate" : "shared");
+
+    const char *direct_write = getenv("VIPU_DIRECT_WRITE");
+    m_direct_write_enabled = (direct_write == nullptr) || (strcmp(direct_write, "0") != 0);
+    for (uint32_t i = 0; i < m_memory_properties.memoryTypeCount; ++i)
+    {
+        if (is_direct_write_type(i))
+        {
+            log_vulkan.info("Direct write memory type {} in heap {}, {:.0f} MiB{}\n",
+                            i,
+                            get_heap_index(i),
+                            to_mib(m_memory_properties.memoryHeaps[get_heap_index(i)].size),
+                            m_direct_write_enabled ? "" : ", disabled by VIPU_DIRECT_WRITE");
+        }
+    }
+}
+
+Memory_allocator::~Memory_allocator()
+{
+    for (auto &block : m_blocks)
+    {
+        if (!block.memory)
+        {
+            continue;
+        }
+        if (block.allocator.get_allocation_count() > 0)
+        {
+            log_vulkan.warn("Memory block of type {} freed with {} allocations\n",
+                            block.memory_type_index,
+                            block.allocator.get_allocation_count());
+        }
+        m_vk_device.freeMemory(block.memory);
+    }
+}
+
+auto Memory_allocator::is_host_visible(uint32_t memory_type_index) const
+-> bool
+{
+    return static_cast<bool>(m_memory_properties.memoryTypes[memory_type_index].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+}
+
+auto Memory_allocator::get_heap_index(uint32_t memory_type_index) const
+-> uint32_t
+{
+    return m_memory_properties.memoryTypes[memory_type_index].heapIndex;
+}
+
+auto Memory_allocator::is_direct_write_type(uint32_t memory_type_index) const
+-> bool
+{
+    using Flags = vk::MemoryPropertyFlagBits;
+    const vk::MemoryPropertyFlags required = Flags::eDeviceLocal | Flags::eHostVisible | Flags::eHostCoherent;
+    return (m_memory_properties.memoryTypes[memory_type_index].propertyFlags & required) == required;
+}
+
+auto Memory_allocator::is_direct_write_preferred(uint32_t memory_type_index, uint64_t size) const
+-> bool
+{
+    if (!m_direct_write_enabled || !is_direct_write_type(memory_type_index))
+    {
+        return false;
+    }
+    const uint32_t heap_index = get_heap_index(memory_type_index);
+    const uint64_t heap_size  = m_memory_properties.memoryHeaps[heap_index].size;
+    const auto    &statistics = m_heap_statistics[heap_index];
+    const uint64_t used_size  = statistics.block_bytes + statistics.dedicated_bytes;
+    return (heap_size > large_heap_size) &&
+           ((used_size + size) * direct_write_heap_usage_denominator <= heap_size * direct_write_heap_usage_numerator);
+}
+
+// Small heaps, like 256 MiB BAR heaps without resizable BAR, get 1/8 of the
+// heap per block, so that one block does not take all of it
+auto Memory_allocator::get_block_size(uint32_t heap_index) const
+-> uint64_t
+{
+    const uint64_t heap_size = m_memory_properties.memoryHeaps[heap_index].size;
+    return (heap_size <= large_heap_size) ? heap_size / 8 : large_block_size;
+}
+
+auto Memory_allocator::allocate(const vk::MemoryRequirements &requirements,
+                                Memory_usage                  usage,
+                                Resource_tiling               tiling)
+-> Memory_allocation
+{
+    return allocate_internal(requirements, usage, tiling, false, Dedicated_resource{});
+}
+
+auto Memory_allocator::allocate_for_buffer(vk::Buffer buffer, Memory_usage usage)
+-> Memory_allocation
+{
+    auto chain = m_vk_device.getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+        vk::BufferMemoryRequirementsInfo2{buffer}
+    );
+    const auto &requirements = chain.get<vk::MemoryRequirements2>().memoryRequirements;
+    const auto &dedicated    = chain.get<vk::MemoryDedicatedRequirements>();
+
+    Memory_allocation allocation = allocate_internal(requirements,
+                                                     usage,
+                                                     Resource_tiling::linear,
+                                                     dedicated.requiresDedicatedAllocation || dedicated.prefersDedicatedAllocation,
+                                                     Dedicated_resource{buffer, vk::Image{}});
+    if (allocation.is_valid())
+    {
+        m_vk_device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+    }
+    return allocation;
+}
+
+auto Memory_allocator::allocate_for_image(vk::Image image, Memory_usage usage, Resource_tiling tiling)
+-> Memory_allocation
+{
+    auto chain = m_vk_device.getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+        vk::ImageMemoryRequirementsInfo2{image}
+    );
+    const auto &requirements = chain.get<vk::MemoryRequirements2>().memoryRequirements;
+    const auto &dedicated    = chain.get<vk::MemoryDedicatedRequirements>();
+
+    Memory_allocation allocation = allocate_internal(requirements,
+                                                     usage,
+                                                     tiling,
+                                                     dedicated.requiresDedicatedAllocation || dedicated.prefersDedicatedAllocation,
+                                                     Dedicated_resource{vk::Buffer{}, image});
+    if (allocation.is_valid())
+    {
+        m_vk_device.bindImageMemory(image, allocation.memory, allocation.offset);
+    }
+    return allocation;
+}
+
+auto Memory_allocator::allocate_internal(const vk::MemoryRequirements &requirements,
+                                         Memory_usage                  usage,
+                                         Resource_tiling               tiling,
+                                         bool                          dedicated,
+                                         Dedicated_resource            dedicated_resource)
+-> Memory_allocation
+{
+    auto candidates = get_memory_type_candidates(m_memory_properties, requirements.memoryTypeBits, usage);
+    if (candidates.empty())
+    {
+        log_vulkan.warn("No memory type for {} usage in type bits {:#x}\n", c_str(usage), requirements.memoryTypeBits);
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Uploads fall back to staging when direct write types are not
+    // preferred. They are still used if nothing else fits.
+    if (usage == Memory_usage::gpu_upload)
+    {
+        std::stable_partition(candidates.begin(), candidates.end(), [&](uint32_t memory_type_index)
+        {
+            return is_direct_write_preferred(memory_type_index, requirements.size) ||
+                   !is_host_visible(memory_type_index);
+        });
+    }
+
+    // Falls back to worse matching types when a heap is full
+    for (uint32_t memory_type_index : candidates)
+    {
+        const uint32_t heap_index = get_heap_index(memory_type_index);
+        const bool use_dedicated = dedicated || (requirements.size > get_block_size(heap_index) / 2);
+
+        Memory_allocation allocation = use_dedicated
+            ? allocate_dedicated(requirements.size, memory_type_index, dedicated_resource)
+            : allocate_from_blocks(requirements, memory_type_index, tiling);
+        if (allocation.is_valid())
+        {
+            auto &statistics = m_heap_statistics[heap_index];
+            ++statistics.allocation_count;
+            statistics.allocated_bytes += allocation.size;
+            return allocation;
+        }
+    }
+
+    log_vulkan.warn("Out of device memory for {} bytes of {} usage\n", requirements.size, c_str(usage));
+    return {};
+}
+
+auto Memory_allocator::allocate_dedicated(uint64_t           size,
+                                          uint32_t           memory_type_index,
+                                          Dedicated_resource dedicated_resource)
+-> Memory_allocation
+{
+    void *mapped{nullptr};
+    vk::DeviceMemory memory = allocate_device_memory(size, memory_type_index, dedicated_resource, &mapped);
+    if (!memory)
+    {
+        return {};
+    }
+
+    auto &statistics = m_heap_statistics[get_heap_index(memory_type_index)];
+    ++statistics.dedicated_count;
+    statistics.dedicated_bytes += size;
+
+    Memory_allocation allocation;
+    allocation.memory            = memory;
+    allocation.offset            = 0;
+    allocation.size              = size;
+    allocation.mapped            = mapped;
+    allocation.memory_type_index = memory_type_index;
+    return allocation;
+}
+
+auto Memory_allocator::allocate_from_blocks(const vk::MemoryRequirements &requirements,
+                                            uint32_t                      memory_type_index,
+                                            Resource_tiling               tiling)
+-> Memory_allocation
+{
+    if (!m_separate_tiling)
+    {
+        tiling = Resource_tiling::linear;
+    }
+
+    auto make_allocation = [&](uint32_t block_index, Tlsf_allocator::Allocation sub_allocation)
+    {
+        const Block &block = m_blocks[block_index];
+        Memory_allocation allocation;
+        allocation.memory            = block.memory;
+        allocation.offset            = sub_allocation.offset;
+        allocation.size              = requirements.size;
+        allocation.mapped            = (block.mapped != nullptr) ? block.mapped + sub_allocation.offset : nullptr;
+        allocation.memory_type_index = memory_type_index;
+        allocation.block_index       = block_index;
+        allocation.sub_allocation    = sub_allocation;
+        return allocation;
+    };
+
+    uint32_t unused_block_index{invalid_block};
+    for (uint32_t block_index = 0; block_index < m_blocks.size(); ++block_index)
+    {
+        Block &block = m_blocks[block_index];
+        if (!block.memory)
+        {
+            unused_block_index = block_index;
+            continue;
+        }
+        if ((block.memory_type_index != memory_type_index) || (block.tiling != tiling))
+        {
+            continue;
+        }
+        auto sub_allocation = block.allocator.allocate(requirements.size, requirements.alignment);
+        if (sub_allocation.is_valid())
+        {
+            return make_allocation(block_index, sub_allocation);
+        }
+    }
+
+    const uint32_t heap_index = get_heap_index(memory_type_index);
+    const uint64_t block_size = get_block_size(heap_index);
+    void *mapped{nullptr};
+    vk::DeviceMemory memory = allocate_device_memory(block_size, memory_type_index, Dedicated_resource{}, &mapped);
+    if (!memory)
+    {
+        return {};
+    }
+
+    if (unused_block_index == invalid_block)
+    {
+        unused_block_index = static_cast<uint32_t>(m_blocks.size());
+        m_blocks.emplace_back();
+    }
+    Block &block = m_blocks[unused_block_index];
+    block.memory            = memory;
+    block.memory_type_index = memory_type_index;
+    block.tiling            = tiling;
+    block.mapped            = static_cast<uint8_t *>(mapped);
+    block.allocator         = Tlsf_allocator{block_size};
+
+    auto &statistics = m_heap_statistics[heap_index];
+    ++statistics.block_count;
+    statistics.block_bytes += block_size;
+
+    auto sub_allocation = block.allocator.allocate(requirements.size, requirements.alignment);
+    VERIFY(sub_allocation.is_valid());
+    return make_allocation(unused_block_index, sub_allocation);
+}
+
+auto Memory_allocator::allocate_device_memory(uint64_t           size,
+                                              uint32_t           memory_type_index,
+                                              Dedicated_resource dedicated_resource,
+                                              void             **mapped)
+-> vk::DeviceMemory
+{
+    vk::MemoryAllocateInfo          allocate_info{size, memory_type_index};
+    vk::MemoryDedicatedAllocateInfo dedicated_allocate_info{dedicated_resource.image, dedicated_resource.buffer};
+    if (dedicated_resource.image || dedicated_resource.buffer)
+    {
+        allocate_info.setPNext(&dedicated_allocate_info);
+    }
+
+    vk::DeviceMemory memory;
+    try
+    {
+        memory = m_vk_device.allocateMemory(allocate_info);
+    }
+    catch (const vk::SystemError &error)
+    {
+        log_vulkan.warn("allocateMemory of {} bytes from memory type {} failed: {}\n", size, memory_type_index, error.what());
+        return {};
+    }
+
+    *mapped = is_host_visible(memory_type_index)
+        ? m_vk_device.mapMemory(memory, 0, VK_WHOLE_SIZE)
+        : nullptr;
+    return memory;
+}
+
+void Memory_allocator::free(Memory_allocation &allocation)
+{
+    if (!allocation.is_valid())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint32_t heap_index = get_heap_index(allocation.memory_type_index);
+    auto &statistics = m_heap_statistics[heap_index];
+    --statistics.allocation_count;
+    statistics.allocated_bytes -= allocation.size;
+
+    if (allocation.block_index == invalid_block)
+    {
+        m_vk_device.freeMemory(allocation.memory);
+        --statistics.dedicated_count;
+        statistics.dedicated_bytes -= allocation.size;
+        allocation = Memory_allocation{};
+        return;
+    }
+
+    Block &block = m_blocks[allocation.block_index];
+    block.allocator.free(allocation.sub_allocation);
+
+    // Keeps one empty block per memory type and tiling to avoid allocating
+    // and freeing device memory repeatedly
+    if (block.allocator.get_allocation_count() == 0)
+    {
+        const bool has_other_block = std::any_of(m_blocks.begin(), m_blocks.end(), [&](const Block &other)
+        {
+            return (&other != &block) &&
+                   other.memory &&
+                   (other.memory_type_index == block.memory_type_index) &&
+                   (other.tiling == block.tiling);
+        });
+        if (has_other_block)
+        {
+            m_vk_device.freeMemory(block.memory);
+            --statistics.block_count;
+            statistics.block_bytes -= block.allocator.get_size();
+            block = Block{};
+        }
+    }
+    allocation = Memory_allocation{};
+}
+
+auto Memory_allocator::get_heap_statistics(uint32_t heap_index) const
+-> Heap_statistics
+{
+    Expects(heap_index < m_memory_properties.memoryHeapCount);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_heap_statistics[heap_index];
+}
+
+auto Memory_allocator::get_memory_properties() const
+-> const vk::PhysicalDeviceMemoryProperties &
+{
+    return m_memory_properties;
+}
+
+auto Memory_allocator::has_direct_write_memory() const
+-> bool
+{
+    if (!m_direct_write_enabled)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < m_memory_properties.memoryTypeCount; ++i)
+    {
+        if (is_direct_write_type(i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto Memory_allocator::get_direct_write_pointer(const Memory_allocation &allocation) const
+-> void *
+{
+    if (!allocation.is_valid() || !m_direct_write_enabled || !is_direct_write_type(allocation.memory_type_index))
+    {
+        return nullptr;
+    }
+    return allocation.mapped;
+}
+
+void Memory_allocator::log_statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t i = 0; i < m_memory_properties.memoryHeapCount; ++i)
+    {
+        const auto &statistics = m_heap_statistics[i];
+        log_vulkan.info("Memory heap {}: {} blocks {:.1f} MiB, {} dedicated {:.1f} MiB, {} allocations {:.1f} MiB\n",
+                        i,
+                        statistics.block_count,
+                        to_mib(statistics.block_bytes),
+                        statistics.dedicated_count,
+                        to_mib(statistics.dedicated_bytes),
+                        statistics.allocation_count,
+                        to_mib(statistics.allocated_bytes));
+    }
+}
+
+Linear_memory_arena::Linear_memory_arena(Memory_allocator &allocator,
+                                         uint64_t          size,
+                                         uint32_t          memory_type_bits,
+                                         Memory_usage      usage,
+                                         Resource_tiling   tiling)
+    : m_allocator       {allocator}
+    , m_linear_allocator{size}
+{
+    m_allocation = m_allocator.allocate(vk::MemoryRequirements{size, max_alignment, memory_type_bits}, usage, tiling);
+    VERIFY(m_allocation.is_valid());
+}
+
+Linear_memory_arena::~Linear_memory_arena()
+{
+    m_allocator.free(m_allocation);
+}
+
+auto Linear_memory_arena::allocate(const vk::MemoryRequirements &requirements)
+-> Transient_allocation
+{
+    // Offsets are aligned relative to the arena, which is only aligned to
+    // max_alignment in device memory
+    Expects(requirements.alignment <= max_alignment);
+
+    if ((requirements.memoryTypeBits & (1u << m_allocation.memory_type_index)) == 0)
+    {
+        return {};
+    }
+
+    const uint64_t offset = m_linear_allocator.allocate(requirements.size, requirements.alignment);
+    if (offset == Linear_allocator::invalid_offset)
+    {
+        return {};
+    }
+
+    Transient_allocation allocation;
+    allocation.memory = m_allocation.memory;
+    allocation.offset = m_allocation.offset + offset;
+    allocation.size   = requirements.size;
+    allocation.mapped = (m_allocation.mapped != nullptr) ? static_cast<uint8_t *>(m_allocation.mapped) + offset : nullptr;
+    return allocation;
+}
+
+void Linear_memory_arena::reset()
+{
+    m_linear_allocator.reset();
+}
+
+auto Linear_memory_arena::get_allocation() const
+-> const Memory_allocation &
+{
+    return m_allocation;
+}
+
+auto Linear_memory_arena::get_used_size() const
+-> uint64_t
+{
+    return m_linear_allocator.get_used_size();
+}
+
+} // namespace vipu
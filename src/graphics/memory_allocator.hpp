@@ -0,0 +1,256 @@
+#ifndef memory_allocator_hpp_vipu_graphics
+#define memory_allocator_hpp_vipu_graphics
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+#include "memory/linear_allocator.hpp"
+#include "memory/tlsf_allocator.hpp"
+
+namespace vipu
+{
+
+class Context;
+
+enum class Memory_usage
+{
+    gpu_only = 0,   // device local, preferably not host visible
+    cpu_to_gpu,     // host visible and coherent, preferably device local; dynamic data
+    staging,        // host visible and coherent, preferably not device local
+    gpu_to_cpu,     // host visible and coherent, preferably host cached; readback
+    gpu_upload      // device local, preferably host visible and coherent so that
+                    // uploads can write directly; see Memory_allocator
+};
+
+// Linear (buffers, linear images) and optimal tiling resources must not
+// share a bufferImageGranularity page. When the granularity is larger than
+// one byte, they are kept in separate blocks.
+enum class Resource_tiling
+{
+    linear = 0,
+    optimal
+};
+
+auto c_str(Memory_usage usage)
+-> const char *;
+
+// Memory types in memory_type_bits which have the required flags for usage,
+// best match first
+auto get_memory_type_candidates(const vk::PhysicalDeviceMemoryProperties &memory_properties,
+                                uint32_t                                  memory_type_bits,
+                                Memory_usage                              usage)
+-> std::vector<uint32_t>;
+
+struct Memory_allocation
+{
+    vk::DeviceMemory memory;
+    uint64_t         offset           {0};
+    uint64_t         size             {0};
+    void            *mapped           {nullptr}; // at offset, nullptr if not host visible
+    uint32_t         memory_type_index{std::numeric_limits<uint32_t>::max()};
+
+    uint32_t                   block_index{std::numeric_limits<uint32_t>::max()}; // max for dedicated
+    Tlsf_allocator::Allocation sub_allocation;
+
+    auto is_valid() const
+    -> bool
+    {
+        return static_cast<bool>(memory);
+    }
+};
+
+// Allocates large device memory blocks per memory type, and sub-allocates
+// resources from them with Tlsf_allocator. Large resources, and resources
+// which require it, get dedicated allocations. Host visible blocks stay
+// mapped. Thread safe.
+class Memory_allocator
+{
+public:
+    struct Heap_statistics
+    {
+        uint64_t block_count     {0};
+        uint64_t block_bytes     {0};  // device memory allocated for blocks
+        uint64_t dedicated_count {0};
+        uint64_t dedicated_bytes {0};
+        uint64_t allocation_count{0};  // sub-allocations and dedicated allocations
+        uint64_t allocated_bytes {0};
+    };
+
+    explicit Memory_allocator(Context &context);
+
+    // Without Context, for tests which create the device themselves
+    Memory_allocator(vk::Device                                vk_device,
+                     const vk::PhysicalDeviceMemoryProperties &memory_properties,
+                     uint64_t                                  buffer_image_granularity);
+
+    ~Memory_allocator();
+
+    Memory_allocator(const Memory_allocator &) = delete;
+    Memory_allocator &operator=(const Memory_allocator &) = delete;
+
+    // Returns invalid allocation if no suitable memory type has room
+    auto allocate(const vk::MemoryRequirements &requirements,
+                  Memory_usage                  usage,
+                  Resource_tiling               tiling)
+    -> Memory_allocation;
+
+    // Allocates and binds
+    auto allocate_for_buffer(vk::Buffer buffer, Memory_usage usage)
+    -> Memory_allocation;
+
+    // Allocates and binds
+    auto allocate_for_image(vk::Image image, Memory_usage usage, Resource_tiling tiling)
+    -> Memory_allocation;
+
+    // Resets allocation
+    void free(Memory_allocation &allocation);
+
+    auto get_heap_statistics(uint32_t heap_index) const
+    -> Heap_statistics;
+
+    auto get_memory_properties() const
+    -> const vk::PhysicalDeviceMemoryProperties &;
+
+    // True if some memory type is device local, host visible and host
+    // coherent (integrated GPUs, resizable BAR), and direct writes have not
+    // been disabled with VIPU_DIRECT_WRITE=0
+    auto has_direct_write_memory() const
+    -> bool;
+
+    // Mapped pointer of allocation if its memory type allows direct writes,
+    // otherwise nullptr
+    auto get_direct_write_pointer(const Memory_allocation &allocation) const
+    -> void *;
+
+    void log_statistics() const;
+
+private:
+    struct Block
+    {
+        vk::DeviceMemory memory;
+        uint32_t         memory_type_index{0};
+        Resource_tiling  tiling{Resource_tiling::linear};
+        uint8_t         *mapped{nullptr};
+        Tlsf_allocator   allocator{0};
+    };
+
+    struct Dedicated_resource
+    {
+        vk::Buffer buffer;
+        vk::Image  image;
+    };
+
+    auto allocate_internal(const vk::MemoryRequirements &requirements,
+                           Memory_usage                  usage,
+                           Resource_tiling               tiling,
+                           bool                          dedicated,
+                           Dedicated_resource            dedicated_resource)
+    -> Memory_allocation;
+
+    auto allocate_dedicated(uint64_t           size,
+                            uint32_t           memory_type_index,
+                            Dedicated_resource dedicated_resource)
+    -> Memory_allocation;
+
+    auto allocate_from_blocks(const vk::MemoryRequirements &requirements,
+                              uint32_t                      memory_type_index,
+                              Resource_tiling               tiling)
+    -> Memory_allocation;
+
+    // Returns null handle if out of memory
+    auto allocate_device_memory(uint64_t           size,
+                                uint32_t           memory_type_index,
+                                Dedicated_resource dedicated_resource,
+                                void             **mapped)
+    -> vk::DeviceMemory;
+
+    auto is_host_visible(uint32_t memory_type_index) const
+    -> bool;
+
+    auto get_heap_index(uint32_t memory_type_index) const
+    -> uint32_t;
+
+    auto is_direct_write_type(uint32_t memory_type_index) const
+    -> bool;
+
+    // Direct write types are avoided for gpu_upload on small heaps, like
+    // 256 MiB BAR heaps, and when the heap is mostly used. Called with
+    // m_mutex locked.
+    auto is_direct_write_preferred(uint32_t memory_type_index, uint64_t size) const
+    -> bool;
+
+    auto get_block_size(uint32_t heap_index) const
+    -> uint64_t;
+
+    vk::Device                                          m_vk_device;
+    vk::PhysicalDeviceMemoryProperties                  m_memory_properties;
+    bool                                                m_separate_tiling{false};
+    bool                                                m_direct_write_enabled{true};
+    mutable std::mutex                                  m_mutex;
+    std::vector<Block>                                  m_blocks;  // freed blocks have null memory
+    std::array<Heap_statistics, VK_MAX_MEMORY_HEAPS>    m_heap_statistics;
+};
+
+// Range of a Linear_memory_arena, released with Linear_memory_arena::reset()
+struct Transient_allocation
+{
+    vk::DeviceMemory memory;
+    uint64_t         offset{0};
+    uint64_t         size  {0};
+    void            *mapped{nullptr};
+
+    auto is_valid() const
+    -> bool
+    {
+        return static_cast<bool>(memory);
+    }
+};
+
+// Transient allocations from one Memory_allocator allocation with
+// Linear_allocator. allocate() is lock-free; reset() releases everything
+// and must only be called once the GPU no longer uses the memory.
+class Linear_memory_arena
+{
+public:
+    // Alignment of the arena allocation, and so the largest alignment
+    // allocate() supports, as offsets are aligned within the arena
+    static constexpr uint64_t max_alignment{64 * 1024};
+
+    Linear_memory_arena(Memory_allocator &allocator,
+                        uint64_t          size,
+                        uint32_t          memory_type_bits,
+                        Memory_usage      usage,
+                        Resource_tiling   tiling);
+
+    ~Linear_memory_arena();
+
+    Linear_memory_arena(const Linear_memory_arena &) = delete;
+    Linear_memory_arena &operator=(const Linear_memory_arena &) = delete;
+
+    // Returns invalid allocation if the arena is full, or if memory type
+    // of arena is not in requirements.memoryTypeBits. requirements.alignment
+    // must not exceed max_alignment.
+    auto allocate(const vk::MemoryRequirements &requirements)
+    -> Transient_allocation;
+
+    void reset();
+
+    auto get_allocation() const
+    -> const Memory_allocation &;
+
+    auto get_used_size() const
+    -> uint64_t;
+
+private:
+    Memory_allocator &m_allocator;
+    Memory_allocation m_allocation;
+    Linear_allocator  m_linear_allocator;
+};
+
+} // namespace vipu
+
+#endif // memory_allocator_hpp_vipu_graphics
@@ -0,0 +1,225 @@
+#include <algorithm>
+
+#include "gsl/gsl"
+
+#include "graphics/memory_budget.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+#include "graphics/memory_allocator.hpp"
+#include "graphics/physical_device.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+// Budget of a heap without VK_EXT_memory_budget, as share of heap size
+constexpr uint64_t fallback_budget_numerator  {8};
+constexpr uint64_t fallback_budget_denominator{10};
+
+auto to_mib(uint64_t bytes)
+-> double
+{
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+auto get_pressure(uint64_t usage, uint64_t budget)
+-> Memory_pressure
+{
+    if (budget == 0)
+    {
+        return Memory_pressure::critical;
+    }
+    const double ratio = static_cast<double>(usage) / static_cast<double>(budget);
+    if (ratio > Memory_budget::critical_pressure_ratio)
+    {
+        return Memory_pressure::critical;
+    }
+    if (ratio > Memory_budget::high_pressure_ratio)
+    {
+        return Memory_pressure::high;
+    }
+    return Memory_pressure::normal;
+}
+
+} // anonymous namespace
+
+auto c_str(Memory_pressure pressure)
+-> const char *
+{
+    switch (pressure)
+    {
+        case Memory_pressure::normal:   return "normal";
+        case Memory_pressure::high:     return "high";
+        case Memory_pressure::critical: return "critical";
+        default:                        return "?";
+    }
+}
+
+Memory_budget::Memory_budget(Context &context, uint32_t update_interval)
+{
+    Expects(context.physical_device != nullptr);
+    Expects(context.memory_allocator != nullptr);
+    Expects(update_interval > 0);
+
+    m_physical_device  = context.physical_device;
+    m_memory_allocator = context.memory_allocator;
+    m_use_extension    = context.device_features.memory_budget;
+    m_update_interval  = update_interval;
+    m_heap_count       = m_physical_device->get_memory_properties().memoryHeapCount;
+
+    log_vulkan.info("Memory budget from {}, updated every {} frames\n",
+                    m_use_extension ? "VK_EXT_memory_budget" : "allocator accounting",
+                    update_interval);
+
+    update();
+}
+
+void Memory_budget::begin_frame(uint64_t frame_number)
+{
+    if ((frame_number % m_update_interval) == 0)
+    {
+        update();
+    }
+}
+
+void Memory_budget::update()
+{
+    const auto &memory_properties = m_physical_device->get_memory_properties();
+
+    vk::PhysicalDeviceMemoryBudgetPropertiesEXT budget_properties;
+    if (m_use_extension)
+    {
+        budget_properties = m_physical_device->query_memory_budget();
+    }
+
+    // Callbacks are called without holding the lock, so that they may query
+    // budgets and free memory
+    std::vector<std::pair<uint32_t, Heap_budget>> notifications;
+    std::vector<Registered_callback>              callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_update_count;
+        for (uint32_t i = 0; i < m_heap_count; ++i)
+        {
+            const auto statistics = m_memory_allocator->get_heap_statistics(i);
+
+            Heap_budget heap_budget;
+            heap_budget.heap_size       = memory_properties.memoryHeaps[i].size;
+            heap_budget.allocated_bytes = statistics.block_bytes + statistics.dedicated_bytes;
+            if (m_use_extension)
+            {
+                heap_budget.budget = budget_properties.heapBudget[i];
+                heap_budget.usage  = budget_properties.heapUsage[i];
+            }
+            else
+            {
+                heap_budget.budget = heap_budget.heap_size * fallback_budget_numerator / fallback_budget_denominator;
+                heap_budget.usage  = heap_budget.allocated_bytes;
+            }
+            heap_budget.pressure = get_pressure(heap_budget.usage, heap_budget.budget);
+
+            const Memory_pressure previous_pressure = m_heap_budgets[i].pressure;
+            m_heap_budgets[i] = heap_budget;
+            m_peak_usage[i]   = std::max(m_peak_usage[i], heap_budget.usage);
+
+            if (heap_budget.pressure != previous_pressure)
+            {
+                log_vulkan.warn("Memory heap {} pressure {}: usage {:.1f} MiB, budget {:.1f} MiB\n",
+                                i,
+                                c_str(heap_budget.pressure),
+                                to_mib(heap_budget.usage),
+                                to_mib(heap_budget.budget));
+            }
+            if ((heap_budget.pressure != Memory_pressure::normal) || (previous_pressure != Memory_pressure::normal))
+            {
+                notifications.emplace_back(i, heap_budget);
+            }
+        }
+        if (!notifications.empty())
+        {
+            callbacks = m_callbacks;
+        }
+    }
+
+    for (const auto &notification : notifications)
+    {
+        for (const auto &callback : callbacks)
+        {
+            callback.callback(notification.first, notification.second);
+        }
+    }
+}
+
+auto Memory_budget::add_callback(Callback callback)
+-> uint32_t
+{
+    Expects(callback);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint32_t id = m_next_callback_id++;
+    m_callbacks.push_back(Registered_callback{id, std::move(callback)});
+    return id;
+}
+
+void Memory_budget::remove_callback(uint32_t callback_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callbacks.erase(std::remove_if(m_callbacks.begin(), m_callbacks.end(), [callback_id](const Registered_callback &callback)
+                                     {
+                                         return callback.id == callback_id;
+                                     }),
+                      m_callbacks.end());
+}
+
+auto Memory_budget::get_heap_count() const
+-> uint32_t
+{
+    return m_heap_count;
+}
+
+auto Memory_budget::get_heap_budget(uint32_t heap_index) const
+-> Heap_budget
+{
+    Expects(heap_index < m_heap_count);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_heap_budgets[heap_index];
+}
+
+auto Memory_budget::get_pressure() const
+-> Memory_pressure
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Memory_pressure pressure{Memory_pressure::normal};
+    for (uint32_t i = 0; i < m_heap_count; ++i)
+    {
+        pressure = std::max(pressure, m_heap_budgets[i].pressure);
+    }
+    return pressure;
+}
+
+auto Memory_budget::is_using_memory_budget_extension() const
+-> bool
+{
+    return m_use_extension;
+}
+
+void Memory_budget::log_statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t i = 0; i < m_heap_count; ++i)
+    {
+        const auto &heap_budget = m_heap_budgets[i];
+        log_vulkan.info("Memory heap {} budget: usage {:.1f} MiB, peak {:.1f} MiB, budget {:.1f} MiB, allocated {:.1f} MiB, {} updates\n",
+                        i,
+                        to_mib(heap_budget.usage),
+                        to_mib(m_peak_usage[i]),
+                        to_mib(heap_budget.budget),
+                        to_mib(heap_budget.allocated_bytes),
+                        m_update_count);
+    }
+}
+
+} // namespace vipu
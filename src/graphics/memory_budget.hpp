@@ -0,0 +1,105 @@
+#ifndef memory_budget_hpp_vipu_graphics
+#define memory_budget_hpp_vipu_graphics
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+class Context;
+class Memory_allocator;
+class Physical_device;
+
+enum class Memory_pressure : uint32_t
+{
+    normal = 0,
+    high,       // usage above high_pressure_ratio of budget
+    critical    // usage above critical_pressure_ratio of budget
+};
+
+auto c_str(Memory_pressure pressure)
+-> const char *;
+
+struct Heap_budget
+{
+    uint64_t        heap_size      {0};
+    uint64_t        budget         {0};  // VK_EXT_memory_budget, or 80% of heap size without it
+    uint64_t        usage          {0};  // whole process with VK_EXT_memory_budget, otherwise allocated_bytes
+    uint64_t        allocated_bytes{0};  // device memory allocated by Memory_allocator
+    Memory_pressure pressure       {Memory_pressure::normal};
+};
+
+// Tracks usage and budget of each memory heap, with VK_EXT_memory_budget when
+// it is enabled, and with Memory_allocator accounting otherwise. Budgets are
+// queried every update_interval frames from begin_frame(). Callbacks are
+// called from update() for each heap above normal pressure, and once more
+// when a heap returns to normal, so that streaming systems can evict or
+// downscale resources before allocations start to fail.
+class Memory_budget
+{
+public:
+    static constexpr double high_pressure_ratio    {0.80};
+    static constexpr double critical_pressure_ratio{0.95};
+
+    using Callback = std::function<void(uint32_t heap_index, const Heap_budget &heap_budget)>;
+
+    Memory_budget(Context &context, uint32_t update_interval = 30);
+
+    Memory_budget(const Memory_budget &) = delete;
+    Memory_budget &operator=(const Memory_budget &) = delete;
+
+    // Calls update() every update_interval frames
+    void begin_frame(uint64_t frame_number);
+
+    void update();
+
+    // Returns callback ID for remove_callback()
+    auto add_callback(Callback callback)
+    -> uint32_t;
+
+    void remove_callback(uint32_t callback_id);
+
+    auto get_heap_count() const
+    -> uint32_t;
+
+    auto get_heap_budget(uint32_t heap_index) const
+    -> Heap_budget;
+
+    // Highest pressure of all heaps
+    auto get_pressure() const
+    -> Memory_pressure;
+
+    auto is_using_memory_budget_extension() const
+    -> bool;
+
+    void log_statistics() const;
+
+private:
+    struct Registered_callback
+    {
+        uint32_t id{0};
+        Callback callback;
+    };
+
+    Physical_device                                *m_physical_device {nullptr};
+    Memory_allocator                               *m_memory_allocator{nullptr};
+    bool                                            m_use_extension   {false};
+    uint32_t                                        m_update_interval {30};
+    uint32_t                                        m_heap_count      {0};
+    mutable std::mutex                              m_mutex;
+    std::array<Heap_budget, VK_MAX_MEMORY_HEAPS>    m_heap_budgets;
+    std::array<uint64_t, VK_MAX_MEMORY_HEAPS>       m_peak_usage{};
+    std::vector<Registered_callback>                m_callbacks;
+    uint32_t                                        m_next_callback_id{1};
+    uint64_t                                        m_update_count    {0};
+};
+
+} // namespace vipu
+
+#endif // memory_budget_hpp_vipu_graphics
@@ -16,6 +16,38 @@ Physical_device::Physical_device(Context &context, vk::PhysicalDevice vk_physica
     Expects(context.vk_instance);
     Expects(vk_physical_device);
 
+    // Warm start: properties and device UUID are enough to find the cache
+    // entry, and everything else is copied from the cache. ID properties
+    // are always queried live, as they tell identical GPUs apart.
+    auto &capability_cache = context.instance->get_capability_cache();
+    vk::StructureChain<vk::PhysicalDeviceProperties2,
+                       vk::PhysicalDeviceIDProperties
+    > properties = m_vk_physical_device.getProperties2<vk::PhysicalDeviceProperties2,
+                                                       vk::PhysicalDeviceIDProperties>();
+    m_id_properties       = properties.get<vk::PhysicalDeviceIDProperties>();
+    m_id_properties.pNext = nullptr;
+
+    Capability_cache::Device cached;
+    if (capability_cache.find_device(properties.get<vk::PhysicalDeviceProperties2>().properties, m_id_properties, cached))
+    {
+        use_cached_capabilities(cached);
+        log_vulkan.trace("Using cached capabilities for {}\n", std::string(m_properties.properties.deviceName));
+    }
+    else
+    {
+        enumerate_capabilities();
+        capability_cache.store_device(get_capabilities_for_cache());
+    }
+
+    if (context.surface_type == Surface::Type::eDisplay)
+    {
+        // Scan displays connected to physical device
+        scan_displays(context);
+    }
+}
+
+void Physical_device::enumerate_capabilities()
+{
     m_extensions = m_vk_physical_device.enumerateDeviceExtensionProperties();
     log_vulkan.trace("\tFound {} device extensions\n", m_extensions.size());
     for (auto &extension : m_extensions)
@@ -42,10 +74,16 @@ Physical_device::Physical_device(Context &context, vk::PhysicalDevice vk_physica
 
     {
         vk::StructureChain<vk::PhysicalDeviceProperties2,
-                           vk::PhysicalDeviceDriverProperties
+                           vk::PhysicalDeviceDriverProperties,
+                           vk::PhysicalDeviceIDProperties
         > properties = m_vk_physical_device.getProperties2<vk::PhysicalDeviceProperties2,
-                                                           vk::PhysicalDeviceDriverProperties>();
-        auto &p = properties.get<vk::PhysicalDeviceDriverProperties>();
+                                                           vk::PhysicalDeviceDriverProperties,
+                                                           vk::PhysicalDeviceIDProperties>();
+        m_driver_properties = properties.get<vk::PhysicalDeviceDriverProperties>();
+        m_id_properties     = properties.get<vk::PhysicalDeviceIDProperties>();
+        m_driver_properties.pNext = nullptr;
+        m_id_properties.pNext     = nullptr;
+        auto &p = m_driver_properties;
         log_vulkan.trace("Driver: id = {}, name = {}, info = {}, conformanceVersion = {}.{}.{}.{}\n",
                          vk::to_string(p.driverID),
                          std::string(p.driverName),
@@ -59,20 +97,96 @@ Physical_device::Physical_device(Context &context, vk::PhysicalDevice vk_physica
     m_queue_family_properties = m_vk_physical_device.getQueueFamilyProperties2();
     m_features                = m_vk_physical_device.getFeatures2();
     m_memory_properties       = m_vk_physical_device.getMemoryProperties2();
+}
 
-    if (context.surface_type == Surface::Type::eDisplay)
+void Physical_device::use_cached_capabilities(const Capability_cache::Device &cached)
+{
+    m_extensions                         = cached.extensions;
+    m_properties.properties              = cached.properties;
+    m_driver_properties                  = cached.driver_properties;
+    m_features.features                  = cached.features;
+    m_memory_properties.memoryProperties = cached.memory_properties;
+    m_queue_family_properties.clear();
+    for (const auto &queue_family : cached.queue_families)
     {
-        // Scan displays connected to physical device
-        scan_displays(context);
+        m_queue_family_properties.push_back(vk::QueueFamilyProperties2{queue_family});
     }
 }
 
+auto Physical_device::get_capabilities_for_cache() const
+-> Capability_cache::Device
+{
+    Capability_cache::Device device;
+    device.properties        = m_properties.properties;
+    device.driver_properties = m_driver_properties;
+    device.id_properties     = m_id_properties;
+    device.extensions        = m_extensions;
+    device.features          = m_features.features;
+    device.memory_properties = m_memory_properties.memoryProperties;
+    for (const auto &queue_family : m_queue_family_properties)
+    {
+        device.queue_families.push_back(queue_family.queueFamilyProperties);
+    }
+    return device;
+}
+
 auto Physical_device::get()
 -> vk::PhysicalDevice
 {
     return m_vk_physical_device;
 }
 
+auto Physical_device::get_name() const
+-> std::string
+{
+    return std::string(m_properties.properties.deviceName.data());
+}
+
+auto Physical_device::get_properties() const
+-> const vk::PhysicalDeviceProperties &
+{
+    return m_properties.properties;
+}
+
+auto Physical_device::get_id_properties() const
+-> const vk::PhysicalDeviceIDProperties &
+{
+    return m_id_properties;
+}
+
+auto Physical_device::get_memory_properties() const
+-> const vk::PhysicalDeviceMemoryProperties &
+{
+    return m_memory_properties.memoryProperties;
+}
+
+auto Physical_device::query_memory_budget() const
+-> vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+{
+    auto chain = m_vk_physical_device.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+                                                           vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+    return chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+}
+
+auto Physical_device::get_queue_family_properties() const
+-> const std::vector<vk::QueueFamilyProperties2> &
+{
+    return m_queue_family_properties;
+}
+
+auto Physical_device::has_extension(std::string_view extension_name) const
+-> bool
+{
+    for (const auto &extension : m_extensions)
+    {
+        if (extension_name == extension.extensionName.data())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Physical_device::scan_displays(Context &context)
 {
     Expects(m_vk_physical_device);
@@ -98,7 +212,8 @@ auto Physical_device::choose_queue_family_indices(Context &context)
     Expects(context.vk_surface);
     Expects(!m_queue_family_properties.empty());
 
-    // Find queue family supporting both graphics and present
+    // Prefer queue family supporting both graphics and present. Otherwise
+    // use separate families, and share swapchain images between them.
     uint32_t graphics_queue_family_index = std::numeric_limits<uint32_t>::max();
     uint32_t present_queue_family_index  = std::numeric_limits<uint32_t>::max();
     for (uint32_t queue_family_index = 0;
@@ -108,28 +223,74 @@ auto Physical_device::choose_queue_family_indices(Context &context)
         bool present_supported = m_vk_physical_device.getSurfaceSupportKHR(queue_family_index, context.vk_surface);
         vk::QueueFlags flags = m_queue_family_properties[queue_family_index].queueFamilyProperties.queueFlags;
         bool graphics_supported = (flags & vk::QueueFlagBits::eGraphics) == vk::QueueFlagBits::eGraphics;
-        if (graphics_supported)
+        if (present_supported && graphics_supported)
         {
             graphics_queue_family_index = queue_family_index;
+            present_queue_family_index  = queue_family_index;
+            break;
         }
-        if (present_supported)
+        if (graphics_supported && (graphics_queue_family_index == std::numeric_limits<uint32_t>::max()))
         {
-            present_queue_family_index = queue_family_index;
+            graphics_queue_family_index = queue_family_index;
         }
-        if (present_supported && graphics_supported)
+        if (present_supported && (present_queue_family_index == std::numeric_limits<uint32_t>::max()))
         {
-            break;
+            present_queue_family_index = queue_family_index;
         }
     }
 
     VERIFY(graphics_queue_family_index != std::numeric_limits<uint32_t>::max());
     VERIFY(present_queue_family_index  != std::numeric_limits<uint32_t>::max());
-    VERIFY(graphics_queue_family_index == present_queue_family_index); // TODO
+
+    // Prefer compute family without graphics (async compute), and transfer
+    // family without graphics and compute (usually a DMA engine). Graphics
+    // and compute families also support transfer, even if not reported.
+    uint32_t compute_queue_family_index  = find_queue_family(vk::QueueFlagBits::eCompute,
+                                                             vk::QueueFlagBits::eGraphics);
+    uint32_t transfer_queue_family_index = find_queue_family(vk::QueueFlagBits::eTransfer,
+                                                             vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+    if (compute_queue_family_index == std::numeric_limits<uint32_t>::max())
+    {
+        compute_queue_family_index = graphics_queue_family_index;
+    }
+    if (transfer_queue_family_index == std::numeric_limits<uint32_t>::max())
+    {
+        transfer_queue_family_index = compute_queue_family_index;
+    }
 
     log_vulkan.info("Chose graphics queue family {}\n", graphics_queue_family_index);
     log_vulkan.info("Chose present queue family {}\n", present_queue_family_index);
+    log_vulkan.info("Chose compute queue family {}{}\n",
+                    compute_queue_family_index,
+                    (compute_queue_family_index != graphics_queue_family_index) ? " (dedicated)" : "");
+    log_vulkan.info("Chose transfer queue family {}{}\n",
+                    transfer_queue_family_index,
+                    (transfer_queue_family_index != graphics_queue_family_index) ? " (dedicated)" : "");
+
+    return {
+        graphics_queue_family_index,
+        present_queue_family_index,
+        compute_queue_family_index,
+        transfer_queue_family_index
+    };
+}
 
-    return { graphics_queue_family_index, present_queue_family_index};
+auto Physical_device::find_queue_family(vk::QueueFlags required, vk::QueueFlags excluded) const
+-> uint32_t
+{
+    for (uint32_t queue_family_index = 0;
+         queue_family_index < m_queue_family_properties.size();
+         ++queue_family_index)
+    {
+        const auto &properties = m_queue_family_properties[queue_family_index].queueFamilyProperties;
+        if ((properties.queueCount > 0) &&
+            ((properties.queueFlags & required) == required) &&
+            !(properties.queueFlags & excluded))
+        {
+            return queue_family_index;
+        }
+    }
+    return std::numeric_limits<uint32_t>::max();
 }
 
 auto Physical_device::choose_display(bool use_current_display)
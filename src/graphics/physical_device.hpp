@@ -3,8 +3,11 @@
 
 #include <cstdint>
 #include <limits>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include "graphics/capability_cache.hpp"
 #include "graphics/display.hpp"
 #include "graphics/vulkan.hpp"
 
@@ -14,10 +17,15 @@ namespace vipu
 class Context;
 class Display;
 
+// Compute and transfer use dedicated families when the device has them, so
+// that their work can overlap graphics work. Otherwise they share a family
+// with graphics.
 struct Queue_family_indices
 {
     uint32_t graphics{std::numeric_limits<uint32_t>::max()};
     uint32_t present {std::numeric_limits<uint32_t>::max()};
+    uint32_t compute {std::numeric_limits<uint32_t>::max()};
+    uint32_t transfer{std::numeric_limits<uint32_t>::max()};
 };
 
 class Physical_device
@@ -40,10 +48,47 @@ public:
     auto get()
     -> vk::PhysicalDevice;
 
+    auto get_name() const
+    -> std::string;
+
+    auto get_properties() const
+    -> const vk::PhysicalDeviceProperties &;
+
+    auto get_id_properties() const
+    -> const vk::PhysicalDeviceIDProperties &;
+
+    auto get_memory_properties() const
+    -> const vk::PhysicalDeviceMemoryProperties &;
+
+    // Queries current heap budgets and usage, unlike get_memory_properties()
+    // which is a snapshot. Requires VK_EXT_memory_budget to be enabled.
+    auto query_memory_budget() const
+    -> vk::PhysicalDeviceMemoryBudgetPropertiesEXT;
+
+    auto get_queue_family_properties() const
+    -> const std::vector<vk::QueueFamilyProperties2> &;
+
+    auto has_extension(std::string_view extension_name) const
+    -> bool;
+
 private:
+    // Returns max uint32_t if there is no family with all of required flags
+    // and none of excluded flags
+    auto find_queue_family(vk::QueueFlags required, vk::QueueFlags excluded) const
+    -> uint32_t;
+
+    void enumerate_capabilities();
+
+    void use_cached_capabilities(const Capability_cache::Device &cached);
+
+    auto get_capabilities_for_cache() const
+    -> Capability_cache::Device;
+
     vk::PhysicalDevice                      m_vk_physical_device;
     std::vector<vk::ExtensionProperties>    m_extensions;
     vk::PhysicalDeviceProperties2           m_properties;
+    vk::PhysicalDeviceDriverProperties      m_driver_properties;
+    vk::PhysicalDeviceIDProperties          m_id_properties;
     std::vector<vk::QueueFamilyProperties2> m_queue_family_properties;
     vk::PhysicalDeviceFeatures2             m_features;
     vk::PhysicalDeviceMemoryProperties2     m_memory_properties;
@@ -0,0 +1,231 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gsl/gsl"
+
+#include "graphics/pipeline_cache.hpp"
+#include "graphics/atomic_file.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+struct File_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint32_t reserved;
+    uint8_t  pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    uint64_t data_hash;
+};
+
+auto hash_data(const uint8_t *data, size_t size)
+-> uint64_t
+{
+    uint64_t value{0xcbf29ce484222325ull};
+    for (size_t i = 0; i < size; ++i)
+    {
+        value = (value ^ data[i]) * 0x100000001b3ull; // FNV-1a
+    }
+    return value;
+}
+
+auto read_file(const std::string &path, std::vector<uint8_t> &data)
+-> bool
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    uint8_t buffer[65536];
+    size_t  count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+} // anonymous namespace
+
+auto Pipeline_cache::get_default_path()
+-> std::string
+{
+    const char *path = getenv("VIPU_PIPELINE_CACHE");
+    return (path != nullptr) ? std::string{path} : std::string{"pipeline_cache.bin"};
+}
+
+Pipeline_cache::Pipeline_cache(vk::Device                          vk_device,
+                               const vk::PhysicalDeviceProperties &properties,
+                               const std::string                  &path,
+                               std::chrono::seconds                save_interval)
+    : m_vk_device {vk_device}
+    , m_properties{properties}
+    , m_path      {path}
+{
+    Expects(vk_device);
+
+    load();
+
+    if (!m_path.empty() && (save_interval.count() > 0))
+    {
+        m_thread = std::thread(&Pipeline_cache::run, this, save_interval);
+    }
+}
+
+Pipeline_cache::~Pipeline_cache()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+    }
+    save();
+}
+
+void Pipeline_cache::load()
+{
+    std::vector<uint8_t> file_data;
+    const char          *reason{"missing"};
+    const uint8_t       *cache_data{nullptr};
+    size_t               cache_size{0};
+    if (!m_path.empty() && read_file(m_path, file_data))
+    {
+        File_header header;
+        reason = "corrupt";
+        if (file_data.size() >= sizeof(header))
+        {
+            memcpy(&header, file_data.data(), sizeof(header));
+            if ((header.magic != magic) || (header.version != version) || (header.header_size != sizeof(header)))
+            {
+                reason = "unsupported version";
+            }
+            else if ((header.vendor_id      != m_properties.vendorID) ||
+                     (header.device_id      != m_properties.deviceID) ||
+                     (header.driver_version != m_properties.driverVersion) ||
+                     (memcmp(header.pipeline_cache_uuid, m_properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0))
+            {
+                reason = "for another device or driver";
+            }
+            else if ((header.data_size == file_data.size() - sizeof(header)) &&
+                     (hash_data(file_data.data() + sizeof(header), header.data_size) == header.data_hash))
+            {
+                cache_data = file_data.data() + sizeof(header);
+                cache_size = header.data_size;
+            }
+        }
+    }
+
+    if (cache_data != nullptr)
+    {
+        try
+        {
+            m_pipeline_cache = m_vk_device.createPipelineCacheUnique(
+                vk::PipelineCacheCreateInfo{vk::PipelineCacheCreateFlags{}, cache_size, cache_data}
+            );
+            m_is_warm         = true;
+            m_saved_data_size = cache_size;
+            m_saved_data_hash = hash_data(cache_data, cache_size);
+        }
+        catch (const vk::SystemError &error)
+        {
+            reason = "rejected by driver";
+            log_vulkan.warn("createPipelineCache with {} bytes of data failed: {}\n", cache_size, error.what());
+        }
+    }
+    if (!m_pipeline_cache)
+    {
+        m_pipeline_cache = m_vk_device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo{});
+    }
+
+    if (m_is_warm)
+    {
+        log_vulkan.info("Pipeline cache {} loaded, {} bytes\n", m_path, cache_size);
+    }
+    else if (!m_path.empty())
+    {
+        log_vulkan.info("Pipeline cache {} not used: {}\n", m_path, reason);
+    }
+}
+
+void Pipeline_cache::run(std::chrono::seconds save_interval)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_condition.wait_for(lock, save_interval, [this]()
+    {
+        return m_stop;
+    }))
+    {
+        lock.unlock();
+        save();
+        lock.lock();
+    }
+}
+
+auto Pipeline_cache::get() const
+-> vk::PipelineCache
+{
+    return m_pipeline_cache.get();
+}
+
+auto Pipeline_cache::is_warm() const
+-> bool
+{
+    return m_is_warm;
+}
+
+void Pipeline_cache::save()
+{
+    if (m_path.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_save_mutex);
+
+    const std::vector<uint8_t> data = m_vk_device.getPipelineCacheData(m_pipeline_cache.get());
+    const uint64_t data_hash = hash_data(data.data(), data.size());
+    if ((data.size() == m_saved_data_size) && (data_hash == m_saved_data_hash))
+    {
+        return;
+    }
+
+    File_header header{};
+    header.magic          = magic;
+    header.version        = version;
+    header.header_size    = sizeof(File_header);
+    header.vendor_id      = m_properties.vendorID;
+    header.device_id      = m_properties.deviceID;
+    header.driver_version = m_properties.driverVersion;
+    memcpy(header.pipeline_cache_uuid, m_properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+    header.data_size      = data.size();
+    header.data_hash      = data_hash;
+
+    const std::span<const uint8_t> header_bytes{reinterpret_cast<const uint8_t *>(&header), sizeof(header)};
+    if (!write_file_atomically(m_path, {header_bytes, data}, "pipeline cache"))
+    {
+        return;
+    }
+
+    m_saved_data_size = data.size();
+    m_saved_data_hash = data_hash;
+    log_vulkan.info("Pipeline cache {} written, {} bytes\n", m_path, data.size());
+}
+
+} // namespace vipu
@@ -0,0 +1,78 @@
+#ifndef pipeline_cache_hpp_vipu_graphics
+#define pipeline_cache_hpp_vipu_graphics
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+// vk::PipelineCache which is loaded from disk at construction, and saved
+// periodically from a background thread and at destruction, so that later
+// launches skip shader compilation.
+//
+// The file has a header with vendorID, deviceID, driverVersion,
+// pipelineCacheUUID and a hash of the cache data. Files for another device
+// or driver, and truncated or corrupt files, are ignored. Saves write a
+// temporary file and rename it, so a crash never leaves a partial file.
+class Pipeline_cache
+{
+public:
+    static constexpr uint64_t magic  {0x48434350'55504956ull}; // "VIPUPCCH"
+    static constexpr uint32_t version{1};
+
+    // Path from environment variable VIPU_PIPELINE_CACHE, or
+    // pipeline_cache.bin. Empty path disables loading and saving.
+    static auto get_default_path()
+    -> std::string;
+
+    // Zero save_interval disables periodic saves
+    Pipeline_cache(vk::Device                          vk_device,
+                   const vk::PhysicalDeviceProperties &properties,
+                   const std::string                  &path,
+                   std::chrono::seconds                save_interval = std::chrono::seconds{30});
+
+    ~Pipeline_cache();
+
+    Pipeline_cache(const Pipeline_cache &) = delete;
+    Pipeline_cache &operator=(const Pipeline_cache &) = delete;
+
+    auto get() const
+    -> vk::PipelineCache;
+
+    // True if data was loaded from disk
+    auto is_warm() const
+    -> bool;
+
+    // Writes the cache if its data changed since load or previous save.
+    // Thread safe.
+    void save();
+
+private:
+    void load();
+
+    void run(std::chrono::seconds save_interval);
+
+    vk::Device                   m_vk_device;
+    vk::PhysicalDeviceProperties m_properties;
+    std::string                  m_path;
+    vk::UniquePipelineCache      m_pipeline_cache;
+    bool                         m_is_warm        {false};
+    std::mutex                   m_save_mutex;
+    uint64_t                     m_saved_data_hash{0};
+    size_t                       m_saved_data_size{0};
+    std::mutex                   m_mutex;
+    std::condition_variable      m_condition;
+    bool                         m_stop{false};
+    std::thread                  m_thread;
+};
+
+} // namespace vipu
+
+#endif // pipeline_cache_hpp_vipu_graphics
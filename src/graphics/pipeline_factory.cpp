@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+#include "gsl/gsl"
+
+#include "graphics/pipeline_factory.hpp"
+#include "graphics/atomic_file.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+auto to_ms(uint64_t ns)
+-> double
+{
+    return static_cast<double>(ns) / 1e6;
+}
+
+} // anonymous namespace
+
+Pipeline_factory::Handle::Handle(Entry *entry)
+    : m_entry{entry}
+{
+}
+
+auto Pipeline_factory::Handle::is_valid() const
+-> bool
+{
+    return m_entry != nullptr;
+}
+
+auto Pipeline_factory::Handle::is_ready() const
+-> bool
+{
+    return (m_entry != nullptr) && m_entry->ready.load(std::memory_order_acquire);
+}
+
+auto Pipeline_factory::Handle::get() const
+-> vk::Pipeline
+{
+    return is_ready() ? m_entry->pipeline.get() : vk::Pipeline{};
+}
+
+auto Pipeline_factory::get_default_manifest_path()
+-> std::string
+{
+    const char *path = getenv("VIPU_PIPELINE_MANIFEST");
+    return (path != nullptr) ? std::string{path} : std::string{"pipeline_manifest.txt"};
+}
+
+Pipeline_factory::Pipeline_factory(Context &context, uint32_t thread_count)
+{
+    Expects(context.vk_device);
+    Expects(context.vk_pipeline_cache);
+
+    m_vk_device         = context.vk_device;
+    m_vk_pipeline_cache = context.vk_pipeline_cache;
+
+    if (thread_count == 0)
+    {
+        // hardware_concurrency() may return 0 if it is not known
+        const uint32_t hardware_thread_count = std::thread::hardware_concurrency();
+        thread_count = (hardware_thread_count > 1) ? hardware_thread_count - 1 : 1;
+    }
+    log_vulkan.trace("Pipeline factory: {} threads\n", thread_count);
+
+    m_threads.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        m_threads.emplace_back(&Pipeline_factory::run, this);
+    }
+}
+
+Pipeline_factory::~Pipeline_factory()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_queue.clear();
+    }
+    m_condition.notify_all();
+    for (auto &thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void Pipeline_factory::add_recipe(const std::string &key, Create_function create, std::vector<std::string> shaders)
+{
+    Expects(create);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &entry = m_entries[key];
+    VERIFY(!entry);
+    entry = std::make_unique<Entry>();
+    entry->key     = key;
+    entry->create  = std::move(create);
+    entry->shaders = std::move(shaders);
+}
+
+auto Pipeline_factory::request(const std::string &key)
+-> Handle
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_entries.find(key);
+    if (i == m_entries.end())
+    {
+        log_vulkan.warn("No pipeline recipe for {}\n", key);
+        return Handle{};
+    }
+
+    Entry &entry = *i->second;
+    if (!entry.requested)
+    {
+        entry.requested = true;
+        m_request_order.push_back(&entry);
+    }
+    if (!entry.queued)
+    {
+        enqueue(entry);
+    }
+    return Handle{&entry};
+}
+
+auto Pipeline_factory::wait(const Handle &handle)
+-> vk::Pipeline
+{
+    Expects(handle.is_valid());
+
+    if (!handle.is_ready())
+    {
+        const auto start = Clock::now();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle_condition.wait(lock, [&handle]()
+        {
+            return handle.is_ready();
+        });
+        m_stall_time_ns += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    return handle.get();
+}
+
+auto Pipeline_factory::warm_up(const std::string &manifest_path)
+-> uint32_t
+{
+    if (manifest_path.empty())
+    {
+        return 0;
+    }
+
+    std::ifstream manifest{manifest_path};
+    if (!manifest)
+    {
+        log_vulkan.info("Pipeline manifest {} not found\n", manifest_path);
+        return 0;
+    }
+
+    uint32_t    queued_count{0};
+    std::string key;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (std::getline(manifest, key))
+    {
+        if (key.empty())
+        {
+            continue;
+        }
+        auto i = m_entries.find(key);
+        if (i == m_entries.end())
+        {
+            ++m_manifest_skip_count;
+            continue;
+        }
+        Entry &entry = *i->second;
+        if (!entry.queued)
+        {
+            entry.warm_up = true;
+            enqueue(entry);
+            ++queued_count;
+        }
+    }
+    log_vulkan.info("Pipeline manifest {}: {} pipelines queued for warm-up, {} keys without recipe\n",
+                    manifest_path,
+                    queued_count,
+                    m_manifest_skip_count);
+    return queued_count;
+}
+
+void Pipeline_factory::save_manifest(const std::string &manifest_path) const
+{
+    if (manifest_path.empty())
+    {
+        return;
+    }
+
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Entry *entry : m_request_order)
+        {
+            text += entry->key;
+            text += '\n';
+        }
+    }
+    if (text.empty())
+    {
+        return;
+    }
+
+    // Per-process temporary file and rename, like the pipeline cache
+    const std::span<const uint8_t> bytes{reinterpret_cast<const uint8_t *>(text.data()), text.size()};
+    write_file_atomically(manifest_path, {bytes}, "pipeline manifest");
+}
+
+auto Pipeline_factory::rebuild_shader(const std::string &shader_name)
+-> uint32_t
+{
+    uint32_t queued_count{0};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &[key, entry] : m_entries)
+    {
+        if (std::find(entry->shaders.begin(), entry->shaders.end(), shader_name) == entry->shaders.end())
+        {
+            continue;
+        }
+        if (!entry->queued)
+        {
+            continue; // not compiled yet, first compile uses the new shader
+        }
+        if (entry->rebuild_queued || !entry->ready.load(std::memory_order_acquire))
+        {
+            // Compile in progress may have read the old shader
+            entry->rebuild_again = true;
+        }
+        else
+        {
+            entry->rebuild_queued = true;
+            m_queue.push_back(entry.get());
+            m_condition.notify_one();
+        }
+        ++queued_count;
+    }
+    return queued_count;
+}
+
+auto Pipeline_factory::apply_rebuilds(uint64_t frame_number, uint32_t frames_in_flight)
+-> uint32_t
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (!m_retired.empty() && (m_retired.front().frame_number <= frame_number))
+    {
+        m_retired.pop_front();
+    }
+
+    const auto replaced_count = static_cast<uint32_t>(m_rebuilt.size());
+    for (Entry *entry : m_rebuilt)
+    {
+        // Previous frames in flight may still use the old pipeline
+        m_retired.push_back(Retired_pipeline{frame_number + frames_in_flight, std::move(entry->pipeline)});
+        entry->pipeline = std::move(entry->rebuilt_pipeline);
+        entry->failed   = false;
+        log_vulkan.trace("Pipeline {} replaced at frame {}\n", entry->key, frame_number);
+    }
+    m_rebuilt.clear();
+    return replaced_count;
+}
+
+void Pipeline_factory::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_condition.wait(lock, [this]()
+    {
+        return m_queue.empty() && (m_busy_count == 0);
+    });
+}
+
+void Pipeline_factory::log_statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t compiled_count     {0};
+    uint32_t failed_count       {0};
+    uint32_t warm_up_count      {0};
+    uint32_t warm_up_used_count {0};
+    uint64_t total_compile_ns   {0};
+    for (const auto &[key, entry] : m_entries)
+    {
+        if (!entry->ready.load(std::memory_order_acquire))
+        {
+            continue;
+        }
+        ++compiled_count;
+        total_compile_ns += entry->compile_time_ns;
+        if (entry->failed)
+        {
+            ++failed_count;
+        }
+        if (entry->warm_up)
+        {
+            ++warm_up_count;
+            if (entry->requested)
+            {
+                ++warm_up_used_count;
+            }
+        }
+        log_vulkan.trace("Pipeline {}: {:.2f} ms{}{}\n",
+                         key,
+                         to_ms(entry->compile_time_ns),
+                         entry->warm_up ? ", warm-up" : "",
+                         entry->failed ? ", failed" : "");
+    }
+
+    const uint64_t wall_ns = m_has_compiled
+        ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(m_last_compile_end - m_first_compile_start).count())
+        : 0;
+    log_vulkan.info("Pipelines: {} compiled ({} failed) on {} threads, {:.1f} ms compile time, {:.1f} ms wall time\n",
+                    compiled_count,
+                    failed_count,
+                    m_threads.size(),
+                    to_ms(total_compile_ns),
+                    to_ms(wall_ns));
+    log_vulkan.info("Pipelines: {} of {} warm-up pipelines used, render thread waited {:.1f} ms, saved {:.1f} ms\n",
+                    warm_up_used_count,
+                    warm_up_count,
+                    to_ms(m_stall_time_ns),
+                    to_ms(total_compile_ns - std::min(total_compile_ns, m_stall_time_ns)));
+    if (m_rebuild_count > 0)
+    {
+        log_vulkan.info("Pipelines: {} rebuilt after shader changes, {} rebuilds failed\n",
+                        m_rebuild_count,
+                        m_rebuild_failed_count);
+    }
+}
+
+void Pipeline_factory::enqueue(Entry &entry)
+{
+    entry.queued = true;
+    m_queue.push_back(&entry);
+    m_condition.notify_one();
+}
+
+void Pipeline_factory::run()
+{
+    for (;;)
+    {
+        Entry *entry  {nullptr};
+        bool   rebuild{false};
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]()
+            {
+                return m_stop || !m_queue.empty();
+            });
+            if (m_stop)
+            {
+                return;
+            }
+            entry = m_queue.front();
+            m_queue.pop_front();
+            rebuild = entry->ready.load(std::memory_order_relaxed);
+            ++m_busy_count;
+        }
+
+        const auto start = Clock::now();
+        vk::UniquePipeline pipeline;
+        try
+        {
+            pipeline = entry->create(m_vk_device, m_vk_pipeline_cache);
+        }
+        catch (const vk::SystemError &error)
+        {
+            log_vulkan.warn("Pipeline {} failed: {}\n", entry->key, error.what());
+        }
+        const auto end = Clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (rebuild)
+            {
+                // Rebuilds are not included in compile time statistics
+                entry->rebuild_queued = false;
+                ++m_rebuild_count;
+                if (!pipeline)
+                {
+                    ++m_rebuild_failed_count;
+                    log_vulkan.warn("Pipeline {} rebuild failed, keeping previous pipeline\n", entry->key);
+                }
+                else
+                {
+                    if (!entry->rebuilt_pipeline)
+                    {
+                        m_rebuilt.push_back(entry);
+                    }
+                    entry->rebuilt_pipeline = std::move(pipeline);
+                }
+            }
+            else
+            {
+                entry->pipeline        = std::move(pipeline);
+                entry->failed          = !entry->pipeline;
+                entry->compile_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                entry->ready.store(true, std::memory_order_release);
+                if (!m_has_compiled || (start < m_first_compile_start))
+                {
+                    m_first_compile_start = start;
+                }
+                m_last_compile_end = std::max(m_last_compile_end, end);
+                m_has_compiled     = true;
+            }
+            if (entry->rebuild_again && !m_stop)
+            {
+                entry->rebuild_again  = false;
+                entry->rebuild_queued = true;
+                m_queue.push_back(entry);
+                m_condition.notify_one();
+            }
+            --m_busy_count;
+        }
+        m_idle_condition.notify_all();
+
+        log_vulkan.trace("Pipeline {} {} in {:.2f} ms\n",
+                         entry->key,
+                         rebuild ? "rebuilt" : "compiled",
+                         to_ms(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())));
+    }
+}
+
+} // namespace vipu
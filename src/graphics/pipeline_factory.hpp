@@ -0,0 +1,180 @@
+#ifndef pipeline_factory_hpp_vipu_graphics
+#define pipeline_factory_hpp_vipu_graphics
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+class Context;
+
+// Compiles graphics and compute pipelines on a pool of worker threads,
+// through the device pipeline cache, so that the render thread does not
+// stall on pipeline creation.
+//
+// Pipelines are identified by key. A recipe, registered with add_recipe(),
+// creates the pipeline for a key. request() returns a handle which the
+// renderer polls; compilation starts on the first request for a key.
+//
+// Keys requested during a run are written to a warm-up manifest by
+// save_manifest(). warm_up() reads the manifest of previous runs, and
+// compiles pipelines for listed keys which have a recipe, while startup
+// continues. Recipes used for warm-up must not depend on objects which are
+// created later during startup.
+//
+// Recipes can list the shaders they use. rebuild_shader() recompiles the
+// pipelines using a shader in the background, and apply_rebuilds() swaps
+// them in at a frame boundary. Used by Shader_watcher for hot reload.
+class Pipeline_factory
+{
+public:
+    using Create_function = std::function<vk::UniquePipeline(vk::Device vk_device, vk::PipelineCache vk_pipeline_cache)>;
+
+private:
+    struct Entry
+    {
+        std::string              key;
+        Create_function          create;
+        std::vector<std::string> shaders;
+        vk::UniquePipeline       pipeline;
+        vk::UniquePipeline       rebuilt_pipeline;   // waiting for apply_rebuilds()
+        std::atomic<bool>        ready         {false};
+        bool                     failed        {false};
+        bool                     queued        {false};
+        bool                     requested     {false};
+        bool                     warm_up       {false};
+        bool                     rebuild_queued{false};
+        bool                     rebuild_again {false};  // shader changed during rebuild
+        uint64_t                 compile_time_ns{0};
+    };
+
+    struct Retired_pipeline
+    {
+        uint64_t           frame_number{0};  // destroyed once this frame has completed
+        vk::UniquePipeline pipeline;
+    };
+
+public:
+    class Handle
+    {
+    public:
+        Handle() = default;
+
+        auto is_valid() const
+        -> bool;
+
+        // True once compilation has finished, also if it failed
+        auto is_ready() const
+        -> bool;
+
+        // Null handle until ready, or if compilation failed
+        auto get() const
+        -> vk::Pipeline;
+
+    private:
+        friend class Pipeline_factory;
+
+        explicit Handle(Entry *entry);
+
+        Entry *m_entry{nullptr};
+    };
+
+    // Path from environment variable VIPU_PIPELINE_MANIFEST, or
+    // pipeline_manifest.txt. Empty path disables the manifest.
+    static auto get_default_manifest_path()
+    -> std::string;
+
+    // Zero thread_count uses one thread less than hardware concurrency
+    explicit Pipeline_factory(Context &context, uint32_t thread_count = 0);
+
+    ~Pipeline_factory();
+
+    Pipeline_factory(const Pipeline_factory &) = delete;
+    Pipeline_factory &operator=(const Pipeline_factory &) = delete;
+
+    // Must be called before the key is requested or warmed up. Shaders are
+    // Shader_library names used by the recipe, see rebuild_shader().
+    void add_recipe(const std::string &key, Create_function create, std::vector<std::string> shaders = {});
+
+    // Starts compilation on first request. Handles stay valid for the
+    // lifetime of the factory. Returns invalid handle for unknown keys.
+    auto request(const std::string &key)
+    -> Handle;
+
+    // Blocks until handle is ready. Time spent here is reported as render
+    // thread stall time.
+    auto wait(const Handle &handle)
+    -> vk::Pipeline;
+
+    // Queues compilation of manifest keys which have a recipe. Returns
+    // number of queued pipelines.
+    auto warm_up(const std::string &manifest_path)
+    -> uint32_t;
+
+    // Writes keys requested in this run, in order of first request. Keeps
+    // the previous manifest if nothing was requested.
+    void save_manifest(const std::string &manifest_path) const;
+
+    // Queues recompilation of compiled pipelines whose recipe uses the
+    // shader. Current pipelines stay in use until apply_rebuilds(), and are
+    // kept if recompilation fails. Returns number of queued pipelines.
+    auto rebuild_shader(const std::string &shader_name)
+    -> uint32_t;
+
+    // Called by the render thread at a frame boundary, after waiting for the
+    // frame fence. Replaces pipelines with finished rebuilds. Replaced
+    // pipelines are destroyed after frames_in_flight more frames. Returns
+    // number of replaced pipelines.
+    auto apply_rebuilds(uint64_t frame_number, uint32_t frames_in_flight)
+    -> uint32_t;
+
+    // Blocks until all queued pipelines have been compiled
+    void wait_idle();
+
+    // Logs compile time of each pipeline, and time saved compared to
+    // compiling on the render thread
+    void log_statistics() const;
+
+private:
+    void enqueue(Entry &entry);  // called with m_mutex locked
+
+    void run();
+
+    vk::Device                                              m_vk_device;
+    vk::PipelineCache                                       m_vk_pipeline_cache;
+    mutable std::mutex                                      m_mutex;
+    std::condition_variable                                 m_condition;
+    std::condition_variable                                 m_idle_condition;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> m_entries;
+    std::vector<Entry *>                                    m_request_order;
+    std::deque<Entry *>                                     m_queue;
+    std::vector<Entry *>                                    m_rebuilt;
+    std::deque<Retired_pipeline>                            m_retired;
+    uint32_t                                                m_busy_count          {0};
+    uint32_t                                                m_manifest_skip_count {0};  // manifest keys without recipe
+    uint64_t                                                m_stall_time_ns       {0};
+    uint32_t                                                m_rebuild_count       {0};
+    uint32_t                                                m_rebuild_failed_count{0};
+    std::chrono::steady_clock::time_point                   m_first_compile_start;
+    std::chrono::steady_clock::time_point                   m_last_compile_end;
+    bool                                                    m_has_compiled        {false};
+    bool                                                    m_stop                {false};
+    std::vector<std::thread>                                m_threads;
+};
+
+} // namespace vipu
+
+#endif // pipeline_factory_hpp_vipu_graphics
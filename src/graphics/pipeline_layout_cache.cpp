@@ -0,0 +1,148 @@
+#include "gsl/gsl"
+
+#include "graphics/pipeline_layout_cache.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+#include "graphics/shader_library.hpp"
+
+namespace vipu
+{
+
+Pipeline_layout_cache::Pipeline_layout_cache(Context &context)
+    : m_vk_device     {context.vk_device}
+    , m_shader_library{context.shader_library}
+{
+    Expects(m_vk_device);
+    Expects(m_shader_library != nullptr);
+}
+
+auto Pipeline_layout_cache::get_shader_interface(const std::vector<std::string> &shader_names, Shader_interface &shader_interface)
+-> bool
+{
+    shader_interface = Shader_interface{};
+    for (const auto &name : shader_names)
+    {
+        // Hot reloaded code has a new address, so it is reflected again
+        const auto code = m_shader_library->get_spirv(name);
+        if (code.empty())
+        {
+            log_vulkan.warn("Shader {} not found\n", name);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto i = m_reflections.find(code.data());
+        if (i == m_reflections.end())
+        {
+            Shader_interface reflection;
+            if (!reflect_shader(code, reflection))
+            {
+                log_vulkan.warn("Shader {} reflection failed\n", name);
+                return false;
+            }
+            i = m_reflections.emplace(code.data(), std::move(reflection)).first;
+        }
+        if (!merge_shader_interface(shader_interface, i->second))
+        {
+            log_vulkan.warn("Shader {} interface does not match other stages\n", name);
+            return false;
+        }
+    }
+    return true;
+}
+
+auto Pipeline_layout_cache::get_set_layout(uint32_t set, const Shader_interface &shader_interface)
+-> const Set_layout_entry &
+{
+    std::vector<uint32_t>                       key;
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for (const auto &binding : shader_interface.bindings)
+    {
+        if (binding.set != set)
+        {
+            continue;
+        }
+        key.push_back(binding.binding);
+        key.push_back(static_cast<uint32_t>(binding.type));
+        key.push_back(binding.count);
+        key.push_back(static_cast<VkShaderStageFlags>(binding.stages));
+        bindings.emplace_back(binding.binding, binding.type, binding.count, binding.stages);
+    }
+
+    auto i = m_set_layouts.find(key);
+    if (i != m_set_layouts.end())
+    {
+        return i->second;
+    }
+
+    Set_layout_entry entry;
+    entry.descriptor_set_layout = m_vk_device.createDescriptorSetLayoutUnique(
+        vk::DescriptorSetLayoutCreateInfo{vk::DescriptorSetLayoutCreateFlags{}, bindings}
+    );
+    entry.id = static_cast<uint32_t>(m_set_layouts.size());
+    return m_set_layouts.emplace(std::move(key), std::move(entry)).first->second;
+}
+
+auto Pipeline_layout_cache::get_layout(const Shader_interface &shader_interface)
+-> const Layout &
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_request_count;
+
+    const uint32_t set_count = shader_interface.bindings.empty() ? 0 : shader_interface.bindings.back().set + 1;
+
+    std::vector<uint32_t>                set_layout_ids;
+    std::vector<vk::DescriptorSetLayout> set_layouts;
+    for (uint32_t set = 0; set < set_count; ++set)
+    {
+        const Set_layout_entry &entry = get_set_layout(set, shader_interface);
+        set_layout_ids.push_back(entry.id);
+        set_layouts.push_back(entry.descriptor_set_layout.get());
+    }
+
+    std::vector<uint32_t> key = set_layout_ids;
+    for (const auto &range : shader_interface.push_constant_ranges)
+    {
+        key.push_back(static_cast<VkShaderStageFlags>(range.stageFlags));
+        key.push_back(range.offset);
+        key.push_back(range.size);
+    }
+
+    auto i = m_layouts.find(key);
+    if (i == m_layouts.end())
+    {
+        Layout_entry entry;
+        entry.pipeline_layout = m_vk_device.createPipelineLayoutUnique(
+            vk::PipelineLayoutCreateInfo{vk::PipelineLayoutCreateFlags{},
+                                         set_layouts,
+                                         shader_interface.push_constant_ranges}
+        );
+        entry.layout.pipeline_layout        = entry.pipeline_layout.get();
+        entry.layout.descriptor_set_layouts = std::move(set_layouts);
+        i = m_layouts.emplace(std::move(key), std::move(entry)).first;
+    }
+    return i->second.layout;
+}
+
+auto Pipeline_layout_cache::get_layout(const std::vector<std::string> &shader_names)
+-> const Layout *
+{
+    Shader_interface shader_interface;
+    if (!get_shader_interface(shader_names, shader_interface))
+    {
+        return nullptr;
+    }
+    return &get_layout(shader_interface);
+}
+
+void Pipeline_layout_cache::log_statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    log_vulkan.info("Pipeline layouts: {} requests, {} pipeline layouts, {} descriptor set layouts, {} shaders reflected\n",
+                    m_request_count,
+                    m_layouts.size(),
+                    m_set_layouts.size(),
+                    m_reflections.size());
+}
+
+} // namespace vipu
@@ -0,0 +1,90 @@
+#ifndef pipeline_layout_cache_hpp_vipu_graphics
+#define pipeline_layout_cache_hpp_vipu_graphics
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "graphics/shader_reflection.hpp"
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+class Context;
+class Shader_library;
+
+// Creates descriptor set layouts and pipeline layouts from reflected shader
+// interfaces, and shares them between pipelines.
+//
+// Pipelines with equal bindings in a set get the same descriptor set layout.
+// Pipelines with equal set layouts and push constant ranges get the same
+// pipeline layout, so switching between them keeps bound descriptor sets
+// and push constants valid. Unused set numbers below the highest used set
+// get a shared empty set layout.
+//
+// Thread safe, so that Pipeline_factory recipes can use it.
+class Pipeline_layout_cache
+{
+public:
+    struct Layout
+    {
+        vk::PipelineLayout                   pipeline_layout;
+        std::vector<vk::DescriptorSetLayout> descriptor_set_layouts;  // by set number
+    };
+
+    // Context must have shader_library set
+    explicit Pipeline_layout_cache(Context &context);
+
+    Pipeline_layout_cache(const Pipeline_layout_cache &) = delete;
+    Pipeline_layout_cache &operator=(const Pipeline_layout_cache &) = delete;
+
+    // Reflects the named shaders from the shader library, and merges them
+    // to one interface. Each version of shader code is reflected once.
+    // Returns false if a shader is missing, or reflection or merge fails.
+    auto get_shader_interface(const std::vector<std::string> &shader_names, Shader_interface &shader_interface)
+    -> bool;
+
+    // Returned layout stays valid for the lifetime of the cache
+    auto get_layout(const Shader_interface &shader_interface)
+    -> const Layout &;
+
+    // Shorthand for get_shader_interface() and get_layout(). Returns nullptr
+    // on failure.
+    auto get_layout(const std::vector<std::string> &shader_names)
+    -> const Layout *;
+
+    // Logs layout requests, and layout objects created for them
+    void log_statistics() const;
+
+private:
+    struct Set_layout_entry
+    {
+        vk::UniqueDescriptorSetLayout descriptor_set_layout;
+        uint32_t                      id{0};  // for pipeline layout keys
+    };
+
+    struct Layout_entry
+    {
+        vk::UniquePipelineLayout pipeline_layout;
+        Layout                   layout;
+    };
+
+    // Called with m_mutex locked
+    auto get_set_layout(uint32_t set, const Shader_interface &shader_interface)
+    -> const Set_layout_entry &;
+
+    vk::Device                                          m_vk_device;
+    Shader_library                                     *m_shader_library{nullptr};
+    mutable std::mutex                                  m_mutex;
+    std::map<const uint32_t *, Shader_interface>        m_reflections;  // by code, which Shader_library keeps valid
+    std::map<std::vector<uint32_t>, Set_layout_entry>   m_set_layouts;
+    std::map<std::vector<uint32_t>, Layout_entry>       m_layouts;
+    uint32_t                                            m_request_count{0};
+};
+
+} // namespace vipu
+
+#endif // pipeline_layout_cache_hpp_vipu_graphics
@@ -0,0 +1,67 @@
+#include <cstdlib>
+
+#include "graphics/present_sharing.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+auto c_str(Present_sharing sharing)
+-> const char *
+{
+    switch (sharing)
+    {
+        case Present_sharing::exclusive:          return "exclusive";
+        case Present_sharing::concurrent:         return "concurrent";
+        case Present_sharing::ownership_transfer: return "ownership-transfer";
+        default:                                  return "?";
+    }
+}
+
+auto parse_present_sharing(std::string_view text, Present_sharing &sharing)
+-> bool
+{
+    for (auto candidate : {Present_sharing::concurrent,
+                           Present_sharing::ownership_transfer})
+    {
+        if (text == c_str(candidate))
+        {
+            sharing = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+auto choose_present_sharing(const vk::PhysicalDeviceProperties &properties,
+                            uint32_t                            graphics_queue_family_index,
+                            uint32_t                            present_queue_family_index)
+-> Present_sharing
+{
+    if (graphics_queue_family_index == present_queue_family_index)
+    {
+        return Present_sharing::exclusive;
+    }
+
+    // Heuristic, not measured on devices with separate present families.
+    // Use scripts/compare_present_sharing.sh to measure.
+    Present_sharing default_sharing = (properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu)
+        ? Present_sharing::ownership_transfer
+        : Present_sharing::concurrent;
+
+    Present_sharing sharing{default_sharing};
+    const char *text = getenv("VIPU_PRESENT_SHARING");
+    if ((text != nullptr) && !parse_present_sharing(text, sharing))
+    {
+        log_vulkan.warn("Ignoring unknown VIPU_PRESENT_SHARING {}, using {}\n", text, c_str(default_sharing));
+        sharing = default_sharing;
+    }
+
+    log_vulkan.info("Graphics queue family {}, present queue family {}, present sharing {}\n",
+                    graphics_queue_family_index,
+                    present_queue_family_index,
+                    c_str(sharing));
+    return sharing;
+}
+
+} // namespace vipu
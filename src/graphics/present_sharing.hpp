@@ -0,0 +1,40 @@
+#ifndef present_sharing_hpp_vipu_graphics
+#define present_sharing_hpp_vipu_graphics
+
+#include <cstdint>
+#include <string_view>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+// How swapchain images are shared between graphics and present queue
+// families.
+enum class Present_sharing
+{
+    exclusive = 0,      // graphics and present use the same family
+    concurrent,         // VK_SHARING_MODE_CONCURRENT, no ownership transfers
+    ownership_transfer  // VK_SHARING_MODE_EXCLUSIVE, release and acquire barriers
+};
+
+auto c_str(Present_sharing sharing)
+-> const char *;
+
+// Returns false if text is not concurrent or ownership-transfer
+auto parse_present_sharing(std::string_view text, Present_sharing &sharing)
+-> bool;
+
+// Returns exclusive if families are the same. Otherwise environment variable
+// VIPU_PRESENT_SHARING overrides the default, which is ownership transfer for
+// discrete GPUs, where concurrent sharing may disable framebuffer compression,
+// and concurrent sharing for others, where it saves the present queue
+// submission.
+auto choose_present_sharing(const vk::PhysicalDeviceProperties &properties,
+                            uint32_t                            graphics_queue_family_index,
+                            uint32_t                            present_queue_family_index)
+-> Present_sharing;
+
+} // namespace vipu
+
+#endif // present_sharing_hpp_vipu_graphics
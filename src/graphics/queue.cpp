@@ -0,0 +1,349 @@
+#include "gsl/gsl"
+
+#include "graphics/queue.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+Queue::Queue(vk::Device     vk_device,
+             uint32_t       family_index,
+             uint32_t       queue_index,
+             vk::QueueFlags flags,
+             const char    *name)
+    : m_family_index{family_index}
+    , m_queue_index {queue_index}
+    , m_flags       {flags}
+    , m_name        {name}
+{
+    Expects(vk_device);
+
+    vk::DeviceQueueInfo2 queue_info{
+        vk::DeviceQueueCreateFlags(),
+        family_index,
+        queue_index
+    };
+
+    m_vk_queue = vk_device.getQueue2(queue_info);
+
+    log_vulkan.trace("{} queue: family {}, index {}, flags {}\n",
+                     m_name,
+                     m_family_index,
+                     m_queue_index,
+                     vk::to_string(m_flags));
+
+    Ensures(m_vk_queue);
+}
+
+auto Queue::get()
+-> vk::Queue
+{
+    return m_vk_queue;
+}
+
+auto Queue::get_family_index() const
+-> uint32_t
+{
+    return m_family_index;
+}
+
+auto Queue::get_queue_index() const
+-> uint32_t
+{
+    return m_queue_index;
+}
+
+auto Queue::get_flags() const
+-> vk::QueueFlags
+{
+    return m_flags;
+}
+
+auto Queue::get_name() const
+-> const char *
+{
+    return m_name;
+}
+
+void Queue::submit(vk::ArrayProxy<const vk::SubmitInfo> submit_infos, vk::Fence fence)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_vk_queue.submit(submit_infos, fence);
+}
+
+void Queue::submit2(vk::ArrayProxy<const vk::SubmitInfo2KHR> submit_infos, vk::Fence fence)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_vk_queue.submit2KHR(submit_infos, fence);
+}
+
+auto Queue::present(const vk::PresentInfoKHR &present_info)
+-> vk::Result
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Not using the enhanced presentKHR(), which throws on eErrorOutOfDateKHR
+    auto result = m_vk_queue.presentKHR(&present_info);
+    switch (result)
+    {
+        case vk::Result::eSuccess:
+        case vk::Result::eSuboptimalKHR:
+        case vk::Result::eErrorOutOfDateKHR:
+        {
+            return result;
+        }
+
+        default:
+        {
+            FATAL("presentKHR failed: {}\n", vk::to_string(result));
+        }
+    }
+}
+
+void Queue::wait_idle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_vk_queue.waitIdle();
+}
+
+Submit_service::Submit_service(Queue &queue, bool use_synchronization2, size_t capacity)
+    : m_queue               {queue}
+    , m_use_synchronization2{use_synchronization2}
+    , m_ring                {capacity}
+{
+    m_thread = std::thread(&Submit_service::run, this);
+}
+
+Submit_service::~Submit_service()
+{
+    m_stop.store(true, std::memory_order_release);
+    wake();
+    m_thread.join();
+}
+
+void Submit_service::push(Submit_batch &&batch)
+{
+    Expects(batch.wait_stages.size() == batch.wait_semaphores.size());
+    Expects(batch.wait_values.empty() || (batch.wait_values.size() == batch.wait_semaphores.size()));
+    Expects(batch.signal_values.empty() || (batch.signal_values.size() == batch.signal_semaphores.size()));
+
+    const bool urgent = batch.fence || batch.flush;
+    size_t position;
+    while (!m_ring.try_push(std::move(batch), position))
+    {
+        wake();
+        std::this_thread::yield();
+    }
+
+    // Batches are submitted in ring order, but pushes can complete out of
+    // order, so this is the end of the highest pushed position rather than
+    // a count.
+    const uint64_t end = position + 1;
+    uint64_t pushed = m_pushed.load(std::memory_order_relaxed);
+    while ((pushed < end) &&
+           !m_pushed.compare_exchange_weak(pushed, end, std::memory_order_release))
+    {
+    }
+
+    // Other batches wait for the next urgent batch or flush(), so there is
+    // no need to wake the submit thread for them.
+    if (urgent)
+    {
+        // Pairs with the fence in run()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed))
+        {
+            wake();
+        }
+    }
+}
+
+void Submit_service::flush()
+{
+    // m_submitted counts batches in ring order, so reaching the end of the
+    // highest pushed position also covers batches pushed out of order.
+    const uint64_t target = m_pushed.load(std::memory_order_acquire);
+    uint64_t flush_target = m_flush_target.load(std::memory_order_relaxed);
+    while ((flush_target < target) &&
+           !m_flush_target.compare_exchange_weak(flush_target, target, std::memory_order_release))
+    {
+    }
+    wake();
+
+    uint64_t submitted = m_submitted.load(std::memory_order_acquire);
+    while (submitted < target)
+    {
+        m_submitted.wait(submitted, std::memory_order_acquire);
+        submitted = m_submitted.load(std::memory_order_acquire);
+    }
+}
+
+auto Submit_service::end_frame()
+-> Frame_statistics
+{
+    return Frame_statistics{
+        m_frame_batches.exchange(0, std::memory_order_relaxed),
+        m_frame_submits.exchange(0, std::memory_order_relaxed)
+    };
+}
+
+void Submit_service::wake()
+{
+    m_wake.fetch_add(1, std::memory_order_release);
+    m_wake.notify_one();
+}
+
+void Submit_service::run()
+{
+    Submit_batch batch;
+    for (;;)
+    {
+        while (m_ring.try_pop(batch))
+        {
+            const bool urgent = batch.fence || batch.flush;
+            m_pending.push_back(std::move(batch));
+            batch = Submit_batch{};
+
+            // Only one fence per submit call, so fence ends the call
+            if (urgent)
+            {
+                submit_pending();
+            }
+        }
+
+        if (!m_pending.empty() &&
+            (m_flush_target.load(std::memory_order_acquire) > m_submitted.load(std::memory_order_relaxed)))
+        {
+            submit_pending();
+        }
+
+        if (m_stop.load(std::memory_order_acquire))
+        {
+            if (m_ring.empty())
+            {
+                submit_pending();
+                break;
+            }
+            continue;
+        }
+
+        const uint32_t wake_count = m_wake.load(std::memory_order_acquire);
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_ring.empty() &&
+            !m_stop.load(std::memory_order_acquire) &&
+            (m_flush_target.load(std::memory_order_acquire) <= m_submitted.load(std::memory_order_relaxed)))
+        {
+            m_wake.wait(wake_count, std::memory_order_acquire);
+        }
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Submit_service::submit_pending()
+{
+    if (m_pending.empty())
+    {
+        return;
+    }
+
+    // Only the last batch can have a fence
+    const vk::Fence fence = m_pending.back().fence;
+
+    try
+    {
+        if (m_use_synchronization2)
+        {
+            size_t semaphore_count     {0};
+            size_t command_buffer_count{0};
+            for (const auto &batch : m_pending)
+            {
+                semaphore_count      += batch.wait_semaphores.size() + batch.signal_semaphores.size();
+                command_buffer_count += batch.command_buffers.size();
+            }
+
+            // Reserved up front, so pointers stay valid
+            std::vector<vk::SemaphoreSubmitInfoKHR>     semaphore_infos;
+            std::vector<vk::CommandBufferSubmitInfoKHR> command_buffer_infos;
+            std::vector<vk::SubmitInfo2KHR>             submit_infos;
+            semaphore_infos     .reserve(semaphore_count);
+            command_buffer_infos.reserve(command_buffer_count);
+            submit_infos        .reserve(m_pending.size());
+            for (const auto &batch : m_pending)
+            {
+                const size_t wait_offset = semaphore_infos.size();
+                for (size_t i = 0; i < batch.wait_semaphores.size(); ++i)
+                {
+                    const auto stage = static_cast<VkPipelineStageFlags>(batch.wait_stages[i]);
+                    semaphore_infos.emplace_back(batch.wait_semaphores[i],
+                                                 batch.wait_values.empty() ? 0 : batch.wait_values[i],
+                                                 vk::PipelineStageFlags2KHR{static_cast<VkPipelineStageFlags2KHR>(stage)},
+                                                 0);
+                }
+                const size_t signal_offset = semaphore_infos.size();
+                for (size_t i = 0; i < batch.signal_semaphores.size(); ++i)
+                {
+                    semaphore_infos.emplace_back(batch.signal_semaphores[i],
+                                                 batch.signal_values.empty() ? 0 : batch.signal_values[i],
+                                                 vk::PipelineStageFlagBits2KHR::eAllCommands,
+                                                 0);
+                }
+                const size_t command_buffer_offset = command_buffer_infos.size();
+                for (auto command_buffer : batch.command_buffers)
+                {
+                    command_buffer_infos.emplace_back(command_buffer, 0);
+                }
+                submit_infos.emplace_back(vk::SubmitFlagsKHR{},
+                                          static_cast<uint32_t>(batch.wait_semaphores.size()),
+                                          semaphore_infos.data() + wait_offset,
+                                          static_cast<uint32_t>(batch.command_buffers.size()),
+                                          command_buffer_infos.data() + command_buffer_offset,
+                                          static_cast<uint32_t>(batch.signal_semaphores.size()),
+                                          semaphore_infos.data() + signal_offset);
+            }
+            m_queue.submit2(submit_infos, fence);
+        }
+        else
+        {
+            std::vector<vk::TimelineSemaphoreSubmitInfo> timeline_infos;
+            std::vector<vk::SubmitInfo>                  submit_infos;
+            timeline_infos.reserve(m_pending.size());
+            submit_infos  .reserve(m_pending.size());
+            for (const auto &batch : m_pending)
+            {
+                vk::SubmitInfo submit_info{
+                    static_cast<uint32_t>(batch.wait_semaphores.size()),
+                    batch.wait_semaphores.data(),
+                    batch.wait_stages.data(),
+                    static_cast<uint32_t>(batch.command_buffers.size()),
+                    batch.command_buffers.data(),
+                    static_cast<uint32_t>(batch.signal_semaphores.size()),
+                    batch.signal_semaphores.data()
+                };
+                if (!batch.wait_values.empty() || !batch.signal_values.empty())
+                {
+                    timeline_infos.emplace_back(static_cast<uint32_t>(batch.wait_values.size()),
+                                                batch.wait_values.data(),
+                                                static_cast<uint32_t>(batch.signal_values.size()),
+                                                batch.signal_values.data());
+                    submit_info.setPNext(&timeline_infos.back());
+                }
+                submit_infos.push_back(submit_info);
+            }
+            m_queue.submit(submit_infos, fence);
+        }
+    }
+    catch (const vk::SystemError &error)
+    {
+        FATAL("{} queue submit failed: {}\n", m_queue.get_name(), error.what());
+    }
+
+    const uint64_t batch_count = m_pending.size();
+    m_pending.clear();
+    m_frame_batches.fetch_add(batch_count, std::memory_order_relaxed);
+    m_frame_submits.fetch_add(1, std::memory_order_relaxed);
+    m_submitted.fetch_add(batch_count, std::memory_order_release);
+    m_submitted.notify_all();
+}
+
+} // namespace vipu
@@ -0,0 +1,138 @@
+#ifndef queue_hpp_vipu_graphics
+#define queue_hpp_vipu_graphics
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+#include "log/mpsc_ring_buffer.hpp"
+
+namespace vipu
+{
+
+// Device queue with its family and capabilities. Submission functions may be
+// called from any thread; vkQueueSubmit and vkQueuePresentKHR require
+// external synchronization, which is done here. When there is no dedicated
+// family for a role, Device hands out the same Queue for several roles, so
+// they also share the lock.
+class Queue
+{
+public:
+    Queue(vk::Device     vk_device,
+          uint32_t       family_index,
+          uint32_t       queue_index,
+          vk::QueueFlags flags,
+          const char    *name);
+
+    Queue(const Queue &) = delete;
+    Queue &operator=(const Queue &) = delete;
+
+    auto get()
+    -> vk::Queue;
+
+    auto get_family_index() const
+    -> uint32_t;
+
+    auto get_queue_index() const
+    -> uint32_t;
+
+    auto get_flags() const
+    -> vk::QueueFlags;
+
+    auto get_name() const
+    -> const char *;
+
+    void submit(vk::ArrayProxy<const vk::SubmitInfo> submit_infos, vk::Fence fence = {});
+
+    // Requires Device_features::synchronization2
+    void submit2(vk::ArrayProxy<const vk::SubmitInfo2KHR> submit_infos, vk::Fence fence = {});
+
+    // Returns eSuccess, eSuboptimalKHR or eErrorOutOfDateKHR; other errors are FATAL
+    auto present(const vk::PresentInfoKHR &present_info)
+    -> vk::Result;
+
+    void wait_idle();
+
+private:
+    std::mutex     m_mutex;
+    vk::Queue      m_vk_queue;
+    uint32_t       m_family_index{std::numeric_limits<uint32_t>::max()};
+    uint32_t       m_queue_index {0};
+    vk::QueueFlags m_flags;
+    const char    *m_name{""};
+};
+
+// Unit of work for Submit_service. Semaphore values are only used for
+// timeline semaphores; leave them empty when all semaphores are binary.
+struct Submit_batch
+{
+    std::vector<vk::CommandBuffer>      command_buffers;
+    std::vector<vk::Semaphore>          wait_semaphores;
+    std::vector<vk::PipelineStageFlags> wait_stages;    // one per wait semaphore
+    std::vector<uint64_t>               wait_values;
+    std::vector<vk::Semaphore>          signal_semaphores;
+    std::vector<uint64_t>               signal_values;
+    vk::Fence                           fence;          // submitted right away when set
+    bool                                flush{false};   // submitted right away when set
+};
+
+// Collects batches from any number of threads through a lock-free ring, and
+// submits them from one thread. Batches are held back until one with a fence
+// or the flush flag arrives, or flush() is called, and are then submitted in
+// a single vkQueueSubmit2KHR (or vkQueueSubmit) call, in push order.
+class Submit_service
+{
+public:
+    struct Frame_statistics
+    {
+        uint64_t batch_count {0};
+        uint64_t submit_count{0}; // vkQueueSubmit calls
+    };
+
+    Submit_service(Queue &queue, bool use_synchronization2, size_t capacity = 1024);
+
+    ~Submit_service();
+
+    Submit_service(const Submit_service &) = delete;
+    Submit_service &operator=(const Submit_service &) = delete;
+
+    // Safe to call from any thread. Blocks while the ring is full.
+    void push(Submit_batch &&batch);
+
+    // Returns when all batches pushed before the call have been submitted.
+    // Needed before presenting with a semaphore signaled by a pushed batch.
+    void flush();
+
+    // Returns counts since previous call, and restarts counting.
+    auto end_frame()
+    -> Frame_statistics;
+
+private:
+    void wake();
+
+    void run();
+
+    void submit_pending();
+
+    Queue                         &m_queue;
+    bool                           m_use_synchronization2{false};
+    Mpsc_ring_buffer<Submit_batch> m_ring;
+    std::vector<Submit_batch>      m_pending;          // only used by submit thread
+    std::atomic<uint64_t>          m_pushed        {0}; // end of highest pushed ring position
+    std::atomic<uint64_t>          m_submitted     {0}; // batches
+    std::atomic<uint64_t>          m_flush_target  {0};
+    std::atomic<uint64_t>          m_frame_batches {0};
+    std::atomic<uint64_t>          m_frame_submits {0};
+    std::atomic<uint32_t>          m_wake          {0};
+    std::atomic<bool>              m_stop          {false};
+    std::atomic<bool>              m_sleeping      {false};
+    std::thread                    m_thread;
+};
+
+} // namespace vipu
+
+#endif // queue_hpp_vipu_graphics
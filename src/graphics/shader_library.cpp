@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gsl/gsl"
+
+#include "graphics/shader_library.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+constexpr uint32_t spirv_magic{0x07230203u};
+
+auto find_embedded_shader(std::string_view name)
+-> const Embedded_shader *
+{
+    for (const auto &shader : get_embedded_shaders())
+    {
+        if (name == shader.name)
+        {
+            return &shader;
+        }
+    }
+    return nullptr;
+}
+
+} // anonymous namespace
+
+auto Shader_library::get_default_override_directory()
+-> std::string
+{
+    const char *directory = getenv("VIPU_SHADER_DIR");
+    return (directory != nullptr) ? std::string{directory} : std::string{};
+}
+
+Shader_library::Shader_library(const std::string &override_directory)
+    : m_override_directory{override_directory}
+{
+    log_vulkan.trace("Shader library: {} embedded shaders{}{}\n",
+                     get_embedded_shaders().size(),
+                     m_override_directory.empty() ? "" : ", override directory ",
+                     m_override_directory);
+}
+
+auto Shader_library::get_override_directory() const
+-> const std::string &
+{
+    return m_override_directory;
+}
+
+auto Shader_library::load_override(std::string_view name, Override &entry)
+-> bool
+{
+    entry.checked = true;
+
+    const std::string path = m_override_directory + "/" + std::string{name} + ".spv";
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[65536];
+    size_t  count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+
+    std::vector<uint32_t> code(bytes.size() / sizeof(uint32_t));
+    memcpy(code.data(), bytes.data(), code.size() * sizeof(uint32_t));
+    if ((bytes.size() % sizeof(uint32_t) != 0) || code.empty() || (code[0] != spirv_magic))
+    {
+        log_vulkan.warn("Shader {} is not SPIR-V, ignored\n", path);
+        return false;
+    }
+
+    log_vulkan.trace("Shader {} loaded from {}\n", name, path);
+    entry.versions.push_back(std::move(code));
+    return true;
+}
+
+auto Shader_library::get_spirv(std::string_view name)
+-> std::span<const uint32_t>
+{
+    // Without overrides the embedded table is used without locking
+    if (!m_override_directory.empty() || m_has_replacements.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto i = m_overrides.find(name);
+        if (i == m_overrides.end())
+        {
+            i = m_overrides.emplace(std::string{name}, Override{}).first;
+        }
+        Override &entry = i->second;
+        if (!entry.checked && !m_override_directory.empty())
+        {
+            load_override(name, entry);
+        }
+        if (!entry.versions.empty())
+        {
+            return entry.versions.back();
+        }
+    }
+
+    const Embedded_shader *shader = find_embedded_shader(name);
+    if (shader == nullptr)
+    {
+        return {};
+    }
+    return std::span<const uint32_t>{shader->code, shader->word_count};
+}
+
+auto Shader_library::reload(std::string_view name)
+-> bool
+{
+    if (m_override_directory.empty())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_overrides.find(name);
+    if (i == m_overrides.end())
+    {
+        i = m_overrides.emplace(std::string{name}, Override{}).first;
+    }
+    return load_override(name, i->second);
+}
+
+void Shader_library::replace(std::string_view name, std::vector<uint32_t> code)
+{
+    Expects(!code.empty() && (code[0] == spirv_magic));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_overrides.find(name);
+    if (i == m_overrides.end())
+    {
+        i = m_overrides.emplace(std::string{name}, Override{}).first;
+    }
+    i->second.checked = true;
+    i->second.versions.push_back(std::move(code));
+    m_has_replacements.store(true, std::memory_order_release);
+}
+
+auto Shader_library::create_shader_module(vk::Device vk_device, std::string_view name)
+-> vk::UniqueShaderModule
+{
+    const auto code = get_spirv(name);
+    if (code.empty())
+    {
+        log_vulkan.warn("Shader {} not found\n", name);
+        return {};
+    }
+    return vk_device.createShaderModuleUnique(
+        vk::ShaderModuleCreateInfo{vk::ShaderModuleCreateFlags{}, code.size_bytes(), code.data()}
+    );
+}
+
+} // namespace vipu
@@ -0,0 +1,89 @@
+#ifndef shader_library_hpp_vipu_graphics
+#define shader_library_hpp_vipu_graphics
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+// Optimized SPIR-V compiled into the executable, by source file name
+// (for example simple.vert)
+struct Embedded_shader
+{
+    const char     *name;
+    const uint32_t *code;
+    size_t          word_count;
+};
+
+// Defined in embedded_shaders.cpp, which is generated by the shaders build
+// target, see cmake/vipu_shaders.cmake
+auto get_embedded_shaders()
+-> std::span<const Embedded_shader>;
+
+// Looks up SPIR-V of shaders by name. Embedded shaders are used without
+// any file I/O. When an override directory is set, <directory>/<name>.spv
+// is loaded instead if it exists, so that shaders can be changed during
+// development without rebuilding. Override files are read on first use
+// and by reload(). Code compiled at runtime can be installed with
+// replace(). Thread safe.
+class Shader_library
+{
+public:
+    // Path from environment variable VIPU_SHADER_DIR, empty if not set
+    static auto get_default_override_directory()
+    -> std::string;
+
+    explicit Shader_library(const std::string &override_directory = get_default_override_directory());
+
+    // Returns empty span if there is no such shader. Returned code stays
+    // valid for the lifetime of the library, also after reload().
+    auto get_spirv(std::string_view name)
+    -> std::span<const uint32_t>;
+
+    // Reads the override file of shader again. Returns false if there is
+    // no override directory, or the file is missing or not SPIR-V.
+    auto reload(std::string_view name)
+    -> bool;
+
+    // Installs code compiled at runtime, for example by Shader_watcher. It
+    // is used instead of embedded code and override file, until reload().
+    void replace(std::string_view name, std::vector<uint32_t> code);
+
+    // Returns null handle if there is no such shader
+    auto create_shader_module(vk::Device vk_device, std::string_view name)
+    -> vk::UniqueShaderModule;
+
+    auto get_override_directory() const
+    -> const std::string &;
+
+private:
+    struct Override
+    {
+        bool                                checked{false};  // file has been read, or found missing
+        std::deque<std::vector<uint32_t>>   versions;        // latest last, older kept for returned spans
+    };
+
+    // Called with m_mutex locked
+    auto load_override(std::string_view name, Override &entry)
+    -> bool;
+
+    std::string                                 m_override_directory;
+    std::atomic<bool>                           m_has_replacements{false};
+    std::mutex                                  m_mutex;
+    std::map<std::string, Override, std::less<>> m_overrides;
+};
+
+} // namespace vipu
+
+#endif // shader_library_hpp_vipu_graphics
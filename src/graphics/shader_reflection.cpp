@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <tuple>
+
+#include "spirv_cross.hpp"
+
+#include "graphics/shader_reflection.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+auto get_stage(spv::ExecutionModel execution_model, vk::ShaderStageFlagBits &stage)
+-> bool
+{
+    switch (execution_model)
+    {
+        case spv::ExecutionModelVertex:                 stage = vk::ShaderStageFlagBits::eVertex;                 return true;
+        case spv::ExecutionModelTessellationControl:    stage = vk::ShaderStageFlagBits::eTessellationControl;    return true;
+        case spv::ExecutionModelTessellationEvaluation: stage = vk::ShaderStageFlagBits::eTessellationEvaluation; return true;
+        case spv::ExecutionModelGeometry:               stage = vk::ShaderStageFlagBits::eGeometry;               return true;
+        case spv::ExecutionModelFragment:               stage = vk::ShaderStageFlagBits::eFragment;               return true;
+        case spv::ExecutionModelGLCompute:              stage = vk::ShaderStageFlagBits::eCompute;                return true;
+        default:                                        return false;
+    }
+}
+
+auto get_vertex_format(const spirv_cross::SPIRType &type)
+-> vk::Format
+{
+    static constexpr vk::Format float32[] = {vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat};
+    static constexpr vk::Format int32  [] = {vk::Format::eR32Sint,   vk::Format::eR32G32Sint,   vk::Format::eR32G32B32Sint,   vk::Format::eR32G32B32A32Sint  };
+    static constexpr vk::Format uint32 [] = {vk::Format::eR32Uint,   vk::Format::eR32G32Uint,   vk::Format::eR32G32B32Uint,   vk::Format::eR32G32B32A32Uint  };
+    static constexpr vk::Format float16[] = {vk::Format::eR16Sfloat, vk::Format::eR16G16Sfloat, vk::Format::eR16G16B16Sfloat, vk::Format::eR16G16B16A16Sfloat};
+
+    if ((type.vecsize < 1) || (type.vecsize > 4))
+    {
+        return vk::Format::eUndefined;
+    }
+    const uint32_t i = type.vecsize - 1;
+    switch (type.basetype)
+    {
+        case spirv_cross::SPIRType::Float: return (type.width == 32) ? float32[i] : vk::Format::eUndefined;
+        case spirv_cross::SPIRType::Half:  return float16[i];
+        case spirv_cross::SPIRType::Int:   return int32[i];
+        case spirv_cross::SPIRType::UInt:  return uint32[i];
+        default:                           return vk::Format::eUndefined;
+    }
+}
+
+// Product of array dimensions. Returns false for runtime sized arrays, and
+// arrays sized by specialization constants.
+auto get_array_count(const spirv_cross::SPIRType &type, uint32_t &count)
+-> bool
+{
+    count = 1;
+    for (size_t i = 0; i < type.array.size(); ++i)
+    {
+        if (!type.array_size_literal[i] || (type.array[i] == 0))
+        {
+            return false;
+        }
+        count *= type.array[i];
+    }
+    return true;
+}
+
+auto add_bindings(const spirv_cross::Compiler                           &compiler,
+                  const spirv_cross::SmallVector<spirv_cross::Resource> &resources,
+                  vk::DescriptorType                                    type,
+                  vk::ShaderStageFlagBits                               stage,
+                  Shader_interface                                      &shader_interface)
+-> bool
+{
+    for (const auto &resource : resources)
+    {
+        const spirv_cross::SPIRType &resource_type = compiler.get_type(resource.type_id);
+
+        Descriptor_binding binding;
+        binding.set     = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        binding.binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+        binding.type    = type;
+        binding.stages  = stage;
+        binding.name    = resource.name;
+        if (!get_array_count(resource_type, binding.count))
+        {
+            log_vulkan.warn("Shader reflection: {} (set {}, binding {}) is a runtime or specialization sized array, not supported\n",
+                            resource.name,
+                            binding.set,
+                            binding.binding);
+            return false;
+        }
+
+        // Texel buffers are images with buffer dimension
+        if (resource_type.image.dim == spv::DimBuffer)
+        {
+            if (type == vk::DescriptorType::eStorageImage)
+            {
+                binding.type = vk::DescriptorType::eStorageTexelBuffer;
+            }
+            else if ((type == vk::DescriptorType::eSampledImage) || (type == vk::DescriptorType::eCombinedImageSampler))
+            {
+                binding.type = vk::DescriptorType::eUniformTexelBuffer;
+            }
+        }
+        shader_interface.bindings.push_back(std::move(binding));
+    }
+    return true;
+}
+
+auto is_binding_less(const Descriptor_binding &lhs, const Descriptor_binding &rhs)
+-> bool
+{
+    return std::tie(lhs.set, lhs.binding) < std::tie(rhs.set, rhs.binding);
+}
+
+} // anonymous namespace
+
+auto reflect_shader(std::span<const uint32_t> spirv, Shader_interface &shader_interface)
+-> bool
+{
+    shader_interface = Shader_interface{};
+    try
+    {
+        spirv_cross::Compiler compiler{spirv.data(), spirv.size()};
+
+        vk::ShaderStageFlagBits stage;
+        if (!get_stage(compiler.get_execution_model(), stage))
+        {
+            log_vulkan.warn("Shader reflection: unsupported execution model {}\n", static_cast<int>(compiler.get_execution_model()));
+            return false;
+        }
+        shader_interface.stages = stage;
+
+        // Declared but unused resources do not need layout entries
+        const auto active_variables = compiler.get_active_interface_variables();
+        const spirv_cross::ShaderResources resources = compiler.get_shader_resources(active_variables);
+
+        const bool bindings_ok =
+            add_bindings(compiler, resources.uniform_buffers,         vk::DescriptorType::eUniformBuffer,            stage, shader_interface) &&
+            add_bindings(compiler, resources.storage_buffers,         vk::DescriptorType::eStorageBuffer,            stage, shader_interface) &&
+            add_bindings(compiler, resources.sampled_images,          vk::DescriptorType::eCombinedImageSampler,     stage, shader_interface) &&
+            add_bindings(compiler, resources.separate_images,         vk::DescriptorType::eSampledImage,             stage, shader_interface) &&
+            add_bindings(compiler, resources.separate_samplers,       vk::DescriptorType::eSampler,                  stage, shader_interface) &&
+            add_bindings(compiler, resources.storage_images,          vk::DescriptorType::eStorageImage,             stage, shader_interface) &&
+            add_bindings(compiler, resources.subpass_inputs,          vk::DescriptorType::eInputAttachment,          stage, shader_interface) &&
+            add_bindings(compiler, resources.acceleration_structures, vk::DescriptorType::eAccelerationStructureKHR, stage, shader_interface);
+        if (!bindings_ok)
+        {
+            return false;
+        }
+        std::sort(shader_interface.bindings.begin(), shader_interface.bindings.end(), is_binding_less);
+
+        // Only the members which are used, rounded to the 4 byte alignment
+        // required for push constant ranges
+        for (const auto &resource : resources.push_constant_buffers)
+        {
+            const auto ranges = compiler.get_active_buffer_ranges(resource.id);
+            if (ranges.empty())
+            {
+                continue;
+            }
+            size_t begin = ranges.front().offset;
+            size_t end   = ranges.front().offset + ranges.front().range;
+            for (const auto &range : ranges)
+            {
+                begin = std::min(begin, range.offset);
+                end   = std::max(end,   range.offset + range.range);
+            }
+            begin &= ~size_t{3};
+            end    = (end + 3) & ~size_t{3};
+            shader_interface.push_constant_ranges.emplace_back(vk::ShaderStageFlags{stage},
+                                                               static_cast<uint32_t>(begin),
+                                                               static_cast<uint32_t>(end - begin));
+        }
+
+        if (stage == vk::ShaderStageFlagBits::eVertex)
+        {
+            for (const auto &resource : resources.stage_inputs)
+            {
+                if (compiler.has_decoration(resource.id, spv::DecorationBuiltIn))
+                {
+                    continue;
+                }
+                const spirv_cross::SPIRType &type = compiler.get_type(resource.type_id);
+                const vk::Format format = get_vertex_format(type);
+                uint32_t array_count{1};
+                if ((format == vk::Format::eUndefined) || !get_array_count(type, array_count))
+                {
+                    log_vulkan.warn("Shader reflection: vertex input {} has unsupported type\n", resource.name);
+                    return false;
+                }
+
+                // Matrix columns and array elements use consecutive locations
+                const uint32_t location = compiler.get_decoration(resource.id, spv::DecorationLocation);
+                const uint32_t size     = type.vecsize * type.width / 8;
+                const uint32_t count    = type.columns * array_count;
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    shader_interface.vertex_attributes.push_back(Vertex_attribute{location + i, format, size, resource.name});
+                }
+            }
+            std::sort(shader_interface.vertex_attributes.begin(),
+                      shader_interface.vertex_attributes.end(),
+                      [](const Vertex_attribute &lhs, const Vertex_attribute &rhs)
+                      {
+                          return lhs.location < rhs.location;
+                      });
+        }
+    }
+    catch (const spirv_cross::CompilerError &error)
+    {
+        log_vulkan.warn("Shader reflection failed: {}\n", error.what());
+        return false;
+    }
+    return true;
+}
+
+auto merge_shader_interface(Shader_interface &shader_interface, const Shader_interface &other)
+-> bool
+{
+    for (const auto &binding : other.bindings)
+    {
+        auto i = std::lower_bound(shader_interface.bindings.begin(), shader_interface.bindings.end(), binding, is_binding_less);
+        if ((i == shader_interface.bindings.end()) || is_binding_less(binding, *i))
+        {
+            shader_interface.bindings.insert(i, binding);
+            continue;
+        }
+        if ((i->type != binding.type) || (i->count != binding.count))
+        {
+            log_vulkan.warn("Shader reflection: set {} binding {} is {} [{}] and {} [{}] in different stages\n",
+                            binding.set,
+                            binding.binding,
+                            vk::to_string(i->type),
+                            i->count,
+                            vk::to_string(binding.type),
+                            binding.count);
+            return false;
+        }
+        i->stages |= binding.stages;
+    }
+
+    for (const auto &range : other.push_constant_ranges)
+    {
+        if (shader_interface.push_constant_ranges.empty())
+        {
+            shader_interface.push_constant_ranges.push_back(range);
+            continue;
+        }
+        auto &merged = shader_interface.push_constant_ranges.front();
+        const uint32_t begin = std::min(merged.offset, range.offset);
+        const uint32_t end   = std::max(merged.offset + merged.size, range.offset + range.size);
+        merged.stageFlags |= range.stageFlags;
+        merged.offset      = begin;
+        merged.size        = end - begin;
+    }
+
+    if (shader_interface.vertex_attributes.empty())
+    {
+        shader_interface.vertex_attributes = other.vertex_attributes;
+    }
+
+    shader_interface.stages |= other.stages;
+    return true;
+}
+
+auto make_vertex_input_layout(const Shader_interface &shader_interface, uint32_t binding)
+-> Vertex_input_layout
+{
+    Vertex_input_layout layout;
+    uint32_t offset{0};
+    for (const auto &attribute : shader_interface.vertex_attributes)
+    {
+        layout.attributes.emplace_back(attribute.location, binding, attribute.format, offset);
+        offset += attribute.size;
+    }
+    layout.binding = vk::VertexInputBindingDescription{binding, offset, vk::VertexInputRate::eVertex};
+    return layout;
+}
+
+} // namespace vipu
@@ -0,0 +1,69 @@
+#ifndef shader_reflection_hpp_vipu_graphics
+#define shader_reflection_hpp_vipu_graphics
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+struct Descriptor_binding
+{
+    uint32_t             set    {0};
+    uint32_t             binding{0};
+    vk::DescriptorType   type   {vk::DescriptorType::eUniformBuffer};
+    uint32_t             count  {1};
+    vk::ShaderStageFlags stages;
+    std::string          name;
+};
+
+struct Vertex_attribute
+{
+    uint32_t    location{0};
+    vk::Format  format  {vk::Format::eUndefined};
+    uint32_t    size    {0};  // bytes
+    std::string name;
+};
+
+// Resource interface of one shader stage, or of the stages of a pipeline
+// merged with merge_shader_interface(). Only resources which are statically
+// used by the shader are included.
+struct Shader_interface
+{
+    vk::ShaderStageFlags               stages;
+    std::vector<Descriptor_binding>    bindings;              // sorted by set and binding
+    std::vector<vk::PushConstantRange> push_constant_ranges;  // at most one, see merge_shader_interface()
+    std::vector<Vertex_attribute>      vertex_attributes;     // vertex stage inputs, sorted by location
+};
+
+// Reflects SPIR-V with SPIRV-Cross. Returns false, and logs the reason, if
+// the code can not be parsed or uses resources which are not supported.
+auto reflect_shader(std::span<const uint32_t> spirv, Shader_interface &shader_interface)
+-> bool;
+
+// Adds stages of other to interface. Bindings used by several stages are
+// merged to one binding, with stage flags of all stages. Push constant
+// ranges are merged to a single range covering all stages, so that one
+// vkCmdPushConstants() with the range stage flags can update any part.
+// Returns false, and logs the reason, if the same set and binding has
+// different type or count in the stages.
+auto merge_shader_interface(Shader_interface &shader_interface, const Shader_interface &other)
+-> bool;
+
+// Vertex input with one interleaved binding, attributes in location order
+struct Vertex_input_layout
+{
+    vk::VertexInputBindingDescription                binding;
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+};
+
+auto make_vertex_input_layout(const Shader_interface &shader_interface, uint32_t binding = 0)
+-> Vertex_input_layout;
+
+} // namespace vipu
+
+#endif // shader_reflection_hpp_vipu_graphics
@@ -0,0 +1,481 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "gsl/gsl"
+
+#include "graphics/shader_watcher.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+#include "graphics/pipeline_factory.hpp"
+#include "graphics/shader_library.hpp"
+
+#if defined VIPU_SHADER_HOT_RELOAD && defined __linux__
+#    include <cerrno>
+#    include <cstring>
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#    include "glslang/Public/ResourceLimits.h"
+#    include "glslang/Public/ShaderLang.h"
+#    include "SPIRV/GlslangToSpv.h"
+#endif
+
+namespace vipu
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+auto to_ms(uint64_t ns)
+-> double
+{
+    return static_cast<double>(ns) / 1e6;
+}
+
+} // anonymous namespace
+
+auto Shader_watcher::get_default_directory()
+-> std::string
+{
+    const char *directory = getenv("VIPU_SHADER_WATCH");
+    if (directory != nullptr)
+    {
+        return std::string{directory};
+    }
+#if defined VIPU_SHADER_SOURCE_DIR
+    return std::string{VIPU_SHADER_SOURCE_DIR};
+#else
+    return std::string{};
+#endif
+}
+
+void Shader_watcher::log_statistics() const
+{
+    const uint32_t compile_count = m_compile_count.load(std::memory_order_relaxed);
+    if (compile_count == 0)
+    {
+        return;
+    }
+    log_vulkan.info("Shader hot reload: {} compiles, {} failed, {:.1f} ms compile time\n",
+                    compile_count,
+                    m_error_count.load(std::memory_order_relaxed),
+                    to_ms(m_compile_time_ns.load(std::memory_order_relaxed)));
+}
+
+#if defined VIPU_SHADER_HOT_RELOAD && defined __linux__
+
+namespace
+{
+
+// Wait for this long without further changes before compiling, as editors
+// often write a file in several steps
+constexpr int debounce_ms{100};
+
+auto get_stage(const std::filesystem::path &path, EShLanguage &stage)
+-> bool
+{
+    const std::string extension = path.extension().string();
+    if      (extension == ".vert") { stage = EShLangVertex;         }
+    else if (extension == ".tesc") { stage = EShLangTessControl;    }
+    else if (extension == ".tese") { stage = EShLangTessEvaluation; }
+    else if (extension == ".geom") { stage = EShLangGeometry;       }
+    else if (extension == ".frag") { stage = EShLangFragment;       }
+    else if (extension == ".comp") { stage = EShLangCompute;        }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+auto read_file(const std::filesystem::path &path, std::string &text)
+-> bool
+{
+    FILE *file = fopen(path.string().c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    char   buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        text.append(buffer, count);
+    }
+    fclose(file);
+    return true;
+}
+
+// Resolves #include relative to the including file, and then relative to
+// the watched directory
+class Includer
+    : public glslang::TShader::Includer
+{
+public:
+    explicit Includer(const std::filesystem::path &directory)
+        : m_directory{directory}
+    {
+    }
+
+    auto includeLocal(const char *header_name, const char *includer_name, size_t inclusion_depth)
+    -> IncludeResult * override
+    {
+        const std::filesystem::path includer_directory = std::filesystem::path{includer_name}.parent_path();
+        if (auto *result = try_include(includer_directory / header_name))
+        {
+            return result;
+        }
+        return includeSystem(header_name, includer_name, inclusion_depth);
+    }
+
+    auto includeSystem(const char *header_name, const char *includer_name, size_t inclusion_depth)
+    -> IncludeResult * override
+    {
+        static_cast<void>(includer_name);
+        static_cast<void>(inclusion_depth);
+
+        return try_include(m_directory / header_name);
+    }
+
+    void releaseInclude(IncludeResult *result) override
+    {
+        if (result != nullptr)
+        {
+            delete static_cast<std::string *>(result->userData);
+            delete result;
+        }
+    }
+
+private:
+    auto try_include(const std::filesystem::path &path)
+    -> IncludeResult *
+    {
+        auto text = std::make_unique<std::string>();
+        if (!read_file(path, *text))
+        {
+            return nullptr;
+        }
+        std::string *data = text.release();
+        return new IncludeResult{path.string(), data->data(), data->size(), data};
+    }
+
+    std::filesystem::path m_directory;
+};
+
+// Same target environment as the shaders build stage, see CMakeLists.txt.
+// Messages get compiler errors and warnings.
+auto compile_glsl(const std::filesystem::path &directory,
+                  const std::filesystem::path &path,
+                  EShLanguage                  stage,
+                  std::vector<uint32_t>       &spirv,
+                  std::string                 &messages)
+-> bool
+{
+    std::string source;
+    if (!read_file(path, source))
+    {
+        messages = fmt::format("{}: cannot read file\n", path.string());
+        return false;
+    }
+
+    const std::string path_string = path.string();
+    const char *sources[] = {source.c_str()};
+    const int   lengths[] = {static_cast<int>(source.size())};
+    const char *names  [] = {path_string.c_str()};
+
+    const auto message_flags = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+    glslang::TShader shader{stage};
+    shader.setStringsWithLengthsAndNames(sources, lengths, names, 1);
+    shader.setEnvInput (glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+    shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_1);
+    shader.setEnvTarget(glslang::EShTargetSpv,    glslang::EShTargetSpv_1_3);
+
+    Includer includer{directory};
+    const bool parsed = shader.parse(GetDefaultResources(), 100, false, message_flags, includer);
+    messages = shader.getInfoLog();
+    if (!parsed)
+    {
+        return false;
+    }
+
+    glslang::TProgram program;
+    program.addShader(&shader);
+    const bool linked = program.link(message_flags);
+    messages += program.getInfoLog();
+    if (!linked)
+    {
+        return false;
+    }
+
+    glslang::SpvOptions options;
+    options.generateDebugInfo = true;
+    options.disableOptimizer  = false;
+    options.validate          = true;
+    spv::SpvBuildLogger logger;
+    glslang::GlslangToSpv(*program.getIntermediate(stage), spirv, &logger, &options);
+    messages += logger.getAllMessages();
+    return !spirv.empty();
+}
+
+} // anonymous namespace
+
+auto Shader_watcher::is_supported()
+-> bool
+{
+    return true;
+}
+
+Shader_watcher::Shader_watcher(Context &context, const std::string &directory)
+    : m_shader_library  {context.shader_library}
+    , m_pipeline_factory{context.pipeline_factory}
+    , m_directory       {directory}
+{
+    Expects(m_shader_library   != nullptr);
+    Expects(m_pipeline_factory != nullptr);
+
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_stop_fd    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((m_inotify_fd < 0) || (m_stop_fd < 0))
+    {
+        log_vulkan.warn("Shader hot reload disabled: {}\n", strerror(errno));
+        return;
+    }
+
+    // Editors either write the file in place, or write a new file and
+    // rename it over the old one
+    if (inotify_add_watch(m_inotify_fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        log_vulkan.warn("Shader hot reload disabled, cannot watch {}: {}\n", m_directory, strerror(errno));
+        return;
+    }
+
+    log_vulkan.info("Shader hot reload: watching {}\n", m_directory);
+    m_thread = std::thread(&Shader_watcher::run, this);
+}
+
+Shader_watcher::~Shader_watcher()
+{
+    if (m_thread.joinable())
+    {
+        const uint64_t value{1};
+        if (write(m_stop_fd, &value, sizeof(value)) != sizeof(value))
+        {
+            log_vulkan.warn("Shader hot reload: cannot stop watcher thread\n");
+        }
+        m_thread.join();
+    }
+    if (m_inotify_fd >= 0)
+    {
+        close(m_inotify_fd);
+    }
+    if (m_stop_fd >= 0)
+    {
+        close(m_stop_fd);
+    }
+}
+
+void Shader_watcher::run()
+{
+    glslang::InitializeProcess();
+
+    std::set<std::string> changed_files;
+    for (;;)
+    {
+        std::array<pollfd, 2> fds{
+            pollfd{m_inotify_fd, POLLIN, 0},
+            pollfd{m_stop_fd,    POLLIN, 0}
+        };
+        const int timeout_ms = changed_files.empty() ? -1 : debounce_ms;
+        const int count = poll(fds.data(), fds.size(), timeout_ms);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            log_vulkan.warn("Shader hot reload stopped: {}\n", strerror(errno));
+            break;
+        }
+        if ((fds[1].revents & POLLIN) != 0)
+        {
+            break;
+        }
+        if (count == 0)
+        {
+            compile_changed(changed_files);
+            changed_files.clear();
+            continue;
+        }
+        if ((fds[0].revents & POLLIN) != 0)
+        {
+            read_events(changed_files);
+        }
+    }
+
+    glslang::FinalizeProcess();
+}
+
+void Shader_watcher::read_events(std::set<std::string> &changed_files)
+{
+    alignas(inotify_event) char buffer[4096];
+    for (;;)
+    {
+        const ssize_t size = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (size <= 0)
+        {
+            return;
+        }
+        for (const char *p = buffer; p < buffer + size; )
+        {
+            const auto *event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if ((event->mask & IN_Q_OVERFLOW) != 0)
+            {
+                // Events were lost, recompile everything
+                changed_files.insert(std::string{});
+                continue;
+            }
+            if (event->len == 0)
+            {
+                continue;
+            }
+            const std::string name{event->name};
+            // Editor swap and backup files
+            if ((name.front() == '.') || (name.back() == '~'))
+            {
+                continue;
+            }
+            changed_files.insert(name);
+        }
+    }
+}
+
+void Shader_watcher::compile_changed(const std::set<std::string> &changed_files)
+{
+    std::set<std::string> shaders;
+    bool                  compile_all{false};
+    for (const auto &file_name : changed_files)
+    {
+        EShLanguage stage;
+        if (get_stage(file_name, stage))
+        {
+            shaders.insert(file_name);
+        }
+        else
+        {
+            // Include dependencies are not tracked
+            compile_all = true;
+        }
+    }
+
+    if (compile_all)
+    {
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator{m_directory, error})
+        {
+            EShLanguage stage;
+            if (entry.is_regular_file() && get_stage(entry.path(), stage))
+            {
+                shaders.insert(entry.path().filename().string());
+            }
+        }
+    }
+
+    for (const auto &file_name : shaders)
+    {
+        compile(file_name);
+    }
+}
+
+void Shader_watcher::compile(const std::string &file_name)
+{
+    const std::filesystem::path directory{m_directory};
+    const std::filesystem::path path = directory / file_name;
+    EShLanguage stage;
+    VERIFY(get_stage(path, stage));
+
+    const auto            start = Clock::now();
+    std::vector<uint32_t> spirv;
+    std::string           messages;
+    const bool            compiled = compile_glsl(directory, path, stage, spirv, messages);
+    const auto            compile_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+
+    m_compile_count.fetch_add(1, std::memory_order_relaxed);
+    m_compile_time_ns.fetch_add(compile_time_ns, std::memory_order_relaxed);
+
+    if (!messages.empty() && (messages.back() != '\n'))
+    {
+        messages.push_back('\n');
+    }
+    if (!compiled)
+    {
+        m_error_count.fetch_add(1, std::memory_order_relaxed);
+        log_vulkan.warn("Shader {} failed to compile, keeping previous code\n", file_name);
+        log_shader.write_text(Log::Level::LEVEL_ERROR, messages);
+        return;
+    }
+    if (!messages.empty())
+    {
+        log_shader.write_text(Log::Level::LEVEL_WARN, messages);
+    }
+
+    m_shader_library->replace(file_name, std::move(spirv));
+    const uint32_t pipeline_count = m_pipeline_factory->rebuild_shader(file_name);
+    log_vulkan.info("Shader {} recompiled in {:.1f} ms, {} pipelines queued for rebuild\n",
+                    file_name,
+                    to_ms(compile_time_ns),
+                    pipeline_count);
+}
+
+#else
+
+auto Shader_watcher::is_supported()
+-> bool
+{
+    return false;
+}
+
+Shader_watcher::Shader_watcher(Context &context, const std::string &directory)
+    : m_shader_library  {context.shader_library}
+    , m_pipeline_factory{context.pipeline_factory}
+    , m_directory       {directory}
+{
+    log_vulkan.warn("Shader hot reload is not available, configure with VIPU_SHADER_HOT_RELOAD on Linux\n");
+}
+
+Shader_watcher::~Shader_watcher()
+{
+}
+
+void Shader_watcher::run()
+{
+}
+
+void Shader_watcher::read_events(std::set<std::string> &changed_files)
+{
+    static_cast<void>(changed_files);
+}
+
+void Shader_watcher::compile_changed(const std::set<std::string> &changed_files)
+{
+    static_cast<void>(changed_files);
+}
+
+void Shader_watcher::compile(const std::string &file_name)
+{
+    static_cast<void>(file_name);
+}
+
+#endif
+
+} // namespace vipu
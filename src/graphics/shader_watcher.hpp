@@ -0,0 +1,73 @@
+#ifndef shader_watcher_hpp_vipu_graphics
+#define shader_watcher_hpp_vipu_graphics
+
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace vipu
+{
+
+class Context;
+class Pipeline_factory;
+class Shader_library;
+
+// Development mode shader hot reload. Watches a GLSL source directory with
+// inotify, and recompiles changed shaders with glslang on a background
+// thread. New SPIR-V is installed to the shader library, and pipelines using
+// the shader are rebuilt by the pipeline factory, to be swapped in by
+// Pipeline_factory::apply_rebuilds() at a frame boundary. Compile errors are
+// logged to log_shader, and the previous code stays in use.
+//
+// Shaders are named by source file name, as in the shader library. A change
+// to any other file in the directory, such as an include file, recompiles
+// all shaders in the directory.
+//
+// Only available on Linux, in builds configured with VIPU_SHADER_HOT_RELOAD.
+class Shader_watcher
+{
+public:
+    static auto is_supported()
+    -> bool;
+
+    // Directory from environment variable VIPU_SHADER_WATCH, or res/shaders
+    // of the source tree in VIPU_SHADER_HOT_RELOAD builds. Empty disables.
+    static auto get_default_directory()
+    -> std::string;
+
+    // Context must have shader_library and pipeline_factory set, and they
+    // must outlive the watcher
+    Shader_watcher(Context &context, const std::string &directory);
+
+    ~Shader_watcher();
+
+    Shader_watcher(const Shader_watcher &) = delete;
+    Shader_watcher &operator=(const Shader_watcher &) = delete;
+
+    void log_statistics() const;
+
+private:
+    void run();
+
+    void read_events(std::set<std::string> &changed_files);
+
+    void compile_changed(const std::set<std::string> &changed_files);
+
+    void compile(const std::string &file_name);
+
+    Shader_library       *m_shader_library  {nullptr};
+    Pipeline_factory     *m_pipeline_factory{nullptr};
+    std::string           m_directory;
+    int                   m_inotify_fd{-1};
+    int                   m_stop_fd   {-1};   // eventfd, wakes up the thread for shutdown
+    std::thread           m_thread;
+    std::atomic<uint32_t> m_compile_count  {0};
+    std::atomic<uint32_t> m_error_count    {0};
+    std::atomic<uint64_t> m_compile_time_ns{0};
+};
+
+} // namespace vipu
+
+#endif // shader_watcher_hpp_vipu_graphics
@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "graphics/startup_timeline.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+Startup_timeline::Startup_timeline()
+    : m_start{Clock::now()}
+{
+}
+
+void Startup_timeline::add(const char *name, Clock::time_point start, Clock::time_point end)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phases.push_back(Phase{name, start, end, std::this_thread::get_id()});
+}
+
+void Startup_timeline::log_summary()
+{
+    std::vector<Phase> phases;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        phases = m_phases;
+    }
+    std::sort(phases.begin(), phases.end(), [](const Phase &lhs, const Phase &rhs)
+    {
+        return lhs.start < rhs.start;
+    });
+
+    // Small thread numbers are easier to read than thread ids
+    std::vector<std::thread::id> threads;
+    auto milliseconds = [](Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+
+    const auto       end = Clock::now();
+    Clock::duration  sum{0};
+    log_vulkan.info("Startup phases:          start ms  duration ms  thread\n");
+    for (const auto &phase : phases)
+    {
+        auto i = std::find(threads.begin(), threads.end(), phase.thread_id);
+        if (i == threads.end())
+        {
+            i = threads.insert(threads.end(), phase.thread_id);
+        }
+        log_vulkan.info("    {:<20} {:>10.3f} {:>12.3f} {:>7}\n",
+                        phase.name,
+                        milliseconds(phase.start - m_start),
+                        milliseconds(phase.end - phase.start),
+                        std::distance(threads.begin(), i));
+        sum += phase.end - phase.start;
+    }
+    log_vulkan.info("Startup wall time {:.3f} ms, sum of phases {:.3f} ms\n",
+                    milliseconds(end - m_start),
+                    milliseconds(sum));
+}
+
+} // namespace vipu
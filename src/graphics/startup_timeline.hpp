@@ -0,0 +1,89 @@
+#ifndef startup_timeline_hpp_vipu_graphics
+#define startup_timeline_hpp_vipu_graphics
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vipu
+{
+
+// Runs startup phases on the calling thread or on a worker thread, and
+// records when each phase started and ended so that log_summary() can
+// show where cold start time goes and how much overlaps.
+class Startup_timeline
+{
+public:
+    Startup_timeline();
+
+    template <typename Function>
+    auto run(const char *name, Function &&function)
+    -> std::invoke_result_t<Function>
+    {
+        Scope scope{*this, name};
+        return function();
+    }
+
+    // Phase runs on a new thread. Caller must get() the future before
+    // using anything the phase writes.
+    template <typename Function>
+    auto run_async(const char *name, Function &&function)
+    -> std::future<std::invoke_result_t<Function>>
+    {
+        return std::async(std::launch::async, [this, name, function = std::forward<Function>(function)]() mutable
+        {
+            Scope scope{*this, name};
+            return function();
+        });
+    }
+
+    // Logs start offset, duration and thread of each phase, and wall time
+    // since the timeline was created
+    void log_summary();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Phase
+    {
+        const char        *name{nullptr};
+        Clock::time_point  start;
+        Clock::time_point  end;
+        std::thread::id    thread_id;
+    };
+
+    class Scope
+    {
+    public:
+        Scope(Startup_timeline &timeline, const char *name)
+            : m_timeline{timeline}
+            , m_name    {name}
+            , m_start   {Clock::now()}
+        {
+        }
+
+        ~Scope()
+        {
+            m_timeline.add(m_name, m_start, Clock::now());
+        }
+
+    private:
+        Startup_timeline  &m_timeline;
+        const char        *m_name;
+        Clock::time_point  m_start;
+    };
+
+    void add(const char *name, Clock::time_point start, Clock::time_point end);
+
+    std::mutex         m_mutex;
+    Clock::time_point  m_start;
+    std::vector<Phase> m_phases;
+};
+
+} // namespace vipu
+
+#endif // startup_timeline_hpp_vipu_graphics
@@ -67,9 +67,19 @@ Swapchain::Swapchain(Context &context)
     m_surface_format = choose_format(surface_formats);
     VERIFY(m_surface_format.format != vk::Format::eUndefined);
 
-    std::array<uint32_t, 1> queue_family_indices {
-        context.graphics_queue_family_index
+    m_present_sharing             = context.present_sharing;
+    m_graphics_queue_family_index = context.graphics_queue_family_index;
+    m_present_queue_family_index  = context.present_queue_family_index;
+
+    // Family indices are only used with concurrent sharing
+    std::array<uint32_t, 2> queue_family_indices {
+        context.graphics_queue_family_index,
+        context.present_queue_family_index
     };
+    vk::SharingMode sharing_mode = (m_present_sharing == Present_sharing::concurrent)
+        ? vk::SharingMode::eConcurrent
+        : vk::SharingMode::eExclusive;
+    uint32_t queue_family_index_count = (m_present_sharing == Present_sharing::concurrent) ? 2 : 1;
 
     auto &c = surface_capabilities;
     log_vulkan.trace("minImageCount           {}\n",     c.minImageCount);
@@ -94,8 +104,8 @@ Swapchain::Swapchain(Context &context)
         surface_capabilities.currentExtent,         // extent
         1,                                          // array layers
         vk::ImageUsageFlagBits::eColorAttachment,   // image usage
-        vk::SharingMode::eExclusive,                // sharing mode
-        queue_family_indices.size(),                // queue family index count
+        sharing_mode,                               // sharing mode
+        queue_family_index_count,                   // queue family index count
         queue_family_indices.data(),                // queue family indices
         surface_capabilities.currentTransform,      // pre transform
         vk::CompositeAlphaFlagBitsKHR::eOpaque,     // composite alpha
@@ -115,10 +125,74 @@ Swapchain::Swapchain(Context &context)
     //
     // m_vk_swapchain = swapchain;
     m_vk_swapchain = context.vk_device.createSwapchainKHRUnique(swapchain_create_info);
+    m_images       = context.vk_device.getSwapchainImagesKHR(m_vk_swapchain.get());
 
     Ensures(m_vk_swapchain);
 }
 
+auto Swapchain::get_images()
+-> const std::vector<vk::Image> &
+{
+    return m_images;
+}
+
+auto Swapchain::get_present_sharing() const
+-> Present_sharing
+{
+    return m_present_sharing;
+}
+
+auto Swapchain::make_ownership_transfer_barrier(vk::Image image) const
+-> vk::ImageMemoryBarrier
+{
+    // Renderpass final layout is already ePresentSrcKHR, so no layout change
+    return vk::ImageMemoryBarrier{
+        vk::AccessFlagBits::eColorAttachmentWrite,      // src access, ignored by acquire
+        vk::AccessFlags{},                              // dst access, none for presentation
+        vk::ImageLayout::ePresentSrcKHR,
+        vk::ImageLayout::ePresentSrcKHR,
+        m_graphics_queue_family_index,
+        m_present_queue_family_index,
+        image,
+        vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}
+    };
+}
+
+void Swapchain::record_release_to_present(vk::CommandBuffer command_buffer, vk::Image image) const
+{
+    if (m_present_sharing != Present_sharing::ownership_transfer)
+    {
+        return;
+    }
+
+    auto barrier = make_ownership_transfer_barrier(image);
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                   vk::PipelineStageFlagBits::eBottomOfPipe,
+                                   vk::DependencyFlags{},
+                                   {},
+                                   {},
+                                   barrier);
+}
+
+void Swapchain::record_acquire_for_present(vk::CommandBuffer command_buffer, vk::Image image) const
+{
+    if (m_present_sharing != Present_sharing::ownership_transfer)
+    {
+        return;
+    }
+
+    // Present family may not support graphics stages. Source stage matches
+    // the semaphore wait stage (eAllCommands) of the present queue submit.
+    auto barrier = make_ownership_transfer_barrier(image);
+    barrier.srcAccessMask = vk::AccessFlags{};
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                                   vk::PipelineStageFlagBits::eBottomOfPipe,
+                                   vk::DependencyFlags{},
+                                   {},
+                                   {},
+                                   barrier);
+}
+
 auto Swapchain::get()
 -> vk::SwapchainKHR
 {
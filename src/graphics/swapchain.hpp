@@ -1,6 +1,11 @@
 #ifndef swapchain_hpp_vipu_graphics
 #define swapchain_hpp_vipu_graphics
 
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "graphics/present_sharing.hpp"
 #include "graphics/vulkan.hpp"
 
 namespace vipu
@@ -19,9 +24,31 @@ public:
     auto get_surface_format()
     -> vk::SurfaceFormatKHR;
 
+    auto get_images()
+    -> const std::vector<vk::Image> &;
+
+    auto get_present_sharing() const
+    -> Present_sharing;
+
+    // With Present_sharing::ownership_transfer, image ownership moves from
+    // graphics to present family after drawing: record release as the last
+    // graphics command, and acquire in a present queue submit which waits
+    // for the graphics submit. Images are not transferred back, as they are
+    // cleared when drawing. Other sharing modes record nothing.
+    void record_release_to_present(vk::CommandBuffer command_buffer, vk::Image image) const;
+
+    void record_acquire_for_present(vk::CommandBuffer command_buffer, vk::Image image) const;
+
 protected:
+    auto make_ownership_transfer_barrier(vk::Image image) const
+    -> vk::ImageMemoryBarrier;
+
     vk::UniqueSwapchainKHR m_vk_swapchain;
     vk::SurfaceFormatKHR   m_surface_format;
+    std::vector<vk::Image> m_images;
+    Present_sharing        m_present_sharing{Present_sharing::exclusive};
+    uint32_t               m_graphics_queue_family_index{std::numeric_limits<uint32_t>::max()};
+    uint32_t               m_present_queue_family_index {std::numeric_limits<uint32_t>::max()};
 };
 
 } // namespace vipu
@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <cstring>
+
+#include "gsl/gsl"
+
+#include "graphics/upload_engine.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+#include "graphics/physical_device.hpp"
+#include "graphics/queue.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+constexpr uint64_t invalid_staging_offset{std::numeric_limits<uint64_t>::max()};
+
+} // anonymous namespace
+
+Upload_engine::Upload_engine(Context &context, uint64_t staging_size)
+{
+    Expects(context.vk_device);
+    Expects(context.transfer_queue != nullptr);
+    Expects(context.memory_allocator != nullptr);
+    Expects(context.physical_device != nullptr);
+    VERIFY(context.device_features.timeline_semaphore);
+
+    m_vk_device                   = context.vk_device;
+    m_transfer_queue              = context.transfer_queue;
+    m_graphics_queue_family_index = context.graphics_queue_family_index;
+    m_transfer_ownership          = context.transfer_queue_family_index != context.graphics_queue_family_index;
+    m_memory_allocator            = context.memory_allocator;
+    m_copy_alignment              = std::max(uint64_t{16},
+                                             static_cast<uint64_t>(context.physical_device->get_properties().limits.optimalBufferCopyOffsetAlignment));
+
+    vk::SemaphoreTypeCreateInfo semaphore_type_create_info{vk::SemaphoreType::eTimeline, 0};
+    vk::SemaphoreCreateInfo     semaphore_create_info;
+    semaphore_create_info.setPNext(&semaphore_type_create_info);
+    m_timeline_semaphore = m_vk_device.createSemaphoreUnique(semaphore_create_info);
+
+    m_command_pool = m_vk_device.createCommandPoolUnique(
+        {
+            vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient,
+            context.transfer_queue_family_index
+        }
+    );
+
+    m_staging_size   = staging_size;
+    m_staging_buffer = m_vk_device.createBufferUnique(
+        vk::BufferCreateInfo{
+            vk::BufferCreateFlags{},
+            staging_size,
+            vk::BufferUsageFlagBits::eTransferSrc,
+            vk::SharingMode::eExclusive
+        }
+    );
+    m_staging_allocation = m_memory_allocator->allocate_for_buffer(m_staging_buffer.get(), Memory_usage::staging);
+    VERIFY(m_staging_allocation.is_valid());
+    VERIFY(m_staging_allocation.mapped != nullptr);
+
+    log_vulkan.trace("Upload engine: {} MiB staging, transfer queue family {}{}\n",
+                     staging_size / (1024 * 1024),
+                     context.transfer_queue_family_index,
+                     m_transfer_ownership ? ", with ownership transfers" : "");
+
+    m_thread = std::thread(&Upload_engine::run, this);
+}
+
+Upload_engine::~Upload_engine()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+
+    if (m_timeline_value > 0)
+    {
+        vk::Semaphore semaphore = m_timeline_semaphore.get();
+        auto result = m_vk_device.waitSemaphoresKHR(vk::SemaphoreWaitInfo{vk::SemaphoreWaitFlags{}, 1, &semaphore, &m_timeline_value},
+                                                    std::numeric_limits<uint64_t>::max());
+        VERIFY(result == vk::Result::eSuccess);
+    }
+
+    log_vulkan.info("Upload engine: {} bytes direct, {} bytes staged in {} submits\n",
+                    m_statistics.direct_bytes,
+                    m_statistics.staged_bytes,
+                    m_statistics.submitted_count);
+
+    m_staging_buffer.reset();
+    m_memory_allocator->free(m_staging_allocation);
+}
+
+auto Upload_engine::upload(Buffer_upload &&upload, Upload_priority priority)
+-> uint64_t
+{
+    Expects(upload.buffer);
+
+    if (upload.mapped != nullptr)
+    {
+        memcpy(static_cast<uint8_t *>(upload.mapped) + upload.offset, upload.data.data(), upload.data.size());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.uploaded_bytes += upload.data.size();
+        m_statistics.direct_bytes   += upload.data.size();
+        return m_next_ticket++;
+    }
+
+    auto request = std::make_unique<Request>();
+    request->buffer = std::move(upload);
+    return enqueue(std::move(request), priority);
+}
+
+auto Upload_engine::upload(Image_upload &&upload, Upload_priority priority)
+-> uint64_t
+{
+    Expects(upload.image);
+    VERIFY(upload.data.size() <= m_staging_size);
+
+    auto request = std::make_unique<Request>();
+    request->is_image = true;
+    request->image    = std::move(upload);
+    return enqueue(std::move(request), priority);
+}
+
+auto Upload_engine::enqueue(std::unique_ptr<Request> &&request, Upload_priority priority)
+-> uint64_t
+{
+    const bool empty = request->is_image ? request->image.data.empty() : request->buffer.data.empty();
+    uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ticket = m_next_ticket++;
+        if (empty)
+        {
+            return ticket;
+        }
+        request->ticket = ticket;
+        m_pending_tickets.insert(ticket);
+        m_queues[static_cast<uint32_t>(priority)].push_back(std::move(request));
+    }
+    m_condition.notify_all();
+    return ticket;
+}
+
+auto Upload_engine::get_timeline_value(uint64_t ticket) const
+-> uint64_t
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pending_tickets.count(ticket) > 0)
+    {
+        return not_submitted;
+    }
+    auto i = m_submitted_tickets.find(ticket);
+    return (i != m_submitted_tickets.end()) ? i->second : 0;
+}
+
+auto Upload_engine::is_complete(uint64_t ticket) const
+-> bool
+{
+    const uint64_t value = get_timeline_value(ticket);
+    if (value == not_submitted)
+    {
+        return false;
+    }
+    return (value == 0) || (m_vk_device.getSemaphoreCounterValueKHR(m_timeline_semaphore.get()) >= value);
+}
+
+void Upload_engine::set_frame_budget(uint64_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frame_budget = bytes;
+    }
+    m_condition.notify_all();
+}
+
+void Upload_engine::begin_frame()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.frame_bytes = 0;
+    }
+    m_condition.notify_all();
+}
+
+auto Upload_engine::record_acquire_barriers(vk::CommandBuffer command_buffer)
+-> uint64_t
+{
+    std::vector<Acquire> acquires;
+    uint64_t             wait_value{0};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        acquires.swap(m_acquires);
+        if (m_timeline_value > m_acquired_value)
+        {
+            wait_value       = m_timeline_value;
+            m_acquired_value = m_timeline_value;
+        }
+    }
+
+    if (acquires.empty())
+    {
+        return wait_value;
+    }
+
+    std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+    std::vector<vk::ImageMemoryBarrier>  image_barriers;
+    for (const auto &acquire : acquires)
+    {
+        if (acquire.is_image)
+        {
+            image_barriers.push_back(acquire.image_barrier);
+        }
+        else
+        {
+            buffer_barriers.push_back(acquire.buffer_barrier);
+        }
+    }
+
+    // Source stage includes any stage the timeline semaphore wait may use
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                                   vk::PipelineStageFlagBits::eAllCommands,
+                                   vk::DependencyFlags{},
+                                   {},
+                                   buffer_barriers,
+                                   image_barriers);
+    return wait_value;
+}
+
+auto Upload_engine::get_timeline_semaphore()
+-> vk::Semaphore
+{
+    return m_timeline_semaphore.get();
+}
+
+auto Upload_engine::get_statistics() const
+-> Statistics
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void Upload_engine::wait_idle()
+{
+    uint64_t value;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]()
+        {
+            return m_pending_tickets.empty();
+        });
+        value = m_timeline_value;
+    }
+    if (value == 0)
+    {
+        return;
+    }
+
+    vk::Semaphore semaphore = m_timeline_semaphore.get();
+    auto result = m_vk_device.waitSemaphoresKHR(vk::SemaphoreWaitInfo{vk::SemaphoreWaitFlags{}, 1, &semaphore, &value},
+                                                std::numeric_limits<uint64_t>::max());
+    VERIFY(result == vk::Result::eSuccess);
+}
+
+// Called with m_mutex locked
+auto Upload_engine::has_work() const
+-> bool
+{
+    for (uint32_t priority = 0; priority < upload_priority_count; ++priority)
+    {
+        if (m_queues[priority].empty())
+        {
+            continue;
+        }
+        if ((priority == static_cast<uint32_t>(Upload_priority::critical)) ||
+            (m_frame_budget == 0) ||
+            (m_statistics.frame_bytes < m_frame_budget) ||
+            m_stop)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Positions grow monotonically; offset in buffer is position modulo size.
+// Allocations do not wrap around the end of the buffer.
+auto Upload_engine::allocate_staging(uint64_t size)
+-> uint64_t
+{
+    uint64_t position = (m_staging_head + m_copy_alignment - 1) & ~(m_copy_alignment - 1);
+    const uint64_t offset = position % m_staging_size;
+    if (offset + size > m_staging_size)
+    {
+        position += m_staging_size - offset;
+    }
+    if (position + size - m_staging_tail > m_staging_size)
+    {
+        return invalid_staging_offset;
+    }
+    m_staging_head = position + size;
+    return position % m_staging_size;
+}
+
+void Upload_engine::reclaim(bool wait_for_oldest)
+{
+    if (m_batches.empty())
+    {
+        return;
+    }
+
+    vk::Semaphore semaphore = m_timeline_semaphore.get();
+    if (wait_for_oldest)
+    {
+        const uint64_t value = m_batches.front().timeline_value;
+        auto result = m_vk_device.waitSemaphoresKHR(vk::SemaphoreWaitInfo{vk::SemaphoreWaitFlags{}, 1, &semaphore, &value},
+                                                    std::numeric_limits<uint64_t>::max());
+        VERIFY(result == vk::Result::eSuccess);
+    }
+
+    const uint64_t completed = m_vk_device.getSemaphoreCounterValueKHR(semaphore);
+    while (!m_batches.empty() && (m_batches.front().timeline_value <= completed))
+    {
+        m_staging_tail = m_batches.front().staging_end;
+        m_free_command_buffers.push_back(m_batches.front().command_buffer);
+        m_batches.pop_front();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_completed_value = completed;
+    for (auto i = m_submitted_tickets.begin(); i != m_submitted_tickets.end();)
+    {
+        i = (i->second <= completed) ? m_submitted_tickets.erase(i) : std::next(i);
+    }
+}
+
+void Upload_engine::run()
+{
+    constexpr uint32_t critical = static_cast<uint32_t>(Upload_priority::critical);
+
+    for (;;)
+    {
+        reclaim(false);
+
+        // Nothing in flight, so the next batch can start from the beginning
+        // of the staging buffer. Not done per allocation, as copies of the
+        // batch being built are not in m_batches yet.
+        if (m_batches.empty())
+        {
+            m_staging_head = 0;
+            m_staging_tail = 0;
+        }
+
+        std::vector<Copy>                     copies;
+        std::vector<std::unique_ptr<Request>> finished;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]()
+            {
+                return m_stop || has_work();
+            });
+            if (!has_work())
+            {
+                break; // stopping, and all uploads have been submitted
+            }
+
+            // Requests stay in their queue until fully scheduled. Only this
+            // thread removes requests, so pointers to them remain valid.
+            bool staging_full{false};
+            for (uint32_t priority = 0; (priority < upload_priority_count) && !staging_full; ++priority)
+            {
+                auto &queue = m_queues[priority];
+                while (!queue.empty())
+                {
+                    const bool budgeted = (priority != critical) && (m_frame_budget > 0) && !m_stop;
+                    if (budgeted && (m_statistics.frame_bytes >= m_frame_budget))
+                    {
+                        break;
+                    }
+
+                    Request &request = *queue.front();
+                    const uint64_t total_size = request.is_image ? request.image.data.size() : request.buffer.data.size();
+                    uint64_t size = total_size - request.progress;
+                    if (!request.is_image)
+                    {
+                        size = std::min(size, m_staging_size / 4);
+                        if (budgeted)
+                        {
+                            size = std::min(size, m_frame_budget - m_statistics.frame_bytes);
+                        }
+                    }
+
+                    const uint64_t staging_offset = allocate_staging(size);
+                    if (staging_offset == invalid_staging_offset)
+                    {
+                        staging_full = true;
+                        break;
+                    }
+
+                    copies.push_back(Copy{&request, request.progress, staging_offset, size});
+                    request.progress               += size;
+                    m_statistics.frame_bytes       += size;
+                    m_statistics.uploaded_bytes    += size;
+                    m_statistics.staged_bytes      += size;
+                    if (request.progress == total_size)
+                    {
+                        finished.push_back(std::move(queue.front()));
+                        queue.pop_front();
+                    }
+                }
+            }
+        }
+
+        if (copies.empty())
+        {
+            // Staging ring is full of in flight uploads
+            reclaim(true);
+            continue;
+        }
+
+        record_and_submit(copies, finished);
+        m_condition.notify_all();
+    }
+}
+
+void Upload_engine::record_and_submit(const std::vector<Copy> &copies, std::vector<std::unique_ptr<Request>> &finished)
+{
+    auto *staging_data = static_cast<uint8_t *>(m_staging_allocation.mapped);
+    for (const auto &copy : copies)
+    {
+        const auto &data = copy.request->is_image ? copy.request->image.data : copy.request->buffer.data;
+        memcpy(staging_data + copy.staging_offset, data.data() + copy.source_offset, copy.size);
+    }
+
+    vk::CommandBuffer command_buffer;
+    if (m_free_command_buffers.empty())
+    {
+        command_buffer = m_vk_device.allocateCommandBuffers(
+            vk::CommandBufferAllocateInfo{m_command_pool.get(), vk::CommandBufferLevel::ePrimary, 1}
+        )[0];
+    }
+    else
+    {
+        command_buffer = m_free_command_buffers.back();
+        m_free_command_buffers.pop_back();
+    }
+
+    const uint32_t transfer_family = m_transfer_queue->get_family_index();
+    const uint32_t src_family      = m_transfer_ownership ? transfer_family               : VK_QUEUE_FAMILY_IGNORED;
+    const uint32_t dst_family      = m_transfer_ownership ? m_graphics_queue_family_index : VK_QUEUE_FAMILY_IGNORED;
+
+    std::vector<vk::ImageMemoryBarrier>  pre_image_barriers;
+    std::vector<vk::ImageMemoryBarrier>  post_image_barriers;
+    std::vector<vk::BufferMemoryBarrier> post_buffer_barriers;
+    std::vector<Acquire>                 acquires;
+    for (const auto &copy : copies)
+    {
+        if (copy.request->is_image)
+        {
+            const auto &image = copy.request->image;
+            const vk::ImageSubresourceRange range{image.subresource.aspectMask,
+                                                  image.subresource.mipLevel, 1,
+                                                  image.subresource.baseArrayLayer, image.subresource.layerCount};
+            pre_image_barriers.emplace_back(vk::AccessFlags{},
+                                            vk::AccessFlagBits::eTransferWrite,
+                                            vk::ImageLayout::eUndefined,
+                                            vk::ImageLayout::eTransferDstOptimal,
+                                            VK_QUEUE_FAMILY_IGNORED,
+                                            VK_QUEUE_FAMILY_IGNORED,
+                                            image.image,
+                                            range);
+            vk::ImageMemoryBarrier release{vk::AccessFlagBits::eTransferWrite,
+                                           vk::AccessFlags{},
+                                           vk::ImageLayout::eTransferDstOptimal,
+                                           image.final_layout,
+                                           src_family,
+                                           dst_family,
+                                           image.image,
+                                           range};
+            post_image_barriers.push_back(release);
+            if (m_transfer_ownership)
+            {
+                Acquire acquire;
+                acquire.is_image                    = true;
+                acquire.image_barrier               = release;
+                acquire.image_barrier.srcAccessMask = vk::AccessFlags{};
+                acquire.image_barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+                acquires.push_back(acquire);
+            }
+        }
+        else if (m_transfer_ownership)
+        {
+            const auto &buffer = copy.request->buffer;
+            vk::BufferMemoryBarrier release{vk::AccessFlagBits::eTransferWrite,
+                                            vk::AccessFlags{},
+                                            src_family,
+                                            dst_family,
+                                            buffer.buffer,
+                                            buffer.offset + copy.source_offset,
+                                            copy.size};
+            post_buffer_barriers.push_back(release);
+            Acquire acquire;
+            acquire.buffer_barrier               = release;
+            acquire.buffer_barrier.srcAccessMask = vk::AccessFlags{};
+            acquire.buffer_barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+            acquires.push_back(acquire);
+        }
+    }
+
+    command_buffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    if (!pre_image_barriers.empty())
+    {
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                       vk::PipelineStageFlagBits::eTransfer,
+                                       vk::DependencyFlags{},
+                                       {},
+                                       {},
+                                       pre_image_barriers);
+    }
+    for (const auto &copy : copies)
+    {
+        if (copy.request->is_image)
+        {
+            const auto &image = copy.request->image;
+            command_buffer.copyBufferToImage(m_staging_buffer.get(),
+                                             image.image,
+                                             vk::ImageLayout::eTransferDstOptimal,
+                                             vk::BufferImageCopy{copy.staging_offset, 0, 0, image.subresource, image.offset, image.extent});
+        }
+        else
+        {
+            const auto &buffer = copy.request->buffer;
+            command_buffer.copyBuffer(m_staging_buffer.get(),
+                                      buffer.buffer,
+                                      vk::BufferCopy{copy.staging_offset, buffer.offset + copy.source_offset, copy.size});
+        }
+    }
+    if (!post_image_barriers.empty() || !post_buffer_barriers.empty())
+    {
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                       vk::PipelineStageFlagBits::eBottomOfPipe,
+                                       vk::DependencyFlags{},
+                                       {},
+                                       post_buffer_barriers,
+                                       post_image_barriers);
+    }
+    command_buffer.end();
+
+    // Only this thread writes m_timeline_value
+    const uint64_t                timeline_value = m_timeline_value + 1;
+    vk::Semaphore                 semaphore      = m_timeline_semaphore.get();
+    vk::TimelineSemaphoreSubmitInfo timeline_submit_info{0, nullptr, 1, &timeline_value};
+    vk::SubmitInfo submit_info{
+        0, nullptr, nullptr,
+        1, &command_buffer,
+        1, &semaphore
+    };
+    submit_info.setPNext(&timeline_submit_info);
+    m_transfer_queue->submit(submit_info);
+
+    m_batches.push_back(Batch{timeline_value, m_staging_head, command_buffer});
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_timeline_value = timeline_value;
+    ++m_statistics.submitted_count;
+    for (const auto &request : finished)
+    {
+        m_pending_tickets.erase(request->ticket);
+        m_submitted_tickets[request->ticket] = timeline_value;
+    }
+    m_acquires.insert(m_acquires.end(), acquires.begin(), acquires.end());
+}
+
+} // namespace vipu
@@ -0,0 +1,211 @@
+#ifndef upload_engine_hpp_vipu_graphics
+#define upload_engine_hpp_vipu_graphics
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "graphics/memory_allocator.hpp"
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+class Context;
+class Queue;
+
+enum class Upload_priority : uint32_t
+{
+    critical = 0,   // needed for the next frame, ignores frame budget
+    high,
+    normal,
+    low
+};
+
+constexpr uint32_t upload_priority_count{4};
+
+// When mapped is set, from Memory_allocator::get_direct_write_pointer() for
+// the memory of buffer, data is written directly at mapped + offset by
+// upload(), and no transfer is recorded. As with staged uploads, the GPU must
+// not be using the range.
+struct Buffer_upload
+{
+    vk::Buffer           buffer;
+    uint64_t             offset{0};
+    std::vector<uint8_t> data;
+    void                *mapped{nullptr};
+};
+
+// Data must fit in the staging ring. Image is transitioned from undefined
+// layout, so previous contents are discarded.
+struct Image_upload
+{
+    vk::Image                  image;
+    vk::ImageSubresourceLayers subresource{vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+    vk::Offset3D               offset;
+    vk::Extent3D               extent;
+    vk::ImageLayout            final_layout{vk::ImageLayout::eShaderReadOnlyOptimal};
+    std::vector<uint8_t>       data;
+};
+
+// Streams buffer and image data to the GPU from a background thread. Data is
+// copied to a pooled staging ring, and copies are recorded and submitted on
+// the transfer queue. Each submit signals the next value of a timeline
+// semaphore; graphics submits wait for the value from
+// record_acquire_barriers(). Buffers are split into chunks, so that large
+// uploads do not block the staging ring or exceed the frame budget.
+// Resources are assumed to use exclusive sharing; when the transfer family
+// differs from the graphics family, ownership is released on the transfer
+// queue and acquired by record_acquire_barriers(). Buffers allocated with
+// Memory_usage::gpu_upload on unified memory or resizable BAR devices can be
+// written directly, see Buffer_upload.
+class Upload_engine
+{
+public:
+    struct Statistics
+    {
+        uint64_t uploaded_bytes  {0};
+        uint64_t direct_bytes    {0};   // written directly to device local memory
+        uint64_t staged_bytes    {0};   // copied through staging ring
+        uint64_t submitted_count {0};
+        uint64_t frame_bytes     {0};   // staged since begin_frame()
+    };
+
+    static constexpr uint64_t not_submitted{std::numeric_limits<uint64_t>::max()};
+
+    Upload_engine(Context &context, uint64_t staging_size = 64 * 1024 * 1024);
+
+    ~Upload_engine();
+
+    Upload_engine(const Upload_engine &) = delete;
+    Upload_engine &operator=(const Upload_engine &) = delete;
+
+    // Returns ticket for get_timeline_value() and is_complete()
+    auto upload(Buffer_upload &&upload, Upload_priority priority = Upload_priority::normal)
+    -> uint64_t;
+
+    auto upload(Image_upload &&upload, Upload_priority priority = Upload_priority::normal)
+    -> uint64_t;
+
+    // Returns timeline value to wait for, 0 if the upload has completed, or
+    // not_submitted
+    auto get_timeline_value(uint64_t ticket) const
+    -> uint64_t;
+
+    auto is_complete(uint64_t ticket) const
+    -> bool;
+
+    // Bytes per frame for non-critical uploads, 0 for no limit
+    void set_frame_budget(uint64_t bytes);
+
+    // Restarts frame budget
+    void begin_frame();
+
+    // Records queue family acquire barriers for resources uploaded since
+    // previous call, into a graphics queue command buffer. Returns timeline
+    // value which the submit of that command buffer must wait for, at least
+    // at the stages using the uploaded resources (0 if nothing was uploaded).
+    auto record_acquire_barriers(vk::CommandBuffer command_buffer)
+    -> uint64_t;
+
+    auto get_timeline_semaphore()
+    -> vk::Semaphore;
+
+    auto get_statistics() const
+    -> Statistics;
+
+    // Blocks until every upload so far has been submitted and completed
+    void wait_idle();
+
+private:
+    struct Request
+    {
+        uint64_t      ticket  {0};
+        bool          is_image{false};
+        Buffer_upload buffer;
+        Image_upload  image;
+        uint64_t      progress{0};   // bytes already scheduled
+    };
+
+    struct Copy
+    {
+        Request *request;
+        uint64_t source_offset;      // in request data
+        uint64_t staging_offset;
+        uint64_t size;
+    };
+
+    struct Batch
+    {
+        uint64_t          timeline_value{0};
+        uint64_t          staging_end   {0};
+        vk::CommandBuffer command_buffer;
+    };
+
+    struct Acquire
+    {
+        vk::BufferMemoryBarrier buffer_barrier;
+        vk::ImageMemoryBarrier  image_barrier;
+        bool                    is_image{false};
+    };
+
+    auto enqueue(std::unique_ptr<Request> &&request, Upload_priority priority)
+    -> uint64_t;
+
+    void run();
+
+    auto has_work() const
+    -> bool;
+
+    auto allocate_staging(uint64_t size)
+    -> uint64_t;
+
+    void reclaim(bool wait_for_oldest);
+
+    void record_and_submit(const std::vector<Copy> &copies, std::vector<std::unique_ptr<Request>> &finished);
+
+    vk::Device                                             m_vk_device;
+    Queue                                                 *m_transfer_queue{nullptr};
+    uint32_t                                               m_graphics_queue_family_index{0};
+    bool                                                   m_transfer_ownership{false};
+    uint64_t                                               m_copy_alignment{16};
+
+    vk::UniqueSemaphore                                    m_timeline_semaphore;
+    vk::UniqueCommandPool                                  m_command_pool;
+    std::vector<vk::CommandBuffer>                         m_free_command_buffers;
+
+    Memory_allocator                                      *m_memory_allocator{nullptr};
+    vk::UniqueBuffer                                       m_staging_buffer;
+    Memory_allocation                                      m_staging_allocation;
+    uint64_t                                               m_staging_size{0};
+    uint64_t                                               m_staging_head{0};  // monotonic positions
+    uint64_t                                               m_staging_tail{0};
+    std::deque<Batch>                                      m_batches;          // in flight, only used by worker
+
+    mutable std::mutex                                     m_mutex;
+    std::condition_variable                                m_condition;
+    std::array<std::deque<std::unique_ptr<Request>>, upload_priority_count> m_queues;
+    std::unordered_set<uint64_t>                           m_pending_tickets;
+    std::unordered_map<uint64_t, uint64_t>                 m_submitted_tickets;  // ticket to timeline value
+    std::vector<Acquire>                                   m_acquires;
+    uint64_t                                               m_next_ticket    {1};
+    uint64_t                                               m_timeline_value {0};  // last submitted
+    uint64_t                                               m_acquired_value {0};  // last returned by record_acquire_barriers()
+    uint64_t                                               m_completed_value{0};
+    uint64_t                                               m_frame_budget   {0};
+    Statistics                                             m_statistics;
+    bool                                                   m_stop{false};
+    std::thread                                            m_thread;
+};
+
+} // namespace vipu
+
+#endif // upload_engine_hpp_vipu_graphics
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <memory>
+
+#include "gsl/gsl"
+
+#include "graphics/upload_ring.hpp"
+#include "graphics/context.hpp"
+#include "graphics/log.hpp"
+#include "graphics/physical_device.hpp"
+
+namespace vipu
+{
+
+Upload_ring_slice::Upload_ring_slice(vk::Buffer buffer, uint8_t *data, uint64_t offset, uint64_t size, uint64_t default_alignment)
+    : m_buffer           {buffer}
+    , m_data             {data}
+    , m_offset           {offset}
+    , m_default_alignment{default_alignment}
+    , m_linear_allocator {size}
+{
+}
+
+auto Upload_ring_slice::allocate(uint64_t size, uint64_t alignment)
+-> Allocation
+{
+    // Slice offset is a multiple of default alignment, so offsets aligned
+    // within the slice are aligned in the buffer
+    const uint64_t offset = m_linear_allocator.allocate(size, (alignment == 0) ? m_default_alignment : alignment);
+    if (offset == Linear_allocator::invalid_offset)
+    {
+        m_failed_count.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+
+    return Allocation{
+        m_buffer,
+        m_offset + offset,
+        size,
+        m_data + m_offset + offset
+    };
+}
+
+void Upload_ring_slice::reset()
+{
+    m_peak_used_size = std::max(m_peak_used_size, m_linear_allocator.get_used_size());
+    m_linear_allocator.reset();
+}
+
+auto Upload_ring_slice::get_size() const
+-> uint64_t
+{
+    return m_linear_allocator.get_size();
+}
+
+auto Upload_ring_slice::get_peak_used_size() const
+-> uint64_t
+{
+    return std::max(m_peak_used_size, m_linear_allocator.get_used_size());
+}
+
+auto Upload_ring_slice::get_failed_count() const
+-> uint64_t
+{
+    return m_failed_count.load(std::memory_order_relaxed);
+}
+
+Upload_ring::Upload_ring(Context &context, uint64_t slice_size, uint32_t slice_count)
+{
+    Expects(context.vk_device);
+    Expects(context.memory_allocator != nullptr);
+    Expects(context.physical_device != nullptr);
+    Expects(slice_count > 0);
+
+    m_vk_device        = context.vk_device;
+    m_memory_allocator = context.memory_allocator;
+
+    const auto &limits = context.physical_device->get_properties().limits;
+    const uint64_t alignment = std::max({uint64_t{16},
+                                         static_cast<uint64_t>(limits.minUniformBufferOffsetAlignment),
+                                         static_cast<uint64_t>(limits.minStorageBufferOffsetAlignment)});
+    slice_size = (slice_size + alignment - 1) & ~(alignment - 1);
+
+    m_buffer = m_vk_device.createBufferUnique(
+        vk::BufferCreateInfo{
+            vk::BufferCreateFlags{},
+            slice_size * slice_count,
+            vk::BufferUsageFlagBits::eUniformBuffer |
+            vk::BufferUsageFlagBits::eStorageBuffer |
+            vk::BufferUsageFlagBits::eVertexBuffer  |
+            vk::BufferUsageFlagBits::eIndexBuffer   |
+            vk::BufferUsageFlagBits::eTransferSrc,
+            vk::SharingMode::eExclusive
+        }
+    );
+
+    m_allocation = m_memory_allocator->allocate_for_buffer(m_buffer.get(), Memory_usage::cpu_to_gpu);
+    VERIFY(m_allocation.is_valid());
+    VERIFY(m_allocation.mapped != nullptr);
+
+    for (uint32_t i = 0; i < slice_count; ++i)
+    {
+        m_slices.push_back(std::make_unique<Upload_ring_slice>(m_buffer.get(),
+                                                               static_cast<uint8_t *>(m_allocation.mapped),
+                                                               slice_size * i,
+                                                               slice_size,
+                                                               alignment));
+    }
+
+    log_vulkan.trace("Upload ring: {} slices of {} bytes, memory type {}\n",
+                     slice_count,
+                     slice_size,
+                     m_allocation.memory_type_index);
+}
+
+Upload_ring::~Upload_ring()
+{
+    m_slices.clear();
+    m_buffer.reset();
+    m_memory_allocator->free(m_allocation);
+}
+
+auto Upload_ring::get_buffer()
+-> vk::Buffer
+{
+    return m_buffer.get();
+}
+
+auto Upload_ring::get_slice(uint32_t slice_index)
+-> Upload_ring_slice &
+{
+    Expects(slice_index < m_slices.size());
+    return *m_slices[slice_index];
+}
+
+void Upload_ring::log_statistics() const
+{
+    for (size_t i = 0; i < m_slices.size(); ++i)
+    {
+        log_vulkan.info("Upload ring slice {}: peak {} of {} bytes, {} failed allocations\n",
+                        i,
+                        m_slices[i]->get_peak_used_size(),
+                        m_slices[i]->get_size(),
+                        m_slices[i]->get_failed_count());
+    }
+}
+
+} // namespace vipu
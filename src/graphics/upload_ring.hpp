@@ -0,0 +1,97 @@
+#ifndef upload_ring_hpp_vipu_graphics
+#define upload_ring_hpp_vipu_graphics
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "graphics/memory_allocator.hpp"
+#include "graphics/vulkan.hpp"
+#include "memory/linear_allocator.hpp"
+
+namespace vipu
+{
+
+class Context;
+
+// Per frame in flight part of Upload_ring. allocate() is lock-free and may be
+// called from any thread recording the frame. reset() is called by
+// Frame_in_flight::wait() once the frame fence has signaled.
+class Upload_ring_slice
+{
+public:
+    struct Allocation
+    {
+        vk::Buffer buffer;
+        uint64_t   offset{0};   // in buffer, for descriptors and vertex bindings
+        uint64_t   size  {0};
+        void      *data  {nullptr};
+
+        auto is_valid() const
+        -> bool
+        {
+            return data != nullptr;
+        }
+    };
+
+    Upload_ring_slice(vk::Buffer buffer, uint8_t *data, uint64_t offset, uint64_t size, uint64_t default_alignment);
+
+    // Returns invalid allocation when the slice is full. Alignment 0 uses
+    // the largest of the uniform and storage buffer offset alignments.
+    auto allocate(uint64_t size, uint64_t alignment = 0)
+    -> Allocation;
+
+    void reset();
+
+    auto get_size() const
+    -> uint64_t;
+
+    auto get_peak_used_size() const
+    -> uint64_t;
+
+    auto get_failed_count() const
+    -> uint64_t;
+
+private:
+    vk::Buffer            m_buffer;
+    uint8_t              *m_data{nullptr};
+    uint64_t              m_offset{0};
+    uint64_t              m_default_alignment{1};
+    Linear_allocator      m_linear_allocator;
+    uint64_t              m_peak_used_size{0};
+    std::atomic<uint64_t> m_failed_count{0};
+};
+
+// One persistently mapped, host coherent buffer for uniforms and dynamic
+// vertex and index data, split into one slice per frame in flight.
+// Prefers device local memory when it is host visible.
+class Upload_ring
+{
+public:
+    Upload_ring(Context &context, uint64_t slice_size, uint32_t slice_count);
+
+    ~Upload_ring();
+
+    Upload_ring(const Upload_ring &) = delete;
+    Upload_ring &operator=(const Upload_ring &) = delete;
+
+    auto get_buffer()
+    -> vk::Buffer;
+
+    auto get_slice(uint32_t slice_index)
+    -> Upload_ring_slice &;
+
+    void log_statistics() const;
+
+private:
+    vk::Device                                      m_vk_device;
+    Memory_allocator                               *m_memory_allocator{nullptr};
+    vk::UniqueBuffer                                m_buffer;
+    Memory_allocation                               m_allocation;
+    std::vector<std::unique_ptr<Upload_ring_slice>> m_slices;
+};
+
+} // namespace vipu
+
+#endif // upload_ring_hpp_vipu_graphics
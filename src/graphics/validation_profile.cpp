@@ -0,0 +1,97 @@
+#include <cstdlib>
+
+#include "graphics/validation_profile.hpp"
+#include "graphics/log.hpp"
+
+namespace vipu
+{
+
+auto c_str(Validation_profile profile)
+-> const char *
+{
+    switch (profile)
+    {
+        case Validation_profile::off:            return "off";
+        case Validation_profile::core:           return "core";
+        case Validation_profile::sync:           return "sync";
+        case Validation_profile::gpu_assisted:   return "gpu-assisted";
+        case Validation_profile::best_practices: return "best-practices";
+        default:                                 return "?";
+    }
+}
+
+auto parse_validation_profile(std::string_view text, Validation_profile &profile)
+-> bool
+{
+    for (auto candidate : {Validation_profile::off,
+                           Validation_profile::core,
+                           Validation_profile::sync,
+                           Validation_profile::gpu_assisted,
+                           Validation_profile::best_practices})
+    {
+        if (text == c_str(candidate))
+        {
+            profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+auto get_validation_profile(Validation_profile default_profile)
+-> Validation_profile
+{
+    const char *text = getenv("VIPU_VALIDATION");
+    if (text == nullptr)
+    {
+        return default_profile;
+    }
+
+    Validation_profile profile;
+    if (!parse_validation_profile(text, profile))
+    {
+        log_vulkan.warn("Ignoring unknown VIPU_VALIDATION profile {}, using {}\n", text, c_str(default_profile));
+        return default_profile;
+    }
+    return profile;
+}
+
+auto get_validation_feature_enables(Validation_profile profile)
+-> std::vector<vk::ValidationFeatureEnableEXT>
+{
+    switch (profile)
+    {
+        case Validation_profile::sync:
+        {
+            return {vk::ValidationFeatureEnableEXT::eSynchronizationValidation};
+        }
+
+        case Validation_profile::gpu_assisted:
+        {
+            // The validation layers reserve a descriptor set binding slot
+            // for their own use. The layer reports a value for
+            // VkPhysicalDeviceLimits::maxBoundDescriptorSets that is one less
+            // than the value reported by the device.
+            return {vk::ValidationFeatureEnableEXT::eGpuAssisted,
+                    vk::ValidationFeatureEnableEXT::eGpuAssistedReserveBindingSlot};
+        }
+
+        case Validation_profile::best_practices:
+        {
+            return {vk::ValidationFeatureEnableEXT::eBestPractices};
+        }
+
+        default:
+        {
+            return {};
+        }
+    }
+}
+
+auto needs_shader_stores_and_atomics(Validation_profile profile)
+-> bool
+{
+    return profile == Validation_profile::gpu_assisted;
+}
+
+} // namespace vipu
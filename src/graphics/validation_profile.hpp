@@ -0,0 +1,53 @@
+#ifndef validation_profile_hpp_vipu_graphics
+#define validation_profile_hpp_vipu_graphics
+
+#include <string_view>
+#include <vector>
+
+#include "graphics/vulkan.hpp"
+
+namespace vipu
+{
+
+// Selects validation layer and VK_EXT_validation_features settings.
+// With off, neither the validation layer nor the debug utils messenger are
+// loaded, and no device features are enabled for validation.
+enum class Validation_profile
+{
+    off = 0,
+    core,           // validation layer default checks
+    sync,           // core + synchronization validation
+    gpu_assisted,   // core + GPU-assisted validation, needs shader stores and atomics
+    best_practices  // core + best practices warnings
+};
+
+#if defined(NDEBUG)
+constexpr Validation_profile default_validation_profile{Validation_profile::off};
+#else
+constexpr Validation_profile default_validation_profile{Validation_profile::core};
+#endif
+
+constexpr const char *validation_layer_name{"VK_LAYER_KHRONOS_validation"};
+
+auto c_str(Validation_profile profile)
+-> const char *;
+
+// Returns false if text is not a profile name (off, core, sync, gpu-assisted,
+// best-practices).
+auto parse_validation_profile(std::string_view text, Validation_profile &profile)
+-> bool;
+
+// Environment variable VIPU_VALIDATION overrides default_profile
+auto get_validation_profile(Validation_profile default_profile = default_validation_profile)
+-> Validation_profile;
+
+auto get_validation_feature_enables(Validation_profile profile)
+-> std::vector<vk::ValidationFeatureEnableEXT>;
+
+// GPU-assisted validation instruments shaders with stores and atomics
+auto needs_shader_stores_and_atomics(Validation_profile profile)
+-> bool;
+
+} // namespace vipu
+
+#endif // validation_profile_hpp_vipu_graphics
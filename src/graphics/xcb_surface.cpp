@@ -7,14 +7,18 @@
 namespace vipu
 {
 
+XCB_surface::XCB_surface()
+{
+    xcb_init_connection();
+    xcb_create_window_();
+}
+
 XCB_surface::XCB_surface(Context &context)
+    : XCB_surface()
 {
     Expects(context.vk_instance);
     Expects(context.vk_physical_device);
 
-    xcb_init_connection();
-    xcb_create_window_();
-
     create_xcb_surface(context);
 }
 
@@ -67,10 +71,11 @@ void XCB_surface::xcb_create_window_()
                       value_mask,
                       value_list);
 
-    // Magic code that will send notification when window is destroyed
+    // Magic code that will send notification when window is destroyed.
+    // Both requests are sent before waiting, for one round trip instead of two.
     xcb_intern_atom_cookie_t  cookie  = xcb_intern_atom(m_xcb_connection, 1, 12, "WM_PROTOCOLS");
-    xcb_intern_atom_reply_t  *reply   = xcb_intern_atom_reply(m_xcb_connection, cookie, 0);
     xcb_intern_atom_cookie_t  cookie2 = xcb_intern_atom(m_xcb_connection, 0, 16, "WM_DELETE_WINDOW");
+    xcb_intern_atom_reply_t  *reply   = xcb_intern_atom_reply(m_xcb_connection, cookie, 0);
     m_xcb_delete_window_wm_atom = xcb_intern_atom_reply(m_xcb_connection, cookie2, 0);
 
     xcb_change_property(m_xcb_connection, XCB_PROP_MODE_REPLACE, m_xcb_window, (*reply).atom, 4, 32, 1, &(*m_xcb_delete_window_wm_atom).atom);
@@ -84,6 +89,9 @@ void XCB_surface::xcb_create_window_()
     // runs
     const uint32_t coords[] = { 100, 100 };
     xcb_configure_window(m_xcb_connection, m_xcb_window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, coords);
+
+    // Let the server map the window while Vulkan is being initialized
+    xcb_flush(m_xcb_connection);
 }
 
 void XCB_surface::create_xcb_surface(Context &context)
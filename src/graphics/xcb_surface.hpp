@@ -10,15 +10,19 @@ class XCB_surface
     : public Surface
 {
 public:
+    // Connects to X server and creates window. Does not use Vulkan, so this
+    // can run while the instance is being created.
+    XCB_surface();
+
     XCB_surface(Context &context);
 
+    void create_xcb_surface(Context &context);
+
 private:
     void xcb_init_connection();
 
     void xcb_create_window_();
 
-    void create_xcb_surface(Context &context);
-
     void xcb_handle_event(Context &context, const xcb_generic_event_t *event);
 
     void xcb_run(Context &context);
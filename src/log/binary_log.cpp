@@ -0,0 +1,290 @@
+#include "log/binary_log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#if defined _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+namespace vipu
+{
+
+std::atomic<uint8_t *> Binary_log::s_base{nullptr};
+
+namespace
+{
+
+constexpr size_t entry_alignment{8};
+constexpr size_t site_cache_size{64};
+
+struct Site_key
+{
+    const char *category{nullptr};
+    const char *format  {nullptr};
+    size_t      format_length{0};
+
+    auto operator<(const Site_key &other) const
+    -> bool
+    {
+        return std::tie(category, format, format_length) < std::tie(other.category, other.format, other.format_length);
+    }
+};
+
+struct Site_cache_entry
+{
+    Site_key key;
+    uint32_t site_id{0};
+    uint64_t generation{0};
+};
+
+size_t                             s_capacity{0};
+std::atomic<size_t>                s_offset  {0};
+std::atomic<uint64_t>              s_dropped {0};
+std::atomic<uint64_t>              s_generation{0};
+uint64_t                           s_steady_time_ns{0};
+int                                s_fd{-1};
+std::mutex                         s_site_mutex;
+std::map<Site_key, uint32_t>       s_sites;
+
+thread_local std::array<Site_cache_entry, site_cache_size> t_site_cache;
+
+auto steady_time_ns()
+-> uint64_t
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count()
+    );
+}
+
+} // anonymous namespace
+
+#if defined _WIN32
+
+auto Binary_log::open(const char *path, size_t capacity)
+-> bool
+{
+    // Not implemented, callers fall back to formatted text logging
+    static_cast<void>(path);
+    static_cast<void>(capacity);
+    return false;
+}
+
+void Binary_log::close()
+{
+}
+
+void Binary_log::flush()
+{
+}
+
+auto Binary_log::get_thread_id()
+-> uint32_t
+{
+    return static_cast<uint32_t>(GetCurrentThreadId());
+}
+
+#else
+
+auto Binary_log::open(const char *path, size_t capacity)
+-> bool
+{
+    if (is_open())
+    {
+        return false;
+    }
+
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(capacity)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    s_fd             = fd;
+    s_capacity       = capacity;
+    s_steady_time_ns = steady_time_ns();
+    s_dropped.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(s_site_mutex);
+        s_sites.clear();
+    }
+    // Invalidates thread local site caches from previous open
+    s_generation.fetch_add(1, std::memory_order_relaxed);
+
+    File_header header{};
+    header.magic          = magic;
+    header.version        = version;
+    header.header_size    = static_cast<uint32_t>((sizeof(File_header) + entry_alignment - 1) & ~(entry_alignment - 1));
+    header.steady_time_ns = s_steady_time_ns;
+    header.system_time_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count()
+    );
+    header.capacity       = capacity;
+    memcpy(base, &header, sizeof(header));
+
+    s_offset.store(header.header_size, std::memory_order_relaxed);
+    s_base.store(static_cast<uint8_t *>(base), std::memory_order_release);
+    return true;
+}
+
+void Binary_log::close()
+{
+    uint8_t *base = s_base.exchange(nullptr, std::memory_order_acq_rel);
+    if (base == nullptr)
+    {
+        return;
+    }
+
+    size_t used = std::min(s_offset.load(std::memory_order_acquire), s_capacity);
+    msync(base, s_capacity, MS_SYNC);
+    munmap(base, s_capacity);
+    if (ftruncate(s_fd, static_cast<off_t>(used)) != 0)
+    {
+        // Keeping the full size is harmless, decoder stops at zero size entry
+    }
+    ::close(s_fd);
+    s_fd = -1;
+}
+
+void Binary_log::flush()
+{
+    uint8_t *base = s_base.load(std::memory_order_acquire);
+    if (base != nullptr)
+    {
+        msync(base, s_capacity, MS_ASYNC);
+    }
+}
+
+auto Binary_log::get_thread_id()
+-> uint32_t
+{
+    thread_local uint32_t thread_id = static_cast<uint32_t>(syscall(SYS_gettid));
+    return thread_id;
+}
+
+#endif
+
+auto Binary_log::get_dropped_count()
+-> uint64_t
+{
+    return s_dropped.load(std::memory_order_relaxed);
+}
+
+auto Binary_log::reserve(size_t &size)
+-> uint8_t *
+{
+    uint8_t *base = s_base.load(std::memory_order_acquire);
+    if (base == nullptr)
+    {
+        return nullptr;
+    }
+
+    size = (size + entry_alignment - 1) & ~(entry_alignment - 1);
+    size_t offset = s_offset.fetch_add(size, std::memory_order_relaxed);
+    if (offset + size > s_capacity)
+    {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return base + offset;
+}
+
+void Binary_log::commit(uint8_t *entry, size_t size, Entry_type type, int level)
+{
+    auto *header  = reinterpret_cast<Entry_header *>(entry);
+    header->type  = static_cast<uint16_t>(type);
+    header->level = static_cast<uint16_t>(level);
+
+    // Size is published last; decoder treats zero size as end of data
+    std::atomic_ref<uint32_t> entry_size{header->size};
+    entry_size.store(static_cast<uint32_t>(size), std::memory_order_release);
+}
+
+auto Binary_log::get_site_id(const char *category, fmt::string_view format)
+-> uint32_t
+{
+    const Site_key key{category, format.data(), format.size()};
+    const uint64_t generation = s_generation.load(std::memory_order_relaxed);
+
+    auto  hash   = (reinterpret_cast<uintptr_t>(key.format) >> 3) ^ (reinterpret_cast<uintptr_t>(key.category) >> 5);
+    auto &cached = t_site_cache[hash % site_cache_size];
+    if ((cached.generation == generation) &&
+        (cached.key.format == key.format) &&
+        (cached.key.category == key.category) &&
+        (cached.key.format_length == key.format_length))
+    {
+        return cached.site_id;
+    }
+
+    uint32_t site_id;
+    {
+        std::lock_guard<std::mutex> lock(s_site_mutex);
+        auto i = s_sites.find(key);
+        if (i != s_sites.end())
+        {
+            site_id = i->second;
+        }
+        else
+        {
+            site_id = static_cast<uint32_t>(s_sites.size());
+            s_sites.emplace(key, site_id);
+
+            // Written while holding the lock, so that the site entry
+            // precedes any record entry using it
+            const size_t category_length = strlen(category);
+            size_t size = sizeof(Entry_header) + sizeof(Site_entry) + category_length + format.size();
+            uint8_t *entry = reserve(size);
+            if (entry != nullptr)
+            {
+                Site_entry site{site_id,
+                                static_cast<uint32_t>(category_length),
+                                static_cast<uint32_t>(format.size()),
+                                0};
+                uint8_t *p = entry + sizeof(Entry_header);
+                memcpy(p, &site, sizeof(site));
+                p += sizeof(site);
+                memcpy(p, category, category_length);
+                p += category_length;
+                memcpy(p, format.data(), format.size());
+                commit(entry, size, Entry_type::site, 0);
+            }
+        }
+    }
+
+    cached.key        = key;
+    cached.site_id    = site_id;
+    cached.generation = generation;
+    return site_id;
+}
+
+auto Binary_log::get_timestamp_ns()
+-> uint64_t
+{
+    return steady_time_ns() - s_steady_time_ns;
+}
+
+} // namespace vipu
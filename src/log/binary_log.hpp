@@ -0,0 +1,250 @@
+#ifndef binary_log_hpp_vipu_log
+#define binary_log_hpp_vipu_log
+
+#include "fmt/format.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace vipu
+{
+
+// Deferred formatting log. Instead of formatting text, each call appends the
+// call site ID, timestamp, thread ID and raw argument values to a memory
+// mapped file. The log_decode tool formats the text afterwards.
+//
+// File layout: File_header, followed by entries. Each entry starts with an
+// Entry_header, and is padded to 8 bytes. A zero size marks the end of data.
+// A site entry (Site_entry, category name, format string) is written the
+// first time a call site is seen. A record entry (Record_entry) is followed
+// by one Argument_type tag and payload per argument.
+class Binary_log
+{
+public:
+    static constexpr uint64_t magic  {0x474f4c4255504956ull}; // "VIPUBLOG"
+    static constexpr uint32_t version{1};
+
+    enum class Entry_type : uint16_t
+    {
+        site   = 1,
+        record = 2
+    };
+
+    enum class Argument_type : uint8_t
+    {
+        i64       = 1, // int64_t
+        u64       = 2, // uint64_t
+        f64       = 3, // double
+        boolean   = 4, // uint8_t
+        character = 5, // char
+        string    = 6, // uint32_t length, followed by bytes
+        pointer   = 7  // uint64_t
+    };
+
+    struct File_header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t steady_time_ns;  // steady clock at open, timestamps are relative to this
+        uint64_t system_time_ns;  // wall clock at open
+        uint64_t capacity;
+    };
+
+    struct Entry_header
+    {
+        uint32_t size;            // including this header and padding, written last
+        uint16_t type;
+        uint16_t level;
+    };
+
+    struct Site_entry
+    {
+        uint32_t site_id;
+        uint32_t category_length;
+        uint32_t format_length;
+        uint32_t reserved;
+    };
+
+    struct Record_entry
+    {
+        uint32_t site_id;
+        uint32_t thread_id;
+        uint64_t timestamp_ns;
+    };
+
+    // Creates the file and maps capacity bytes of it. Records which do not
+    // fit are dropped and counted.
+    static auto open(const char *path, size_t capacity)
+    -> bool;
+
+    // Truncates the file to used size and unmaps it.
+    // Must not be called while other threads are logging.
+    static void close();
+
+    // Schedules write back of the mapped pages.
+    static void flush();
+
+    static auto is_open()
+    -> bool
+    {
+        return s_base.load(std::memory_order_acquire) != nullptr;
+    }
+
+    static auto get_dropped_count()
+    -> uint64_t;
+
+    template <typename... Args>
+    static void write(const char *category, int level, fmt::string_view format, const Args & ... args)
+    {
+        const std::array<Argument, sizeof...(Args)> arguments{make_argument(args)...};
+
+        // Before reserve(), so that the site entry is written first
+        const uint32_t site_id = get_site_id(category, format);
+
+        size_t size = sizeof(Entry_header) + sizeof(Record_entry);
+        for (const auto &argument : arguments)
+        {
+            size += argument.encoded_size();
+        }
+
+        uint8_t *entry = reserve(size);
+        if (entry == nullptr)
+        {
+            return;
+        }
+
+        Record_entry record{site_id, get_thread_id(), get_timestamp_ns()};
+        uint8_t *p = entry + sizeof(Entry_header);
+        memcpy(p, &record, sizeof(record));
+        p += sizeof(record);
+        for (const auto &argument : arguments)
+        {
+            p = argument.encode(p);
+        }
+
+        commit(entry, size, Entry_type::record, level);
+    }
+
+private:
+    struct Argument
+    {
+        Argument_type type{Argument_type::i64};
+        union
+        {
+            int64_t  i64;
+            uint64_t u64;
+            double   f64;
+        } value{0};
+        std::string_view string;
+        std::string      owned;   // for types which are formatted eagerly
+
+        auto text() const
+        -> std::string_view
+        {
+            return owned.empty() ? string : std::string_view{owned};
+        }
+
+        auto encoded_size() const
+        -> size_t
+        {
+            return (type == Argument_type::string) ? 1 + sizeof(uint32_t) + text().size()
+                                                   : 1 + sizeof(uint64_t);
+        }
+
+        auto encode(uint8_t *p) const
+        -> uint8_t *
+        {
+            *p++ = static_cast<uint8_t>(type);
+            if (type == Argument_type::string)
+            {
+                std::string_view bytes = text();
+                auto length = static_cast<uint32_t>(bytes.size());
+                memcpy(p, &length, sizeof(length));
+                p += sizeof(length);
+                memcpy(p, bytes.data(), bytes.size());
+                return p + bytes.size();
+            }
+            memcpy(p, &value, sizeof(uint64_t));
+            return p + sizeof(uint64_t);
+        }
+    };
+
+    template <typename T>
+    static auto make_argument(const T &value)
+    -> Argument
+    {
+        Argument argument;
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            argument.type      = Argument_type::boolean;
+            argument.value.u64 = value ? 1 : 0;
+        }
+        else if constexpr (std::is_same_v<T, char>)
+        {
+            argument.type      = Argument_type::character;
+            argument.value.u64 = static_cast<unsigned char>(value);
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            argument.type      = Argument_type::i64;
+            argument.value.i64 = value;
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            argument.type      = Argument_type::u64;
+            argument.value.u64 = value;
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            argument.type      = Argument_type::f64;
+            argument.value.f64 = static_cast<double>(value);
+        }
+        else if constexpr (std::is_same_v<std::decay_t<T>, const char *> || std::is_same_v<std::decay_t<T>, char *>)
+        {
+            argument.type   = Argument_type::string;
+            argument.string = (value != nullptr) ? std::string_view{value} : std::string_view{};
+        }
+        else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        {
+            argument.type   = Argument_type::string;
+            argument.string = value;
+        }
+        else if constexpr (std::is_pointer_v<T>)
+        {
+            argument.type      = Argument_type::pointer;
+            argument.value.u64 = reinterpret_cast<uintptr_t>(value);
+        }
+        else
+        {
+            argument.type  = Argument_type::string;
+            argument.owned = fmt::format("{}", value);
+        }
+        return argument;
+    }
+
+    static auto reserve(size_t &size)
+    -> uint8_t *;
+
+    static void commit(uint8_t *entry, size_t size, Entry_type type, int level);
+
+    static auto get_site_id(const char *category, fmt::string_view format)
+    -> uint32_t;
+
+    static auto get_thread_id()
+    -> uint32_t;
+
+    static auto get_timestamp_ns()
+    -> uint64_t;
+
+    static std::atomic<uint8_t *> s_base;
+};
+
+} // namespace vipu
+
+#endif // binary_log_hpp_vipu_log
@@ -0,0 +1,420 @@
+#include "log/flight_recorder.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+
+#if defined _WIN32
+#    include <windows.h>
+#    include <io.h>
+#    include <fcntl.h>
+#else
+#    include <fcntl.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+namespace vipu
+{
+
+namespace
+{
+
+constexpr size_t max_dump_rings{64};
+constexpr size_t max_path_size {256};
+
+// Copied out of the ring by the dump, and checked against the sequence
+// afterwards
+struct Entry_data
+{
+    uint64_t                                     timestamp_ns{0};
+    uint64_t                                     frame_number{0};
+    uint32_t                                     thread_id{0};
+    Flight_recorder::Event                       event{Flight_recorder::Event::log};
+    uint8_t                                      level{0};
+    uint16_t                                     length{0};
+    std::array<char, Flight_recorder::text_size> text;
+};
+
+struct Entry
+{
+    std::atomic<uint64_t> sequence{0}; // index + 1 when complete, 0 while written
+    Entry_data            data;
+};
+
+struct Thread_ring
+{
+    std::array<Entry, Flight_recorder::ring_size> entries;
+    std::atomic<uint64_t>                         write_index{0};
+    std::atomic<bool>                             in_use     {true};
+    Thread_ring                                  *next       {nullptr};
+};
+
+// Rings are never freed. A ring is handed to a new thread when the thread
+// which owned it exits, so the number of rings is bounded by the peak
+// number of threads.
+std::atomic<Thread_ring *> s_rings       {nullptr};
+std::atomic<uint64_t>      s_frame_number{0};
+std::atomic<bool>          s_fatal_dumped{false};
+char                       s_dump_path[max_path_size] = "flight_recorder.txt";
+
+struct Ring_owner
+{
+    Thread_ring *ring{nullptr};
+
+    ~Ring_owner()
+    {
+        if (ring != nullptr)
+        {
+            ring->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local Ring_owner t_ring_owner;
+
+auto get_thread_id()
+-> uint32_t
+{
+#if defined _WIN32
+    return static_cast<uint32_t>(GetCurrentThreadId());
+#else
+    thread_local uint32_t thread_id = static_cast<uint32_t>(syscall(SYS_gettid));
+    return thread_id;
+#endif
+}
+
+auto get_ring()
+-> Thread_ring *
+{
+    if (t_ring_owner.ring != nullptr)
+    {
+        return t_ring_owner.ring;
+    }
+
+    for (Thread_ring *ring = s_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        bool in_use{false};
+        if (ring->in_use.compare_exchange_strong(in_use, true, std::memory_order_acq_rel))
+        {
+            t_ring_owner.ring = ring;
+            return ring;
+        }
+    }
+
+    auto *ring = new Thread_ring;
+    ring->next = s_rings.load(std::memory_order_relaxed);
+    while (!s_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    t_ring_owner.ring = ring;
+    return ring;
+}
+
+void record(Flight_recorder::Event event, int level, uint64_t frame_number, std::string_view text)
+{
+    Thread_ring *ring  = get_ring();
+    uint64_t     index = ring->write_index.load(std::memory_order_relaxed);
+    Entry       &entry = ring->entries[index % Flight_recorder::ring_size];
+    Entry_data  &data  = entry.data;
+
+    // Sequence lock; the dump skips entries which are being overwritten.
+    // The fence keeps the data writes below after the 0 store.
+    entry.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    data.timestamp_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count()
+    );
+    data.frame_number = frame_number;
+    data.thread_id    = get_thread_id();
+    data.event        = event;
+    data.level        = static_cast<uint8_t>(level);
+    data.length       = static_cast<uint16_t>(std::min(text.size(), data.text.size()));
+    if (data.length > 0)
+    {
+        memcpy(data.text.data(), text.data(), data.length);
+    }
+
+    entry.sequence.store(index + 1, std::memory_order_release);
+    ring->write_index.store(index + 1, std::memory_order_release);
+}
+
+auto event_name(Flight_recorder::Event event)
+-> const char *
+{
+    switch (event)
+    {
+        case Flight_recorder::Event::log:         return "log";
+        case Flight_recorder::Event::begin_frame: return "begin_frame";
+        case Flight_recorder::Event::acquire:     return "acquire";
+        case Flight_recorder::Event::submit:      return "submit";
+        case Flight_recorder::Event::present:     return "present";
+        case Flight_recorder::Event::end_frame:   return "end_frame";
+        default:                                  return "?";
+    }
+}
+
+// Minimal line formatting which does not allocate, for use in signal handlers
+class Line
+{
+public:
+    void append(const char *text, size_t length)
+    {
+        length = std::min(length, m_buffer.size() - m_size);
+        memcpy(m_buffer.data() + m_size, text, length);
+        m_size += length;
+    }
+
+    void append(const char *text)
+    {
+        append(text, strlen(text));
+    }
+
+    void append(uint64_t value, size_t width = 0)
+    {
+        char   digits[20];
+        size_t count{0};
+        do
+        {
+            digits[count++] = static_cast<char>('0' + (value % 10));
+            value /= 10;
+        }
+        while (value != 0);
+        while (width-- > count)
+        {
+            append(" ", 1);
+        }
+        while (count > 0)
+        {
+            append(&digits[--count], 1);
+        }
+    }
+
+    void write(int fd)
+    {
+        size_t offset{0};
+        while (offset < m_size)
+        {
+#if defined _WIN32
+            auto written = _write(fd, m_buffer.data() + offset, static_cast<unsigned int>(m_size - offset));
+#else
+            auto written = ::write(fd, m_buffer.data() + offset, m_size - offset);
+#endif
+            if (written <= 0)
+            {
+                break;
+            }
+            offset += static_cast<size_t>(written);
+        }
+        m_size = 0;
+    }
+
+private:
+    std::array<char, 256> m_buffer;
+    size_t                m_size{0};
+};
+
+// Copies entry at index. Returns false if it is being written, or was
+// overwritten before or during the copy.
+auto read_entry(const Entry &entry, uint64_t index, Entry_data &data)
+-> bool
+{
+    if (entry.sequence.load(std::memory_order_acquire) != index + 1)
+    {
+        return false;
+    }
+    data = entry.data;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry.sequence.load(std::memory_order_relaxed) == index + 1;
+}
+
+void write_entry(int fd, const Entry_data &entry, uint64_t base_ns)
+{
+    Line line;
+    const uint64_t ns = entry.timestamp_ns - base_ns;
+    line.append(ns / 1000000000u, 6);
+    line.append(".");
+    char fraction[9];
+    uint64_t remainder = ns % 1000000000u;
+    for (int i = 8; i >= 0; --i)
+    {
+        fraction[i] = static_cast<char>('0' + (remainder % 10));
+        remainder /= 10;
+    }
+    line.append(fraction, 6); // microseconds
+    line.append(" tid ");
+    line.append(entry.thread_id, 7);
+    line.append(" frame ");
+    line.append(entry.frame_number, 7);
+    line.append(" ");
+    if (entry.event == Flight_recorder::Event::log)
+    {
+        line.append("level ");
+        line.append(entry.level);
+        line.append(" ");
+        const char *text   = entry.text.data();
+        size_t      length = entry.length;
+        while ((length > 0) && (text[length - 1] == '\n'))
+        {
+            --length;
+        }
+        line.append(text, length);
+    }
+    else
+    {
+        line.append(event_name(entry.event));
+    }
+    line.append("\n");
+    line.write(fd);
+}
+
+void signal_handler(int signal_number)
+{
+#if !defined _WIN32
+    if (signal_number == SIGUSR1)
+    {
+        Flight_recorder::dump();
+        return;
+    }
+#endif
+
+    Flight_recorder::dump_fatal();
+
+    // Let the default action terminate the process
+    std::signal(signal_number, SIG_DFL);
+    std::raise(signal_number);
+}
+
+} // anonymous namespace
+
+void Flight_recorder::record_log(int level, std::string_view text)
+{
+    record(Event::log, level, s_frame_number.load(std::memory_order_relaxed), text);
+}
+
+void Flight_recorder::record_frame_event(Event event, uint64_t frame_number)
+{
+    if (event == Event::begin_frame)
+    {
+        s_frame_number.store(frame_number, std::memory_order_relaxed);
+    }
+    record(event, 0, frame_number, {});
+}
+
+void Flight_recorder::set_dump_path(const char *path)
+{
+    strncpy(s_dump_path, path, max_path_size - 1);
+    s_dump_path[max_path_size - 1] = '\0';
+}
+
+void Flight_recorder::install_signal_handlers()
+{
+    for (int signal_number : {SIGSEGV, SIGILL, SIGFPE, SIGABRT})
+    {
+        std::signal(signal_number, signal_handler);
+    }
+#if !defined _WIN32
+    std::signal(SIGBUS,  signal_handler);
+    std::signal(SIGUSR1, signal_handler);
+#endif
+}
+
+void Flight_recorder::dump()
+{
+#if defined _WIN32
+    int fd = _open(s_dump_path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    int fd = ::open(s_dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0)
+    {
+        return;
+    }
+
+    // Merge rings by timestamp. Cursors start at the oldest entry which has
+    // not been overwritten.
+    std::array<Thread_ring *, max_dump_rings> rings;
+    std::array<uint64_t, max_dump_rings>      cursors;
+    std::array<uint64_t, max_dump_rings>      ends;
+    std::array<Entry_data, max_dump_rings>    heads;       // copy of entry at cursor
+    std::array<bool, max_dump_rings>          head_valid{};
+    size_t                                    ring_count{0};
+    for (Thread_ring *ring = s_rings.load(std::memory_order_acquire);
+         (ring != nullptr) && (ring_count < max_dump_rings);
+         ring = ring->next)
+    {
+        uint64_t end = ring->write_index.load(std::memory_order_acquire);
+        rings  [ring_count] = ring;
+        ends   [ring_count] = end;
+        cursors[ring_count] = (end > ring_size) ? end - ring_size : 0;
+        ++ring_count;
+    }
+
+    Line header;
+    header.append("Flight recorder: ");
+    header.append(ring_count);
+    header.append(" threads, seconds since first entry\n");
+    header.write(fd);
+
+    uint64_t base_ns{0};
+    bool     have_base{false};
+    for (;;)
+    {
+        size_t   best{max_dump_rings};
+        uint64_t best_timestamp{0};
+        for (size_t i = 0; i < ring_count; ++i)
+        {
+            // Skip entries which are being written, or were overwritten
+            while (!head_valid[i] && (cursors[i] < ends[i]))
+            {
+                head_valid[i] = read_entry(rings[i]->entries[cursors[i] % ring_size], cursors[i], heads[i]);
+                if (!head_valid[i])
+                {
+                    ++cursors[i];
+                }
+            }
+            if (!head_valid[i])
+            {
+                continue;
+            }
+            if ((best == max_dump_rings) || (heads[i].timestamp_ns < best_timestamp))
+            {
+                best           = i;
+                best_timestamp = heads[i].timestamp_ns;
+            }
+        }
+        if (best == max_dump_rings)
+        {
+            break;
+        }
+        if (!have_base)
+        {
+            base_ns   = best_timestamp;
+            have_base = true;
+        }
+        write_entry(fd, heads[best], base_ns);
+        head_valid[best] = false;
+        ++cursors[best];
+    }
+
+#if defined _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+void Flight_recorder::dump_fatal()
+{
+    if (!s_fatal_dumped.exchange(true))
+    {
+        dump();
+    }
+}
+
+} // namespace vipu
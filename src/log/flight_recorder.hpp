@@ -0,0 +1,54 @@
+#ifndef flight_recorder_hpp_vipu_log
+#define flight_recorder_hpp_vipu_log
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace vipu
+{
+
+// Always-on in-memory record of the most recent log records and frame
+// events. Each thread writes to its own ring buffer without locks, and the
+// rings are merged by timestamp when dumped. Dumped by FATAL and VERIFY, and
+// by fatal signals once install_signal_handlers() has been called, so that
+// post-mortem context does not depend on the log file.
+class Flight_recorder
+{
+public:
+    static constexpr size_t ring_size{512};  // entries per thread
+    static constexpr size_t text_size{96};   // longer log records are truncated
+
+    enum class Event : uint8_t
+    {
+        log = 0,
+        begin_frame,
+        acquire,
+        submit,
+        present,
+        end_frame
+    };
+
+    static void record_log(int level, std::string_view text);
+
+    static void record_frame_event(Event event, uint64_t frame_number);
+
+    // Path is copied. Defaults to flight_recorder.txt.
+    static void set_dump_path(const char *path);
+
+    // Dumps on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, and then lets
+    // the signal terminate the process. SIGUSR1 dumps and continues.
+    static void install_signal_handlers();
+
+    // Writes all rings to the dump file. Only uses async signal safe calls.
+    static void dump();
+
+    // As dump(), but only the first call in the process dumps. Used by
+    // FATAL and fatal signals, so that FATAL followed by the trap signal
+    // dumps only once.
+    static void dump_fatal();
+};
+
+} // namespace vipu
+
+#endif // flight_recorder_hpp_vipu_log
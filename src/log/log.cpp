@@ -1,8 +1,15 @@
 #include "log.hpp"
+#include "log/mpsc_ring_buffer.hpp"
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 #if defined _WIN32
 #    include <windows.h>
@@ -13,14 +20,73 @@
 namespace vipu
 {
 
+namespace
+{
+
+FILE            *s_log_file{nullptr};
+bool             s_log_file_disabled{false};
+std::atomic<int> s_print_color{-1}; // -1 until detected
+
+// Path from environment variable VIPU_LOG_FILE, log.txt by default. Empty
+// or off disables the log file, so that production runs can rely on the
+// flight recorder alone.
+void open_log_file(const char *mode)
+{
+    if (s_log_file != nullptr)
+    {
+        fclose(s_log_file);
+        s_log_file = nullptr;
+    }
+    const char *path = getenv("VIPU_LOG_FILE");
+    if (path == nullptr)
+    {
+        path = "log.txt";
+    }
+    s_log_file_disabled = (path[0] == '\0') || (strcmp(path, "off") == 0);
+    if (!s_log_file_disabled)
+    {
+        s_log_file = fopen(path, mode);
+    }
+}
+
+auto text_color_escape(int c)
+-> const char *
+{
+    switch (c)
+    {
+        case Log::Color::DARK_BLUE:    return "\033[22;34m";
+        case Log::Color::DARK_GREEN:   return "\033[22;32m";
+        case Log::Color::DARK_RED:     return "\033[22;31m";
+        case Log::Color::DARK_CYAN:    return "\033[22;36m";
+        case Log::Color::DARK_MAGENTA: return "\033[22;35m";
+        case Log::Color::DARK_YELLOW:  return "\033[22;33m";
+        case Log::Color::BLUE:         return "\033[1;34m";
+        case Log::Color::GREEN:        return "\033[1;32m";
+        case Log::Color::RED:          return "\033[1;31m";
+        case Log::Color::CYAN:         return "\033[1;36m";
+        case Log::Color::MAGENTA:      return "\033[1;35m";
+        case Log::Color::YELLOW:       return "\033[1;33m";
+        case Log::Color::DARK_GREY:    return "\033[1;30m";
+        case Log::Color::GREY:         return "\033[22;37m";
+        case Log::Color::WHITE:        return "\033[1;37m";
+        default:                       return "";
+    }
+}
+
+} // anonymous namespace
 
 #if defined _WIN32
-auto Log::print_color()
+namespace
+{
+
+auto detect_print_color()
 -> bool
 {
     return true;
 }
 
+} // anonymous namespace
+
 void Log::set_text_color(int c)
 {
     HANDLE hConsoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -36,19 +102,24 @@ void Log::console_init()
     GetConsoleMode(hConsoleHandle, &mode);
     SetConsoleMode(hConsoleHandle, (mode & ~ENABLE_MOUSE_INPUT) | ENABLE_QUICK_EDIT_MODE | ENABLE_EXTENDED_FLAGS);
 
+    // Console output is colored with escape sequences embedded in the text
+    DWORD output_mode = 0;
+    if (GetConsoleMode(hConsoleHandle, &output_mode))
+    {
+        SetConsoleMode(hConsoleHandle, output_mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+
     SendMessage(hwnd, WM_SETICON, ICON_BIG, (LPARAM)(icon));
     SendMessage(hwnd, WM_SETICON, ICON_SMALL, (LPARAM)(icon));
 
-    FILE *l = fopen("log.txt", "wb");
-    if (l)
-    {
-        fprintf(l, "");
-        fclose(l);
-    }
+    open_log_file("wb");
 }
 #else
 
-auto Log::print_color()
+namespace
+{
+
+auto detect_print_color()
 -> bool
 {
 #    if defined(__APPLE__)
@@ -58,206 +129,540 @@ auto Log::print_color()
 # endif
 }
 
+} // anonymous namespace
+
 void Log::set_text_color(int c)
 {
 #    if defined(__APPLE__)
     (void)c;
 #    else
-    switch (c)
-    {
-        case Log::Color::DARK_BLUE:    fputs("\033[22;34m", stdout); break;
-        case Log::Color::DARK_GREEN:   fputs("\033[22;32m", stdout); break;
-        case Log::Color::DARK_RED:     fputs("\033[22;31m", stdout); break;
-        case Log::Color::DARK_CYAN:    fputs("\033[22;36m", stdout); break;
-        case Log::Color::DARK_MAGENTA: fputs("\033[22;35m", stdout); break;
-        case Log::Color::DARK_YELLOW:  fputs("\033[22;33m", stdout); break;
-        case Log::Color::BLUE:         fputs("\033[1;34m", stdout); break;
-        case Log::Color::GREEN:        fputs("\033[1;32m", stdout); break;
-        case Log::Color::RED:          fputs("\033[1;31m", stdout); break;
-        case Log::Color::CYAN:         fputs("\033[1;36m", stdout); break;
-        case Log::Color::MAGENTA:      fputs("\033[1;35m", stdout); break;
-        case Log::Color::YELLOW:       fputs("\033[1;33m", stdout); break;
-        case Log::Color::DARK_GREY:    fputs("\033[1;30m", stdout); break;
-        case Log::Color::GREY:         fputs("\033[22;37m", stdout); break;
-        case Log::Color::WHITE:        fputs("\033[1;37m", stdout); break;
-        default: break;
-    }
+    fputs(text_color_escape(c), stdout);
 #    endif
 }
 
 void Log::console_init()
 {
-    FILE *l = fopen("log.txt", "wb");
-    if (l != nullptr)
+    open_log_file("wb");
+}
+#endif
+
+auto Log::print_color()
+-> bool
+{
+    // isatty() is a system call; the answer does not change
+    int print_color = s_print_color.load(std::memory_order_relaxed);
+    if (print_color < 0)
     {
-        fclose(l);
+        print_color = detect_print_color() ? 1 : 0;
+        s_print_color.store(print_color, std::memory_order_relaxed);
     }
+    return print_color != 0;
+}
+
+void Log::set_print_color(bool enable)
+{
+    s_print_color.store(enable ? 1 : 0, std::memory_order_relaxed);
 }
-#endif
 
 int Log::s_indent{0};
 
-void Log::indent(int indent_amount)
+namespace
 {
-    s_indent += indent_amount;
+
+struct Record
+{
+    // Zero terminated. Short lines stay in the inline storage, so neither
+    // formatting nor passing the record to the writer thread allocates.
+    fmt::basic_memory_buffer<char, 256> text;
+
+    std::array<int, 2> color    {Log::Color::GRAY, Log::Color::GRAY};
+    Log::Colorizer     colorizer{Log::Colorizer::default_};
+    int                indent   {0};
+};
+
+auto log_file()
+-> FILE *
+{
+    if ((s_log_file == nullptr) && !s_log_file_disabled)
+    {
+        open_log_file("ab+");
+    }
+    return s_log_file;
 }
 
-void Log::Category::write(bool indent, int level, const char *format, fmt::format_args args)
+// Appends console output of record, including color escape sequences, so
+// that it can be written with a single write
+void append_console(fmt::memory_buffer &out, const Record &record)
 {
-    if (level < m_level)
+    for (int i = 0; i < record.indent; ++i)
+    {
+        out.push_back(' ');
+    }
+
+    if (!Log::print_color())
     {
         return;
     }
 
-    std::string text = fmt::vformat(format, args);
+    const auto append = [&out](const char *begin, size_t length)
+    {
+        out.append(begin, begin + length);
+    };
+    const auto set_color = [&out](int c)
+    {
+        const char *escape = text_color_escape(c);
+        out.append(escape, escape + strlen(escape));
+    };
+
+    const char *text = record.text.data();
+    const char *end  = text + strlen(text);
+    const char *p;
+    const char *span;
+    size_t span_len;
+    char c;
+    char next;
+    switch (record.colorizer)
+    {
+        case Log::Colorizer::default_:
+        {
+            set_color(record.color[0]);
+            p = span = text;
+            span_len = 0;
+            char prev = 0;
+            for (;;)
+            {
+                c = p[0];
+                next = (c != '\0') ? p[1] : '\0';
+                if (c == '(' || (c == ':' && next != ':' && prev != ':'))
+                {
+                    append(span, span_len + 1);
+                    prev = c;
+                    ++p;
+                    span = p;
+                    span_len = 0;
+                    set_color(record.color[1]);
+                }
+                else if (c == ')')
+                {
+                    if (span_len > 0)
+                    {
+                        append(span, span_len);
+                    }
+                    set_color(record.color[0]);
+                    span = p;
+                    ++p;
+                    span_len = 1;
+                }
+                else if (c == 0)
+                {
+                    append(span, static_cast<size_t>(end - span));
+                    set_color(record.color[1]);
+                    break;
+                }
+                else
+                {
+                    prev = c;
+                    ++p;
+                    ++span_len;
+                }
+            }
+            break;
+        }
+
+        case Log::Colorizer::glsl:
+        {
+            set_color(record.color[0]);
+            p = span = text;
+            span_len = 1;
+            for (;;)
+            {
+                c = *p;
+                p++;
+                if (c == ':')
+                {
+                    append(span, span_len);
+                    span = p;
+                    span_len = 1;
+                    set_color(record.color[1]);
+                }
+                else if (c == '\n')
+                {
+                    append(span, span_len);
+                    span = p;
+                    span_len = 1;
+                    set_color(record.color[0]);
+                }
+                else if (c == 0)
+                {
+                    append(span, static_cast<size_t>(end - span));
+                    set_color(record.color[1]);
+                    break;
+                }
+                else
+                {
+                    ++span_len;
+                }
+            }
+            break;
+        }
+
+        default:
+        {
+            FATAL("Bad log colorizer");
+        }
+    }
+    set_color(Log::Color::GRAY);
+}
 
-    write(indent, text);
+void write_console(fmt::memory_buffer &out)
+{
+    if (out.size() > 0)
+    {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+        out.clear();
+    }
 }
 
-void Log::Category::write(bool indent, int level, const std::string &text)
+// Writes to log file and debugger. Flushing the log file is left to the
+// caller, so that the async writer can flush once per batch.
+void write_file(const Record &record)
 {
-    if (level < m_level)
+    // Log to file
+    FILE *file = log_file();
+    if (file != nullptr)
     {
-        return;
+        fputs(record.text.data(), file);
     }
 
-    write(indent, text);
+    // Log to debugger
+#if defined(_WIN32)
+    OutputDebugStringA(record.text.data());
+#endif
 }
 
-void Log::Category::write(bool indent, const std::string &text)
+class Async_writer
 {
-    if (indent)
+public:
+    Async_writer(size_t capacity, Log::Overflow_policy overflow_policy)
+        : m_ring           {capacity}
+        , m_overflow_policy{overflow_policy}
+    {
+        m_thread = std::thread(&Async_writer::run, this);
+    }
+
+    ~Async_writer()
+    {
+        m_stop.store(true, std::memory_order_release);
+        wake();
+        m_thread.join();
+    }
+
+    void push(Record &&record)
     {
-        for (int i = 0; i < s_indent; ++i)
+        size_t position;
+        while (!m_ring.try_push(std::move(record), position))
+        {
+            if (m_overflow_policy == Log::Overflow_policy::drop)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wake();
+            std::this_thread::yield();
+        }
+
+        // Records are written in ring order, but pushes can complete out of
+        // order, so this is the end of the highest pushed position rather
+        // than a count.
+        const uint64_t end = position + 1;
+        uint64_t pushed = m_pushed.load(std::memory_order_relaxed);
+        while ((pushed < end) &&
+               !m_pushed.compare_exchange_weak(pushed, end, std::memory_order_release))
         {
-            putc(' ', stdout);
+        }
+
+        // Pairs with the fence in run(): either the writer sees the record,
+        // or this thread sees that the writer is about to sleep.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed))
+        {
+            wake();
         }
     }
 
-    // Log to console
-    if (print_color())
+    void flush()
     {
-        const char *p;
-        const char *span;
-        size_t span_len;
-        char c;
-        char next;
-        switch (m_colorizer)
+        // FATAL from within the writer thread must not wait for itself
+        if (std::this_thread::get_id() == m_thread.get_id())
+        {
+            return;
+        }
+
+        // m_written counts records in ring order, so reaching the end of the
+        // highest pushed position also covers records of this thread.
+        // The writer might be stuck; do not hang a terminating process forever
+        const uint64_t target   = m_pushed.load(std::memory_order_acquire);
+        const auto     deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (m_written.load(std::memory_order_acquire) < target)
         {
-            case Colorizer::default_:
+            if (std::chrono::steady_clock::now() > deadline)
             {
-                set_text_color(m_color[0]);
-                p = span = text.data();
-                span_len = 0;
-                char prev = 0;
-                for (;;)
-                {
-                    c = p[0];
-                    next = (c != '\0') ? p[1] : '\0';
-                    if (c == '(' || (c == ':' && next != ':' && prev != ':'))
-                    {
-                        fwrite(span, 1, span_len + 1, stdout);
-                        fflush(stdout);
-                        prev = c;
-                        ++p;
-                        ++span_len;
-                        span = p;
-                        span_len = 0;
-                        set_text_color(m_color[1]);
-                    }
-                    else if (c == ')')
-                    {
-                        if (span_len > 1)
-                        {
-                            fwrite(span, 1, span_len, stdout);
-                            fflush(stdout);
-                        }
-                        set_text_color(m_color[0]);
-                        span = p;
-                        ++p;
-                        span_len = 1;
-                        //fwrite(span, 1, span_len, stdout);
-                        //fflush(stdout);
-                        //++p;
-                        //c = *p;
-                    }
-                    else if (c == 0)
-                    {
-                        fputs(span, stdout);
-                        fflush(stdout);
-                        set_text_color(m_color[1]);
-                        break;
-                    }
-                    else
-                    {
-                        prev = c;
-                        ++p;
-                        ++span_len;
-                    }
-                }
                 break;
             }
+            wake();
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    void wake()
+    {
+        m_wake.fetch_add(1, std::memory_order_release);
+        m_wake.notify_one();
+    }
+
+    void run()
+    {
+        constexpr size_t batch_size{256};
+
+        Record   record;
+        uint64_t reported_dropped{0};
+        for (;;)
+        {
+            size_t count{0};
+            while ((count < batch_size) && m_ring.try_pop(record))
+            {
+                append_console(m_console_buffer, record);
+                write_file(record);
+                ++count;
+            }
+
+            const uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+            if (dropped != reported_dropped)
+            {
+                Record report;
+                fmt::format_to(std::back_inserter(report.text), "Log ring buffer full, dropped {} records\n", dropped - reported_dropped);
+                report.text.push_back('\0');
+                append_console(m_console_buffer, report);
+                write_file(report);
+                reported_dropped = dropped;
+            }
 
-            case Log::Colorizer::glsl:
+            // One console write per batch
+            write_console(m_console_buffer);
+
+            if (count > 0)
             {
-                set_text_color(m_color[0]);
-                p = span = text.data();
-                span_len = 1;
-                for (;;)
+                FILE *file = log_file();
+                if (file != nullptr)
                 {
-                    c = *p;
-                    p++;
-                    if (c == ':')
-                    {
-                        fwrite(span, 1, span_len, stdout);
-                        fflush(stdout);
-                        span = p;
-                        span_len = 1;
-                        set_text_color(m_color[1]);
-                    }
-                    else if (c == '\n')
-                    {
-                        fwrite(span, 1, span_len, stdout);
-                        fflush(stdout);
-                        span = p;
-                        span_len = 1;
-                        set_text_color(m_color[0]);
-                    }
-                    else if (c == 0)
-                    {
-                        fputs(span, stdout);
-                        fflush(stdout);
-                        set_text_color(m_color[1]);
-                        break;
-                    }
-                    else
-                    {
-                        ++span_len;
-                    }
+                    fflush(file);
                 }
+                m_written.fetch_add(count, std::memory_order_release);
+                continue;
+            }
+
+            if (m_stop.load(std::memory_order_acquire))
+            {
                 break;
             }
 
-            default:
+            const uint32_t wake_count = m_wake.load(std::memory_order_acquire);
+            m_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_ring.empty() && !m_stop.load(std::memory_order_acquire))
             {
-                FATAL("Bad log colorizer");
+                m_wake.wait(wake_count, std::memory_order_acquire);
             }
+            m_sleeping.store(false, std::memory_order_relaxed);
         }
-        set_text_color(Log::Color::GRAY);
     }
 
-    // Log to file
-    FILE *log_file = fopen("log.txt", "ab+");
-    if (log_file != nullptr)
+    Mpsc_ring_buffer<Record> m_ring;
+    fmt::memory_buffer       m_console_buffer;
+    Log::Overflow_policy     m_overflow_policy;
+    std::atomic<uint64_t>    m_pushed {0};    // end of highest pushed ring position
+    std::atomic<uint64_t>    m_written{0};    // records, in ring order
+    std::atomic<uint64_t>    m_dropped{0};
+    std::atomic<uint32_t>    m_wake   {0};
+    std::atomic<bool>        m_stop    {false};
+    std::atomic<bool>        m_sleeping{false};
+    std::thread              m_thread;
+};
+
+std::unique_ptr<Async_writer> s_async_writer;
+
+void submit(Record &&record)
+{
+    if (s_async_writer)
     {
-        fputs(text.data(), log_file);
-        fclose(log_file);
+        s_async_writer->push(std::move(record));
+        return;
     }
 
-    // Log to debugger
-#if defined(_WIN32)
-    OutputDebugStringA(text.c_str());
-#endif
+    thread_local fmt::memory_buffer t_console_buffer;
+    append_console(t_console_buffer, record);
+    write_console(t_console_buffer);
+    write_file(record);
+
+    FILE *file = log_file();
+    if (file != nullptr)
+    {
+        fflush(file);
+    }
+}
+
+} // anonymous namespace
+
+void Log::start_async(size_t capacity, Overflow_policy overflow_policy)
+{
+    if (s_async_writer)
+    {
+        return;
+    }
+    fflush(stdout);
+    s_async_writer = std::make_unique<Async_writer>(capacity, overflow_policy);
+}
+
+void Log::stop_async()
+{
+    s_async_writer.reset();
+}
+
+void Log::flush()
+{
+    if (s_async_writer)
+    {
+        s_async_writer->flush();
+    }
+    Binary_log::flush();
+    fflush(stdout);
+    FILE *file = s_log_file;
+    if (file != nullptr)
+    {
+        fflush(file);
+    }
+}
+
+void Log::fatal(std::string_view text)
+{
+    flush();
+    fwrite(text.data(), 1, text.size(), stdout);
+    fflush(stdout);
+    Flight_recorder::record_log(Level::LEVEL_FATAL, text);
+    Flight_recorder::dump_fatal();
+}
+
+void Log::indent(int indent_amount)
+{
+    s_indent += indent_amount;
+}
+
+auto Log::parse_level(std::string_view text)
+-> int
+{
+    if (text == "all")
+    {
+        return Level::LEVEL_ALL;
+    }
+    if (text == "trace")
+    {
+        return Level::LEVEL_TRACE;
+    }
+    if (text == "info")
+    {
+        return Level::LEVEL_INFO;
+    }
+    if (text == "warn")
+    {
+        return Level::LEVEL_WARN;
+    }
+    if (text == "error")
+    {
+        return Level::LEVEL_ERROR;
+    }
+    if (text == "fatal")
+    {
+        return Level::LEVEL_FATAL;
+    }
+    if ((text.size() == 1) && (text[0] >= '0') && (text[0] <= '5'))
+    {
+        return text[0] - '0';
+    }
+    return -1;
+}
+
+void Log::Category::apply_environment_level()
+{
+    const char *env = getenv("VIPU_LOG_LEVEL");
+    if (env == nullptr)
+    {
+        return;
+    }
+
+    // Comma separated list of either level, which applies to all
+    // categories, or name=level. Later entries override earlier ones.
+    std::string_view list{env};
+    while (!list.empty())
+    {
+        size_t           comma = list.find(',');
+        std::string_view entry = list.substr(0, comma);
+        list = (comma == std::string_view::npos) ? std::string_view{} : list.substr(comma + 1);
+
+        size_t           equals = entry.find('=');
+        std::string_view level_text{entry};
+        if (equals != std::string_view::npos)
+        {
+            if (entry.substr(0, equals) != m_name)
+            {
+                continue;
+            }
+            level_text = entry.substr(equals + 1);
+        }
+
+        int level = parse_level(level_text);
+        if (level >= 0)
+        {
+            set_level(level);
+        }
+    }
+}
+
+void Log::Category::write(bool indent, int level, fmt::string_view format, fmt::format_args args)
+{
+    if (!is_enabled(level))
+    {
+        return;
+    }
+
+    Record record;
+    fmt::vformat_to(std::back_inserter(record.text), format, args);
+    Flight_recorder::record_log(level, {record.text.data(), record.text.size()});
+    record.text.push_back('\0');
+    record.color     = m_color;
+    record.colorizer = m_colorizer;
+    record.indent    = indent ? s_indent : 0;
+
+    submit(std::move(record));
+}
+
+void Log::Category::write(bool indent, int level, std::string_view text)
+{
+    if (!is_enabled(level))
+    {
+        return;
+    }
+
+    Record record;
+    record.text.append(text.data(), text.data() + text.size());
+    Flight_recorder::record_log(level, text);
+    record.text.push_back('\0');
+    record.color     = m_color;
+    record.colorizer = m_colorizer;
+    record.indent    = indent ? s_indent : 0;
+
+    submit(std::move(record));
 }
 
 } // namespace vipu::log
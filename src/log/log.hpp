@@ -2,8 +2,24 @@
 #define log_hpp_vipu_log
 
 #include "fmt/format.h"
+#include "log/binary_log.hpp"
+#include "log/flight_recorder.hpp"
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
 #include <string>
+#include <string_view>
+
+// Log calls below this level are compiled out. Defaults to LEVEL_INFO for
+// release builds, so that trace calls cost nothing there.
+#if !defined(VIPU_LOG_MIN_LEVEL)
+#   if defined(NDEBUG)
+#       define VIPU_LOG_MIN_LEVEL 2
+#   else
+#       define VIPU_LOG_MIN_LEVEL 0
+#   endif
+#endif
 
 #if _MSC_VER
 
@@ -22,12 +38,12 @@
 #   include <windows.h>
 #endif
 
-#define FATAL(format, ...) do { fmt::print("{}:{} " format, __FILE__, __LINE__, ##__VA_ARGS__); DebugBreak(); abort(); } while (1)
+#define FATAL(text, ...) do { vipu::Log::fatal(fmt::format("{}:{} " text, __FILE__, __LINE__, ##__VA_ARGS__)); DebugBreak(); abort(); } while (1)
 #define VERIFY(expression) do { if (!(expression)) { FATAL("assert {} failed in {}", #expression, __func__); } } while (0)
 
 #else
 
-#define FATAL(format, ...) do { fmt::print("{}:{} " format, __FILE__, __LINE__, ##__VA_ARGS__); __builtin_trap(); __builtin_unreachable(); } while (1)
+#define FATAL(text, ...) do { vipu::Log::fatal(fmt::format("{}:{} " text, __FILE__, __LINE__, ##__VA_ARGS__)); __builtin_trap(); __builtin_unreachable(); } while (1)
 #define VERIFY(expression) do { if (!(expression)) { FATAL("assert {} failed in {}", #expression, __func__); } } while (0)
 
 #endif
@@ -43,6 +59,13 @@ struct Log
         glsl     = 1
     };
 
+    // What to do when the async log ring buffer is full
+    enum class Overflow_policy
+    {
+        drop  = 0, // discard the record, and report number of dropped records later
+        block = 1  // wait for the writer thread to make room
+    };
+
     struct Level
     {
         static constexpr int LEVEL_ALL  {0};
@@ -76,90 +99,205 @@ struct Log
 
     static int s_indent;
 
+    // Whether stdout is a terminal. Detected once, and cached.
     static bool print_color();
 
+    // Overrides terminal detection
+    static void set_print_color(bool enable);
+
     static void indent(int indent_amount);
 
     static void set_text_color(int c);
 
+    // Also opens log.txt, or the file named by environment variable
+    // VIPU_LOG_FILE. VIPU_LOG_FILE=off disables file logging.
     static void console_init();
 
+    // Moves console and file output to a background writer thread.
+    // Callers only format the text and push it to a lock-free ring buffer.
+    // Must not be called while other threads are logging.
+    static void start_async(size_t capacity = 4096, Overflow_policy overflow_policy = Overflow_policy::block);
+
+    // Drains pending records and joins the writer thread.
+    // Must not be called while other threads are logging.
+    static void stop_async();
+
+    // Waits until all records logged so far have been written out.
+    // Used by FATAL before terminating.
+    static void flush();
+
+    // Used by FATAL: flushes the log, prints text, and dumps the flight
+    // recorder. Caller terminates the process.
+    static void fatal(std::string_view text);
+
+    // Minimum level which is compiled in at all. Calls below it compile to
+    // nothing, although their arguments are still evaluated by the caller.
+    static constexpr int min_level{VIPU_LOG_MIN_LEVEL};
+
+    // Parses level name (all, trace, info, warn, error, fatal) or number.
+    // Returns -1 if text is not a valid level.
+    static auto parse_level(std::string_view text)
+    -> int;
+
     struct Category
     {
-        Category(int color0, int color1, int level, Colorizer colorizer = Colorizer::default_) noexcept
-            : m_color    {color0, color1}
+        // Initial level can be overridden at runtime with environment
+        // variable VIPU_LOG_LEVEL, for example VIPU_LOG_LEVEL=warn or
+        // VIPU_LOG_LEVEL=vulkan=warn,shader=trace
+        Category(const char *name, int color0, int color1, int level, Colorizer colorizer = Colorizer::default_) noexcept
+            : m_name     {name}
+            , m_color    {color0, color1}
             , m_level    {level}
             , m_colorizer(colorizer)
         {
+            apply_environment_level();
         }
 
-        void write(bool indent, int level, const char *format, fmt::format_args args);
+        Category(const Category &) = delete;
+        auto operator=(const Category &) -> Category & = delete;
 
-        void write(bool indent, int level, const std::string &text);
+        auto get_name() const
+        -> const char *
+        {
+            return m_name;
+        }
 
-        template <typename... Args>
-        void log(int /*level*/  , const char *format, const Args & ... args)
+        void set_level(int level)
         {
-            write(true, format, fmt::make_format_args(args...));
+            m_level.store(level, std::memory_order_relaxed);
         }
 
-        template <typename... Args>
-        void log_ni(int level, const char *format, const Args & ... args)
+        auto get_level() const
+        -> int
         {
-            write(false, level, format, fmt::make_format_args(args...));
+            return m_level.load(std::memory_order_relaxed);
         }
 
-        template <typename... Args>
-        void trace(const char *format, const Args & ... args)
+        // When set and Binary_log is open, records go to the binary log
+        // unformatted instead of console and log file.
+        void set_binary(bool enable)
         {
-            write(true, Level::LEVEL_TRACE, format, fmt::make_format_args(args...));
+            m_binary = enable;
         }
 
-        void trace(const std::string &text)
+        auto is_enabled(int level) const
+        -> bool
         {
-            write(true, Level::LEVEL_TRACE, text);
+            return (level >= min_level) && (level >= m_level.load(std::memory_order_relaxed));
         }
 
+        void write(bool indent, int level, fmt::string_view format, fmt::format_args args);
+
+        void write(bool indent, int level, std::string_view text);
+
         template <typename... Args>
-        void info(const char *format, const Args & ... args)
+        void log(int level, fmt::format_string<Args...> format, Args && ... args)
+        {
+            if (is_enabled(level))
+            {
+                dispatch(true, level, format, args...);
+            }
+        }
+
+        // Writes text as is, without formatting, for text which is not a
+        // format string, such as compiler output
+        void write_text(int level, std::string_view text)
         {
-            write(true, Level::LEVEL_INFO, format, fmt::make_format_args(args...));
+            if (is_enabled(level))
+            {
+                dispatch(true, level, text);
+            }
         }
 
-        void info(const std::string &text)
+        template <typename... Args>
+        void log_ni(int level, fmt::format_string<Args...> format, Args && ... args)
         {
-            write(true, Level::LEVEL_INFO, text);
+            if (is_enabled(level))
+            {
+                dispatch(false, level, format, args...);
+            }
         }
 
         template <typename... Args>
-        void warn(const char *format, const Args & ... args)
+        void trace(fmt::format_string<Args...> format, Args && ... args)
         {
-            write(true, Level::LEVEL_WARN, format, fmt::make_format_args(args...));
+            if constexpr (Level::LEVEL_TRACE >= min_level)
+            {
+                if (is_enabled(Level::LEVEL_TRACE))
+                {
+                    dispatch(true, Level::LEVEL_TRACE, format, args...);
+                }
+            }
         }
 
-        void warn(const std::string &text)
+        template <typename... Args>
+        void info(fmt::format_string<Args...> format, Args && ... args)
         {
-            write(true, Level::LEVEL_WARN, text);
+            if constexpr (Level::LEVEL_INFO >= min_level)
+            {
+                if (is_enabled(Level::LEVEL_INFO))
+                {
+                    dispatch(true, Level::LEVEL_INFO, format, args...);
+                }
+            }
         }
 
         template <typename... Args>
-        void error(const char *format, const Args & ... args)
+        void warn(fmt::format_string<Args...> format, Args && ... args)
         {
-            write(true, Level::LEVEL_ERROR, format, fmt::make_format_args(args...));
+            if constexpr (Level::LEVEL_WARN >= min_level)
+            {
+                if (is_enabled(Level::LEVEL_WARN))
+                {
+                    dispatch(true, Level::LEVEL_WARN, format, args...);
+                }
+            }
         }
 
-        void error(const std::string &text)
+        template <typename... Args>
+        void error(fmt::format_string<Args...> format, Args && ... args)
         {
-            write(true, Level::LEVEL_ERROR, text);
+            if constexpr (Level::LEVEL_ERROR >= min_level)
+            {
+                if (is_enabled(Level::LEVEL_ERROR))
+                {
+                    dispatch(true, Level::LEVEL_ERROR, format, args...);
+                }
+            }
         }
 
     protected:
-        void write(bool indent, const std::string &text);
+        template <typename... Args>
+        void dispatch(bool indent, int level, fmt::string_view format, Args & ... args)
+        {
+            if (m_binary && Binary_log::is_open())
+            {
+                Binary_log::write(m_name, level, format, args...);
+                Flight_recorder::record_log(level, {format.data(), format.size()});
+                return;
+            }
+            write(indent, level, format, fmt::make_format_args(args...));
+        }
+
+        void dispatch(bool indent, int level, std::string_view text)
+        {
+            if (m_binary && Binary_log::is_open())
+            {
+                Binary_log::write(m_name, level, "{}", text);
+                Flight_recorder::record_log(level, text);
+                return;
+            }
+            write(indent, level, text);
+        }
+
+        void apply_environment_level();
 
+        const char        *m_name{""};
         std::array<int, 2> m_color;
-        int                m_level{Level::LEVEL_ALL};
+        std::atomic<int>   m_level{Level::LEVEL_ALL};
         Colorizer          m_colorizer{Colorizer::default_};
         int                m_indent{0};
+        bool               m_binary{false};
     };
 
     class Indenter
@@ -0,0 +1,126 @@
+#ifndef mpsc_ring_buffer_hpp_vipu_log
+#define mpsc_ring_buffer_hpp_vipu_log
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace vipu
+{
+
+// Bounded lock-free multi producer, single consumer queue.
+// Each cell carries a sequence number which tells producers and the consumer
+// whether the cell is free, published, or still being written.
+template <typename T>
+class Mpsc_ring_buffer
+{
+public:
+    explicit Mpsc_ring_buffer(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        m_mask  = size - 1;
+        m_cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Mpsc_ring_buffer(const Mpsc_ring_buffer &) = delete;
+    auto operator=(const Mpsc_ring_buffer &) -> Mpsc_ring_buffer & = delete;
+
+    // Safe to call from any thread. Returns false if the ring is full.
+    auto try_push(T &&value)
+    -> bool
+    {
+        size_t position;
+        return try_push(std::move(value), position);
+    }
+
+    // As above, and sets position to the count of values pushed before this
+    // one. Values are popped in position order.
+    auto try_push(T &&value, size_t &position)
+    -> bool
+    {
+        Cell *cell;
+        position = m_enqueue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_cells[position & m_mask];
+            size_t   sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff     = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0)
+            {
+                if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only to be called from the single consumer thread.
+    auto try_pop(T &value)
+    -> bool
+    {
+        Cell  &cell     = m_cells[m_dequeue_position & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != m_dequeue_position + 1)
+        {
+            return false;
+        }
+
+        value = std::move(cell.value);
+        cell.sequence.store(m_dequeue_position + m_mask + 1, std::memory_order_release);
+        ++m_dequeue_position;
+        return true;
+    }
+
+    // Only to be called from the single consumer thread.
+    auto empty() const
+    -> bool
+    {
+        const Cell &cell = m_cells[m_dequeue_position & m_mask];
+        return cell.sequence.load(std::memory_order_acquire) != m_dequeue_position + 1;
+    }
+
+    auto capacity() const
+    -> size_t
+    {
+        return m_mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{0};
+        T                   value;
+    };
+
+    std::unique_ptr<Cell[]>          m_cells;
+    size_t                           m_mask{0};
+    alignas(64) std::atomic<size_t>  m_enqueue_position{0};
+    alignas(64) size_t               m_dequeue_position{0};
+};
+
+} // namespace vipu
+
+#endif // mpsc_ring_buffer_hpp_vipu_log
@@ -1,7 +1,9 @@
 
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <future>
 #include <gsl/gsl>
 
 #include "graphics/context.hpp"
@@ -10,26 +12,46 @@
 #include "graphics/display_surface.hpp"
 #include "graphics/instance.hpp"
 #include "graphics/log.hpp"
+#include "graphics/memory_allocator.hpp"
+#include "graphics/memory_budget.hpp"
+#include "graphics/pipeline_factory.hpp"
+#include "graphics/pipeline_layout_cache.hpp"
+#include "graphics/queue.hpp"
+#include "graphics/shader_library.hpp"
+#include "graphics/shader_watcher.hpp"
+#include "graphics/startup_timeline.hpp"
 #include "graphics/surface.hpp"
 #include "graphics/swapchain.hpp"
+#include "graphics/upload_engine.hpp"
+#include "graphics/upload_ring.hpp"
 #include "graphics/xcb_surface.hpp"
 #include "graphics/vulkan.hpp"
 
-using Context         = vipu::Context;
-using Device          = vipu::Device;
-using Display         = vipu::Display;
-using Display_surface = vipu::Display_surface;
-using Instance        = vipu::Instance;
-using Surface         = vipu::Surface;
-using Swapchain       = vipu::Swapchain;
-using XCB_surface     = vipu::XCB_surface;
+using Context               = vipu::Context;
+using Device                = vipu::Device;
+using Display               = vipu::Display;
+using Display_surface       = vipu::Display_surface;
+using Instance              = vipu::Instance;
+using Memory_allocator      = vipu::Memory_allocator;
+using Memory_budget         = vipu::Memory_budget;
+using Pipeline_factory      = vipu::Pipeline_factory;
+using Pipeline_layout_cache = vipu::Pipeline_layout_cache;
+using Shader_library        = vipu::Shader_library;
+using Shader_watcher        = vipu::Shader_watcher;
+using Submit_service        = vipu::Submit_service;
+using Surface               = vipu::Surface;
+using Swapchain             = vipu::Swapchain;
+using Upload_engine         = vipu::Upload_engine;
+using Upload_ring           = vipu::Upload_ring;
+using XCB_surface           = vipu::XCB_surface;
 
 class Frame_in_flight
 {
 public:
     Frame_in_flight() = default;
 
-    Frame_in_flight(Context &context)
+    Frame_in_flight(Context &context, vipu::Upload_ring_slice &upload_slice)
+        : m_upload_slice{&upload_slice}
     {
         Expects(context.vk_device);
 
@@ -54,30 +76,61 @@ public:
 
         m_pre_command_buffer  = std::move(context.vk_device.allocateCommandBuffersUnique(command_buffer_allocate_info)[0]);
         m_post_command_buffer = std::move(context.vk_device.allocateCommandBuffersUnique(command_buffer_allocate_info)[0]);
+
+        // Present family acquires swapchain image ownership in its own submit
+        if (context.present_sharing == vipu::Present_sharing::ownership_transfer)
+        {
+            m_ownership_acquired_ready_to_present_semaphore = context.vk_device.createSemaphoreUnique( {} );
+            m_present_fence                                 = context.vk_device.createFenceUnique( {vk::FenceCreateFlagBits::eSignaled} );
+            m_present_command_pool = context.vk_device.createCommandPoolUnique(
+                {
+                    command_pool_flags,
+                    context.present_queue_family_index
+                }
+            );
+            vk::CommandBufferAllocateInfo present_command_buffer_allocate_info(
+                m_present_command_pool.get(),
+                vk::CommandBufferLevel::ePrimary,
+                1
+            );
+            m_present_command_buffer = std::move(context.vk_device.allocateCommandBuffersUnique(present_command_buffer_allocate_info)[0]);
+        }
     }
 
     void wait(Context &context)
     {
-        vk::Fence  vk_fence  = m_fence.get();
+        std::vector<vk::Fence> vk_fences{m_fence.get()};
+        if (m_present_fence)
+        {
+            vk_fences.push_back(m_present_fence.get());
+        }
         uint64_t   timeout_ns { 1000000000ULL }; // one second timeout
-        vk::Bool32 wait_all   { VK_FALSE };
+        vk::Bool32 wait_all   { VK_TRUE };
 
         auto result = context.vk_device.waitForFences(
-            {
-                vk_fence
-            },
+            vk_fences,
             wait_all,
             timeout_ns
         );
         VERIFY(result == vk::Result::eSuccess);
 
-        context.vk_device.resetFences( { vk_fence } );
+        context.vk_device.resetFences(vk_fences);
+
+        // GPU is done with this frame, so its uploads can be overwritten
+        m_upload_slice->reset();
+    }
+
+    // Uniforms and dynamic vertex data for this frame
+    auto get_upload_slice()
+    -> vipu::Upload_ring_slice &
+    {
+        return *m_upload_slice;
     }
 
     void acquire_image(Context &context)
     {
         uint64_t timeout_ns = 3000000000ULL; // 3 seconds
-        uint32_t swapchain_image_index{std::numeric_limits<uint32_t>::max()};
+        m_swapchain_image_index = std::numeric_limits<uint32_t>::max();
 
         // Acquire swapchain image
         vk::Semaphore vk_semaphore = m_image_acquired_ready_to_draw_semaphore.get();
@@ -86,8 +139,9 @@ public:
             timeout_ns,
             vk_semaphore,
             vk::Fence(),
-            &swapchain_image_index
+            &m_swapchain_image_index
         );
+        vipu::Flight_recorder::record_frame_event(vipu::Flight_recorder::Event::acquire, context.frame_number);
 
         switch (res)
         {
@@ -114,6 +168,50 @@ public:
         }
     }
 
+    // Draw submit must signal m_draw_complete_ready_to_present_semaphore,
+    // with Swapchain::record_release_to_present() as its last command.
+    void present(Context &context)
+    {
+        // Signal operation must be submitted before present waits for it
+        if (context.graphics_submit_service != nullptr)
+        {
+            context.graphics_submit_service->flush();
+        }
+
+        vk::Semaphore wait_semaphore = m_draw_complete_ready_to_present_semaphore.get();
+
+        if (context.present_sharing == vipu::Present_sharing::ownership_transfer)
+        {
+            vk::Image         image          = context.swapchain->get_images()[m_swapchain_image_index];
+            vk::CommandBuffer command_buffer = m_present_command_buffer.get();
+            command_buffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+            context.swapchain->record_acquire_for_present(command_buffer, image);
+            command_buffer.end();
+
+            vk::PipelineStageFlags wait_stage       = vk::PipelineStageFlagBits::eAllCommands;
+            vk::Semaphore          signal_semaphore = m_ownership_acquired_ready_to_present_semaphore.get();
+            vk::SubmitInfo submit_info{
+                1, &wait_semaphore, &wait_stage,
+                1, &command_buffer,
+                1, &signal_semaphore
+            };
+            context.present_queue->submit(submit_info, m_present_fence.get());
+            wait_semaphore = signal_semaphore;
+        }
+
+        vk::SwapchainKHR   vk_swapchain = context.vk_swapchain;
+        vk::PresentInfoKHR present_info{
+            1, &wait_semaphore,
+            1, &vk_swapchain, &m_swapchain_image_index
+        };
+        auto result = context.present_queue->present(present_info);
+        vipu::Flight_recorder::record_frame_event(vipu::Flight_recorder::Event::present, context.frame_number);
+        if (result == vk::Result::eErrorOutOfDateKHR)
+        {
+            // OnWindowSizeChanged();
+        }
+    }
+
     vk::UniqueFence          m_fence;
     vk::UniqueSemaphore      m_image_acquired_ready_to_draw_semaphore;
     vk::UniqueSemaphore      m_draw_complete_ready_to_present_semaphore;
@@ -121,6 +219,14 @@ public:
     vk::UniqueCommandPool    m_command_pool;
     vk::UniqueCommandBuffer  m_pre_command_buffer;
     vk::UniqueCommandBuffer  m_post_command_buffer;
+    uint32_t                 m_swapchain_image_index{std::numeric_limits<uint32_t>::max()};
+    vipu::Upload_ring_slice *m_upload_slice{nullptr};
+
+    // Only with Present_sharing::ownership_transfer
+    vk::UniqueFence          m_present_fence;
+    vk::UniqueSemaphore      m_ownership_acquired_ready_to_present_semaphore;
+    vk::UniqueCommandPool    m_present_command_pool;
+    vk::UniqueCommandBuffer  m_present_command_buffer;
 };
 
 class Swapchain_entry
@@ -133,25 +239,62 @@ class Swapchain_entry
 class Vulkan
 {
 public:
-    Context                       m_context;
-    std::unique_ptr<Instance>     m_instance;
-    std::unique_ptr<Surface>      m_surface;
-    std::unique_ptr<Device>       m_device;
+    static constexpr uint32_t frames_in_flight_count{2};
+    static constexpr uint64_t upload_ring_slice_size{4 * 1024 * 1024};
+
+    Context                                m_context;
+    std::unique_ptr<Instance>              m_instance;
+    std::unique_ptr<Surface>               m_surface;
+    std::unique_ptr<Device>                m_device;
+    std::unique_ptr<Submit_service>        m_graphics_submit_service;
+    std::unique_ptr<Memory_allocator>      m_memory_allocator;
+    std::unique_ptr<Memory_budget>         m_memory_budget;
+    std::unique_ptr<Upload_engine>         m_upload_engine;
+    std::unique_ptr<Pipeline_factory>      m_pipeline_factory;
+    std::unique_ptr<Shader_library>        m_shader_library;
+    std::unique_ptr<Pipeline_layout_cache> m_pipeline_layout_cache;
+    std::unique_ptr<Shader_watcher>        m_shader_watcher;
 
     std::unique_ptr<Swapchain>    m_swapchain;
+    std::unique_ptr<Upload_ring>  m_upload_ring;
     std::vector<Frame_in_flight>  m_frames_in_flight;
     size_t                        m_frame_resource_index{0};
     Frame_in_flight              *m_current_frame{nullptr};
     vk::UniqueRenderPass          m_renderpass;
 
+    std::chrono::steady_clock::time_point m_frame_start_time;
+    std::chrono::steady_clock::duration   m_total_frame_time{0};
+    uint64_t                              m_frame_count{0};
+    uint64_t                              m_total_submit_batches{0};
+    uint64_t                              m_total_submit_calls{0};
+
     Vulkan()
     {
         m_context.surface_type = Surface::Type::eXCB;
         //m_context.surface_type = Surface::Type::eDisplay;
+        m_context.validation_profile = vipu::get_validation_profile();
 
-        m_instance = std::make_unique<Instance>(m_context);
+        // Independent phases run concurrently: X server connection and
+        // window creation do not need Vulkan, and do not block instance
+        // creation and physical device probing.
+        vipu::Startup_timeline timeline;
+        m_context.startup_timeline = &timeline;
 
-        auto &physical_device = m_instance->choose_physical_device();
+        std::future<std::unique_ptr<XCB_surface>> xcb_window;
+        if (m_context.surface_type == Surface::Type::eXCB)
+        {
+            xcb_window = timeline.run_async("xcb window", []()
+            {
+                return std::make_unique<XCB_surface>();
+            });
+        }
+
+        m_instance = timeline.run("instance", [this]()
+        {
+            return std::make_unique<Instance>(m_context);
+        });
+
+        auto &physical_device = m_instance->choose_physical_device(vipu::get_device_override());
         m_context.physical_device = &physical_device;
         m_context.vk_physical_device = physical_device.get();
 
@@ -159,13 +302,21 @@ public:
         {
             vipu::log_vulkan.info("Creating display surface\n");
 
-            m_surface = std::make_unique<Display_surface>(m_context);
+            m_surface = timeline.run("display surface", [this]()
+            {
+                return std::make_unique<Display_surface>(m_context);
+            });
         }
         else if (m_context.surface_type == Surface::Type::eXCB)
         {
             vipu::log_vulkan.info("Creating XCB surface\n");
 
-            m_surface = std::make_unique<XCB_surface>(m_context);
+            auto xcb_surface = xcb_window.get();
+            timeline.run("xcb surface", [this, &xcb_surface]()
+            {
+                xcb_surface->create_xcb_surface(m_context);
+            });
+            m_surface = std::move(xcb_surface);
         }
         else
         {
@@ -175,19 +326,126 @@ public:
         m_context.surface    = m_surface.get();
         m_context.vk_surface = m_context.surface->get();
 
-        m_device = std::make_unique<Device>(m_context);
+        m_device = timeline.run("device", [this]()
+        {
+            return std::make_unique<Device>(m_context);
+        });
 
         m_context.vk_device                   = m_device->get();
+        m_context.device_features             = m_device->get_features();
         m_context.vk_queue                    = m_device->get_queue();
+        m_context.graphics_queue              = &m_device->get_graphics_queue();
+        m_context.present_queue               = &m_device->get_present_queue();
+        m_context.compute_queue               = &m_device->get_compute_queue();
+        m_context.transfer_queue              = &m_device->get_transfer_queue();
         m_context.graphics_queue_family_index = m_device->get_queue_family_indices().graphics;
+        m_context.present_queue_family_index  = m_device->get_queue_family_indices().present;
+        m_context.compute_queue_family_index  = m_device->get_queue_family_indices().compute;
+        m_context.transfer_queue_family_index = m_device->get_queue_family_indices().transfer;
+        m_context.present_sharing             = m_device->get_present_sharing();
+        m_context.pipeline_cache              = &m_device->get_pipeline_cache();
+        m_context.vk_pipeline_cache           = m_context.pipeline_cache->get();
+
+        m_graphics_submit_service = std::make_unique<Submit_service>(m_device->get_graphics_queue(),
+                                                                     m_context.device_features.synchronization2);
+        m_context.graphics_submit_service = m_graphics_submit_service.get();
+
+        m_memory_allocator = std::make_unique<Memory_allocator>(m_context);
+        m_context.memory_allocator = m_memory_allocator.get();
+        m_memory_budget = std::make_unique<Memory_budget>(m_context);
+        m_context.memory_budget = m_memory_budget.get();
+
+        if (m_context.device_features.timeline_semaphore)
+        {
+            m_upload_engine = std::make_unique<Upload_engine>(m_context);
+            m_context.upload_engine = m_upload_engine.get();
+        }
+        else
+        {
+            vipu::log_vulkan.info("Timeline semaphores not available, upload engine disabled\n");
+        }
+
+        // SPIR-V is embedded in the executable, VIPU_SHADER_DIR overrides it
+        m_shader_library = std::make_unique<Shader_library>();
+        m_context.shader_library = m_shader_library.get();
 
-        m_swapchain = std::make_unique<Swapchain>(m_context);
+        // Layouts from SPIR-V reflection, shared between pipelines
+        m_pipeline_layout_cache = std::make_unique<Pipeline_layout_cache>(m_context);
+        m_context.pipeline_layout_cache = m_pipeline_layout_cache.get();
+
+        // Warm-up compiles on factory threads while the swapchain is created
+        m_pipeline_factory = std::make_unique<Pipeline_factory>(m_context);
+        m_context.pipeline_factory = m_pipeline_factory.get();
+        timeline.run("pipeline warm-up", [this]()
+        {
+            return m_pipeline_factory->warm_up(Pipeline_factory::get_default_manifest_path());
+        });
+
+        // Development mode: changed shaders are recompiled, and pipelines
+        // using them are replaced in begin_frame()
+        const std::string shader_watch_directory = Shader_watcher::get_default_directory();
+        if (!shader_watch_directory.empty())
+        {
+            m_shader_watcher = std::make_unique<Shader_watcher>(m_context, shader_watch_directory);
+        }
+
+        m_swapchain = timeline.run("swapchain", [this]()
+        {
+            return std::make_unique<Swapchain>(m_context);
+        });
         m_context.swapchain    = m_swapchain.get();
         m_context.vk_swapchain = m_context.swapchain->get();
 
-        create_renderpasses();
+        timeline.run("renderpasses", [this]()
+        {
+            create_renderpasses();
+        });
+
+        timeline.run("frames in flight", [this]()
+        {
+            m_upload_ring = std::make_unique<Upload_ring>(m_context, upload_ring_slice_size, frames_in_flight_count);
+            m_frames_in_flight.reserve(frames_in_flight_count);
+            for (uint32_t i = 0; i < frames_in_flight_count; ++i)
+            {
+                m_frames_in_flight.emplace_back(m_context, m_upload_ring->get_slice(i));
+            }
+        });
+
+        m_context.startup_timeline = nullptr;
+        timeline.log_summary();
 
+        m_frames_in_flight.clear();
+        m_upload_ring->log_statistics();
+        m_upload_ring.reset();
         m_swapchain.reset();
+        if (m_shader_watcher)
+        {
+            m_shader_watcher->log_statistics();
+            m_shader_watcher.reset();
+        }
+        m_pipeline_factory->wait_idle();
+        m_pipeline_factory->log_statistics();
+        m_pipeline_factory->save_manifest(Pipeline_factory::get_default_manifest_path());
+        m_context.pipeline_factory = nullptr;
+        m_pipeline_factory.reset();
+        m_pipeline_layout_cache->log_statistics();
+        m_context.pipeline_layout_cache = nullptr;
+        m_pipeline_layout_cache.reset();
+        m_context.shader_library = nullptr;
+        m_shader_library.reset();
+        m_context.upload_engine = nullptr;
+        m_upload_engine.reset();
+        m_memory_budget->update();
+        m_memory_budget->log_statistics();
+        m_context.memory_budget = nullptr;
+        m_memory_budget.reset();
+        m_memory_allocator->log_statistics();
+        m_context.memory_allocator = nullptr;
+        m_memory_allocator.reset();
+        m_context.graphics_submit_service = nullptr;
+        m_graphics_submit_service.reset();
+        m_context.pipeline_cache    = nullptr;
+        m_context.vk_pipeline_cache = vk::PipelineCache{};
         m_device.reset();
         m_surface.reset();
         m_instance.reset();
@@ -247,21 +505,53 @@ public:
 
     ~Vulkan()
     {
+        if (m_frame_count > 0)
+        {
+            vipu::log_vulkan.info("Frames {}, average frame time {:.3f} ms, validation profile {}, present sharing {}\n",
+                                  m_frame_count,
+                                  std::chrono::duration<double, std::milli>(m_total_frame_time).count() / static_cast<double>(m_frame_count),
+                                  vipu::c_str(m_context.validation_profile),
+                                  vipu::c_str(m_context.present_sharing));
+            vipu::log_vulkan.info("Average per frame: {:.2f} submit batches, {:.2f} queue submits\n",
+                                  static_cast<double>(m_total_submit_batches) / static_cast<double>(m_frame_count),
+                                  static_cast<double>(m_total_submit_calls)   / static_cast<double>(m_frame_count));
+        }
         m_instance.reset();
     }
 
     void begin_frame(Context &context)
     {
         ++context.frame_number;
+        vipu::Flight_recorder::record_frame_event(vipu::Flight_recorder::Event::begin_frame, context.frame_number);
         m_frame_resource_index = context.frame_number % m_frames_in_flight.size();
 
         m_current_frame = &m_frames_in_flight[m_frame_resource_index];
         m_current_frame->wait(context);
+        m_pipeline_factory->apply_rebuilds(context.frame_number, frames_in_flight_count);
+        m_memory_budget->begin_frame(context.frame_number);
+        if (m_upload_engine)
+        {
+            m_upload_engine->begin_frame();
+        }
+        m_frame_start_time = std::chrono::steady_clock::now();
     }
 
 
     void end_frame()
     {
+        if (m_graphics_submit_service)
+        {
+            auto statistics = m_graphics_submit_service->end_frame();
+            m_total_submit_batches += statistics.batch_count;
+            m_total_submit_calls   += statistics.submit_count;
+            vipu::log_vulkan.trace("Frame {}: {} submit batches, {} queue submits\n",
+                                   m_context.frame_number,
+                                   statistics.batch_count,
+                                   statistics.submit_count);
+        }
+        vipu::Flight_recorder::record_frame_event(vipu::Flight_recorder::Event::end_frame, m_context.frame_number);
+        m_total_frame_time += std::chrono::steady_clock::now() - m_frame_start_time;
+        ++m_frame_count;
     }
 
 };
@@ -271,7 +561,30 @@ int main(int argc, const char **argv)
     static_cast<void>(argc);
     static_cast<void>(argv);
 
-    Vulkan vulkan;
+    vipu::Log::console_init();
+    vipu::Log::start_async();
+
+    // Recent log records and frame events, dumped on FATAL, crash or SIGUSR1
+    vipu::Flight_recorder::set_dump_path("flight_recorder.txt");
+    vipu::Flight_recorder::install_signal_handlers();
+
+    // Deferred formatting, decode with log_decode
+    const char *binary_log_path = getenv("VIPU_LOG_BINARY");
+    if ((binary_log_path != nullptr) && vipu::Binary_log::open(binary_log_path, 256 * 1024 * 1024))
+    {
+        vipu::log_vulkan.set_binary(true);
+    }
+
+    {
+        auto   start_time = std::chrono::steady_clock::now();
+        Vulkan vulkan;
+        vipu::log_vulkan.info("Startup {:.3f} ms, validation profile {}\n",
+                              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count(),
+                              vipu::c_str(vulkan.m_context.validation_profile));
+    }
+
+    vipu::Binary_log::close();
+    vipu::Log::stop_async();
 
     return 0;
 }
@@ -0,0 +1,51 @@
+#include "memory/linear_allocator.hpp"
+
+namespace vipu
+{
+
+Linear_allocator::Linear_allocator(uint64_t size)
+    : m_size{size}
+{
+}
+
+auto Linear_allocator::allocate(uint64_t size, uint64_t alignment)
+-> uint64_t
+{
+    if (alignment == 0)
+    {
+        alignment = 1;
+    }
+
+    uint64_t offset = m_offset.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        const uint64_t aligned_offset = (offset + alignment - 1) & ~(alignment - 1);
+        if ((aligned_offset > m_size) || (size > m_size - aligned_offset))
+        {
+            return invalid_offset;
+        }
+        if (m_offset.compare_exchange_weak(offset, aligned_offset + size, std::memory_order_relaxed))
+        {
+            return aligned_offset;
+        }
+    }
+}
+
+void Linear_allocator::reset()
+{
+    m_offset.store(0, std::memory_order_relaxed);
+}
+
+auto Linear_allocator::get_size() const
+-> uint64_t
+{
+    return m_size;
+}
+
+auto Linear_allocator::get_used_size() const
+-> uint64_t
+{
+    return m_offset.load(std::memory_order_relaxed);
+}
+
+} // namespace vipu
@@ -0,0 +1,42 @@
+#ifndef linear_allocator_hpp_vipu_memory
+#define linear_allocator_hpp_vipu_memory
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace vipu
+{
+
+// Bump allocator of offsets within a range, for transient allocations which
+// are all released together with reset(). allocate() is lock-free and may be
+// called from any thread.
+class Linear_allocator
+{
+public:
+    static constexpr uint64_t invalid_offset{std::numeric_limits<uint64_t>::max()};
+
+    explicit Linear_allocator(uint64_t size);
+
+    // Alignment must be a power of two. Returns invalid_offset if the range
+    // is full.
+    auto allocate(uint64_t size, uint64_t alignment = 1)
+    -> uint64_t;
+
+    // Must not be called concurrently with allocate()
+    void reset();
+
+    auto get_size() const
+    -> uint64_t;
+
+    auto get_used_size() const
+    -> uint64_t;
+
+private:
+    uint64_t              m_size{0};
+    std::atomic<uint64_t> m_offset{0};
+};
+
+} // namespace vipu
+
+#endif // linear_allocator_hpp_vipu_memory
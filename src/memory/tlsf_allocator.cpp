@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <bit>
+
+#include "memory/tlsf_allocator.hpp"
+
+namespace vipu
+{
+
+namespace
+{
+
+auto align_up(uint64_t value, uint64_t alignment)
+-> uint64_t
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+auto floor_log2(uint64_t value)
+-> uint32_t
+{
+    return 63u - static_cast<uint32_t>(std::countl_zero(value));
+}
+
+} // anonymous namespace
+
+Tlsf_allocator::Tlsf_allocator(uint64_t size)
+    : m_size{size}
+{
+    m_bin_heads.fill(invalid_node);
+    if (size > 0)
+    {
+        uint32_t node = new_node();
+        m_nodes[node].size = size;
+        insert_free(node);
+    }
+}
+
+// First level is the highest set bit, second level the next sl_log2 bits.
+// Sizes below sl_count map linearly to first level 0.
+auto Tlsf_allocator::get_bin(uint64_t size)
+-> uint32_t
+{
+    if (size < sl_count)
+    {
+        return static_cast<uint32_t>(size);
+    }
+    const uint32_t log2 = floor_log2(size);
+    const uint32_t fl   = log2 - sl_log2 + 1;
+    const uint32_t sl   = static_cast<uint32_t>(size >> (log2 - sl_log2)) ^ sl_count;
+    return fl * sl_count + sl;
+}
+
+// Rounds size up to the next bin, so that any block in the found bin fits
+auto Tlsf_allocator::find_free_node(uint64_t size) const
+-> uint32_t
+{
+    if (size >= sl_count)
+    {
+        const uint64_t round = (uint64_t{1} << (floor_log2(size) - sl_log2)) - 1;
+        if (size > std::numeric_limits<uint64_t>::max() - round)
+        {
+            return invalid_node;
+        }
+        size += round;
+    }
+
+    const uint32_t bin = get_bin(size);
+    uint32_t fl = bin / sl_count;
+    uint32_t sl = bin % sl_count;
+
+    uint32_t sl_map = m_sl_bitmaps[fl] & (~0u << sl);
+    if (sl_map == 0)
+    {
+        const uint64_t fl_map = (fl + 1 < 64) ? (m_fl_bitmap & (~uint64_t{0} << (fl + 1))) : 0;
+        if (fl_map == 0)
+        {
+            return invalid_node;
+        }
+        fl     = static_cast<uint32_t>(std::countr_zero(fl_map));
+        sl_map = m_sl_bitmaps[fl];
+    }
+    sl = static_cast<uint32_t>(std::countr_zero(sl_map));
+    return m_bin_heads[fl * sl_count + sl];
+}
+
+auto Tlsf_allocator::new_node()
+-> uint32_t
+{
+    if (!m_unused_nodes.empty())
+    {
+        uint32_t node = m_unused_nodes.back();
+        m_unused_nodes.pop_back();
+        m_nodes[node] = Node{};
+        return node;
+    }
+    m_nodes.emplace_back();
+    return static_cast<uint32_t>(m_nodes.size() - 1);
+}
+
+void Tlsf_allocator::insert_free(uint32_t node)
+{
+    const uint32_t bin  = get_bin(m_nodes[node].size);
+    const uint32_t head = m_bin_heads[bin];
+
+    m_nodes[node].used      = false;
+    m_nodes[node].prev_free = invalid_node;
+    m_nodes[node].next_free = head;
+    if (head != invalid_node)
+    {
+        m_nodes[head].prev_free = node;
+    }
+    m_bin_heads[bin] = node;
+    m_sl_bitmaps[bin / sl_count] |= 1u << (bin % sl_count);
+    m_fl_bitmap |= uint64_t{1} << (bin / sl_count);
+    ++m_free_block_count;
+}
+
+void Tlsf_allocator::remove_free(uint32_t node)
+{
+    const Node &n = m_nodes[node];
+    if (n.prev_free != invalid_node)
+    {
+        m_nodes[n.prev_free].next_free = n.next_free;
+    }
+    if (n.next_free != invalid_node)
+    {
+        m_nodes[n.next_free].prev_free = n.prev_free;
+    }
+
+    const uint32_t bin = get_bin(n.size);
+    if (m_bin_heads[bin] == node)
+    {
+        m_bin_heads[bin] = n.next_free;
+        if (n.next_free == invalid_node)
+        {
+            m_sl_bitmaps[bin / sl_count] &= ~(1u << (bin % sl_count));
+            if (m_sl_bitmaps[bin / sl_count] == 0)
+            {
+                m_fl_bitmap &= ~(uint64_t{1} << (bin / sl_count));
+            }
+        }
+    }
+    --m_free_block_count;
+}
+
+auto Tlsf_allocator::allocate(uint64_t size, uint64_t alignment)
+-> Allocation
+{
+    if (size == 0)
+    {
+        size = 1;
+    }
+    if (alignment == 0)
+    {
+        alignment = 1;
+    }
+
+    // Offsets are usually aligned already; only search for a block with
+    // room for padding when the first candidate is not.
+    uint32_t node = find_free_node(size);
+    if ((node != invalid_node) &&
+        (align_up(m_nodes[node].offset, alignment) + size > m_nodes[node].offset + m_nodes[node].size))
+    {
+        node = invalid_node;
+    }
+    if ((node == invalid_node) && (alignment > 1))
+    {
+        node = find_free_node(size + alignment - 1);
+    }
+    if (node == invalid_node)
+    {
+        return {};
+    }
+
+    remove_free(node);
+
+    // Padding before aligned offset becomes a free block. The previous block
+    // is used, as free blocks are always coalesced.
+    const uint64_t aligned_offset = align_up(m_nodes[node].offset, alignment);
+    const uint64_t padding        = aligned_offset - m_nodes[node].offset;
+    if (padding > 0)
+    {
+        uint32_t head = new_node();
+        Node &n = m_nodes[node];
+        Node &h = m_nodes[head];
+        h.offset        = n.offset;
+        h.size          = padding;
+        h.prev_physical = n.prev_physical;
+        h.next_physical = node;
+        if (n.prev_physical != invalid_node)
+        {
+            m_nodes[n.prev_physical].next_physical = head;
+        }
+        n.prev_physical = head;
+        n.offset        = aligned_offset;
+        n.size         -= padding;
+        insert_free(head);
+    }
+
+    if (m_nodes[node].size > size)
+    {
+        uint32_t tail = new_node();
+        Node &n = m_nodes[node];
+        Node &t = m_nodes[tail];
+        t.offset        = n.offset + size;
+        t.size          = n.size - size;
+        t.prev_physical = node;
+        t.next_physical = n.next_physical;
+        if (n.next_physical != invalid_node)
+        {
+            m_nodes[n.next_physical].prev_physical = tail;
+        }
+        n.next_physical = tail;
+        n.size          = size;
+        insert_free(tail);
+    }
+
+    m_nodes[node].used = true;
+    m_used_size += size;
+    ++m_allocation_count;
+    return Allocation{aligned_offset, node};
+}
+
+void Tlsf_allocator::free(Allocation allocation)
+{
+    if (!allocation.is_valid())
+    {
+        return;
+    }
+
+    uint32_t node = allocation.node;
+    m_used_size -= m_nodes[node].size;
+    --m_allocation_count;
+
+    const uint32_t prev = m_nodes[node].prev_physical;
+    if ((prev != invalid_node) && !m_nodes[prev].used)
+    {
+        remove_free(prev);
+        Node &p = m_nodes[prev];
+        Node &n = m_nodes[node];
+        p.size         += n.size;
+        p.next_physical = n.next_physical;
+        if (n.next_physical != invalid_node)
+        {
+            m_nodes[n.next_physical].prev_physical = prev;
+        }
+        m_unused_nodes.push_back(node);
+        node = prev;
+    }
+
+    const uint32_t next = m_nodes[node].next_physical;
+    if ((next != invalid_node) && !m_nodes[next].used)
+    {
+        remove_free(next);
+        Node &n  = m_nodes[node];
+        Node &nx = m_nodes[next];
+        n.size         += nx.size;
+        n.next_physical = nx.next_physical;
+        if (nx.next_physical != invalid_node)
+        {
+            m_nodes[nx.next_physical].prev_physical = node;
+        }
+        m_unused_nodes.push_back(next);
+    }
+
+    insert_free(node);
+}
+
+auto Tlsf_allocator::get_size() const
+-> uint64_t
+{
+    return m_size;
+}
+
+auto Tlsf_allocator::get_used_size() const
+-> uint64_t
+{
+    return m_used_size;
+}
+
+auto Tlsf_allocator::get_allocation_count() const
+-> uint32_t
+{
+    return m_allocation_count;
+}
+
+auto Tlsf_allocator::get_free_block_count() const
+-> uint32_t
+{
+    return m_free_block_count;
+}
+
+auto Tlsf_allocator::get_largest_free_size() const
+-> uint64_t
+{
+    if (m_fl_bitmap == 0)
+    {
+        return 0;
+    }
+    const uint32_t fl  = floor_log2(m_fl_bitmap);
+    const uint32_t sl  = 31u - static_cast<uint32_t>(std::countl_zero(m_sl_bitmaps[fl]));
+    uint64_t largest{0};
+    for (uint32_t node = m_bin_heads[fl * sl_count + sl]; node != invalid_node; node = m_nodes[node].next_free)
+    {
+        largest = std::max(largest, m_nodes[node].size);
+    }
+    return largest;
+}
+
+} // namespace vipu
@@ -0,0 +1,100 @@
+#ifndef tlsf_allocator_hpp_vipu_memory
+#define tlsf_allocator_hpp_vipu_memory
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace vipu
+{
+
+// Two-level segregated fit allocator of offsets within a range. It does not
+// access the memory it manages, so it can sub-allocate device memory.
+// Allocation and free are O(1). Free blocks are coalesced with free
+// neighbours on free. Not thread safe.
+class Tlsf_allocator
+{
+public:
+    static constexpr uint32_t invalid_node  {std::numeric_limits<uint32_t>::max()};
+    static constexpr uint64_t invalid_offset{std::numeric_limits<uint64_t>::max()};
+
+    struct Allocation
+    {
+        uint64_t offset{invalid_offset};
+        uint32_t node  {invalid_node};
+
+        auto is_valid() const
+        -> bool
+        {
+            return node != invalid_node;
+        }
+    };
+
+    explicit Tlsf_allocator(uint64_t size);
+
+    // Alignment must be a power of two. Returns invalid allocation if there
+    // is no free block large enough.
+    auto allocate(uint64_t size, uint64_t alignment = 1)
+    -> Allocation;
+
+    void free(Allocation allocation);
+
+    auto get_size() const
+    -> uint64_t;
+
+    auto get_used_size() const
+    -> uint64_t;
+
+    auto get_allocation_count() const
+    -> uint32_t;
+
+    auto get_free_block_count() const
+    -> uint32_t;
+
+    auto get_largest_free_size() const
+    -> uint64_t;
+
+private:
+    static constexpr uint32_t sl_log2 {4};
+    static constexpr uint32_t sl_count{1u << sl_log2};
+    static constexpr uint32_t fl_count{64 - sl_log2 + 1};
+
+    struct Node
+    {
+        uint64_t offset       {0};
+        uint64_t size         {0};
+        uint32_t prev_physical{invalid_node};
+        uint32_t next_physical{invalid_node};
+        uint32_t prev_free    {invalid_node};
+        uint32_t next_free    {invalid_node};
+        bool     used         {false};
+    };
+
+    static auto get_bin(uint64_t size)
+    -> uint32_t;
+
+    auto find_free_node(uint64_t size) const
+    -> uint32_t;
+
+    auto new_node()
+    -> uint32_t;
+
+    void insert_free(uint32_t node);
+
+    void remove_free(uint32_t node);
+
+    uint64_t                                  m_size           {0};
+    uint64_t                                  m_used_size      {0};
+    uint32_t                                  m_allocation_count{0};
+    uint32_t                                  m_free_block_count{0};
+    uint64_t                                  m_fl_bitmap      {0};
+    std::array<uint32_t, fl_count>            m_sl_bitmaps     {};
+    std::array<uint32_t, fl_count * sl_count> m_bin_heads;
+    std::vector<Node>                         m_nodes;
+    std::vector<uint32_t>                     m_unused_nodes;
+};
+
+} // namespace vipu
+
+#endif // tlsf_allocator_hpp_vipu_memory
@@ -0,0 +1,13 @@
+#include "graphics/shader_library.hpp"
+
+namespace vipu
+{
+
+// Tests read SPIR-V from files, so nothing is embedded
+auto get_embedded_shaders()
+-> std::span<const Embedded_shader>
+{
+    return {};
+}
+
+} // namespace vipu
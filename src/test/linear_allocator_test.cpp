@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "memory/linear_allocator.hpp"
+
+using Linear_allocator = vipu::Linear_allocator;
+
+TEST(Linear_allocator, aligns_offsets)
+{
+    Linear_allocator allocator{1024};
+
+    EXPECT_EQ(allocator.allocate(10), 0u);
+    EXPECT_EQ(allocator.allocate(16, 64), 64u);
+    EXPECT_EQ(allocator.allocate(1, 16), 80u);
+    EXPECT_EQ(allocator.allocate(1, 0), 81u);
+    EXPECT_EQ(allocator.get_used_size(), 82u);
+}
+
+TEST(Linear_allocator, reports_exhaustion)
+{
+    Linear_allocator allocator{1024};
+
+    EXPECT_EQ(allocator.allocate(1025), Linear_allocator::invalid_offset);
+    EXPECT_EQ(allocator.allocate(1000), 0u);
+
+    // Alignment padding alone would go past the end
+    EXPECT_EQ(allocator.allocate(1, 2048), Linear_allocator::invalid_offset);
+    EXPECT_EQ(allocator.allocate(25), Linear_allocator::invalid_offset);
+    EXPECT_EQ(allocator.allocate(24), 1000u);
+    EXPECT_EQ(allocator.allocate(1), Linear_allocator::invalid_offset);
+    EXPECT_EQ(allocator.get_used_size(), 1024u);
+}
+
+TEST(Linear_allocator, reset_releases_everything)
+{
+    Linear_allocator allocator{1024};
+
+    EXPECT_EQ(allocator.allocate(1024), 0u);
+    EXPECT_EQ(allocator.allocate(1), Linear_allocator::invalid_offset);
+
+    allocator.reset();
+    EXPECT_EQ(allocator.get_used_size(), 0u);
+    EXPECT_EQ(allocator.allocate(512, 256), 0u);
+}
+
+TEST(Linear_allocator, concurrent_allocations_do_not_overlap)
+{
+    constexpr int      thread_count          {4};
+    constexpr int      allocations_per_thread{256};
+    constexpr uint64_t size                  {64};
+
+    Linear_allocator allocator{thread_count * allocations_per_thread * size};
+
+    std::vector<std::vector<uint64_t>> offsets(thread_count);
+    std::vector<std::thread>           threads;
+    for (int i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([&allocator, &offsets = offsets[i]]()
+        {
+            for (int j = 0; j < allocations_per_thread; ++j)
+            {
+                offsets.push_back(allocator.allocate(size, size));
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::vector<uint64_t> all_offsets;
+    for (const auto &thread_offsets : offsets)
+    {
+        all_offsets.insert(all_offsets.end(), thread_offsets.begin(), thread_offsets.end());
+    }
+    std::sort(all_offsets.begin(), all_offsets.end());
+    for (size_t i = 0; i < all_offsets.size(); ++i)
+    {
+        EXPECT_EQ(all_offsets[i], i * size);
+    }
+    EXPECT_EQ(allocator.allocate(1), Linear_allocator::invalid_offset);
+}
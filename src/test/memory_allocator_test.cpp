@@ -0,0 +1,196 @@
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "graphics/memory_allocator.hpp"
+#include "graphics/vulkan.hpp"
+
+using Memory_allocation = vipu::Memory_allocation;
+using Memory_allocator  = vipu::Memory_allocator;
+using Memory_usage      = vipu::Memory_usage;
+using Resource_tiling   = vipu::Resource_tiling;
+
+namespace
+{
+
+// Creates a device on lavapipe (Mesa llvmpipe), so that the tests run the
+// same way on any machine. Tests are skipped if it is not installed.
+class Memory_allocator_test : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        try
+        {
+            m_dl = std::make_unique<vk::DynamicLoader>();
+        }
+        catch (const std::runtime_error &)
+        {
+            GTEST_SKIP() << "Vulkan loader not found";
+        }
+        VULKAN_HPP_DEFAULT_DISPATCHER.init(m_dl->getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr"));
+
+        const vk::ApplicationInfo application_info{"memory_allocator_test", 0, nullptr, 0, VK_API_VERSION_1_1};
+        m_instance = vk::createInstanceUnique(vk::InstanceCreateInfo{vk::InstanceCreateFlags{}, &application_info});
+        VULKAN_HPP_DEFAULT_DISPATCHER.init(m_instance.get());
+
+        for (auto physical_device : m_instance->enumeratePhysicalDevices())
+        {
+            if (physical_device.getProperties().deviceType == vk::PhysicalDeviceType::eCpu)
+            {
+                m_physical_device = physical_device;
+                break;
+            }
+        }
+        if (!m_physical_device)
+        {
+            GTEST_SKIP() << "lavapipe not found";
+        }
+
+        const float queue_priority{1.0f};
+        const vk::DeviceQueueCreateInfo queue_create_info{vk::DeviceQueueCreateFlags{}, 0, 1, &queue_priority};
+        m_device = m_physical_device.createDeviceUnique(vk::DeviceCreateInfo{vk::DeviceCreateFlags{}, 1, &queue_create_info});
+        VULKAN_HPP_DEFAULT_DISPATCHER.init(m_device.get());
+
+        m_memory_properties = m_physical_device.getMemoryProperties();
+        m_granularity       = m_physical_device.getProperties().limits.bufferImageGranularity;
+    }
+
+    auto create_buffer(uint64_t size)
+    -> vk::UniqueBuffer
+    {
+        return m_device->createBufferUnique(
+            vk::BufferCreateInfo{vk::BufferCreateFlags{}, size, vk::BufferUsageFlagBits::eStorageBuffer}
+        );
+    }
+
+    auto create_image(uint32_t width, uint32_t height)
+    -> vk::UniqueImage
+    {
+        return m_device->createImageUnique(
+            vk::ImageCreateInfo{vk::ImageCreateFlags{},
+                                vk::ImageType::e2D,
+                                vk::Format::eR8G8B8A8Unorm,
+                                vk::Extent3D{width, height, 1},
+                                1,
+                                1,
+                                vk::SampleCountFlagBits::e1,
+                                vk::ImageTiling::eOptimal,
+                                vk::ImageUsageFlagBits::eSampled}
+        );
+    }
+
+    std::unique_ptr<vk::DynamicLoader> m_dl;
+    vk::UniqueInstance                 m_instance;
+    vk::PhysicalDevice                 m_physical_device;
+    vk::UniqueDevice                   m_device;
+    vk::PhysicalDeviceMemoryProperties m_memory_properties;
+    uint64_t                           m_granularity{1};
+};
+
+} // anonymous namespace
+
+TEST_F(Memory_allocator_test, selects_memory_type_for_usage)
+{
+    Memory_allocator allocator{m_device.get(), m_memory_properties, m_granularity};
+
+    auto buffer = create_buffer(64 * 1024);
+    const vk::MemoryRequirements requirements = m_device->getBufferMemoryRequirements(buffer.get());
+
+    using Flags = vk::MemoryPropertyFlagBits;
+    const struct
+    {
+        Memory_usage            usage;
+        vk::MemoryPropertyFlags required;
+    } cases[] = {
+        {Memory_usage::gpu_only,   Flags::eDeviceLocal},
+        {Memory_usage::cpu_to_gpu, Flags::eHostVisible | Flags::eHostCoherent},
+        {Memory_usage::staging,    Flags::eHostVisible | Flags::eHostCoherent},
+        {Memory_usage::gpu_to_cpu, Flags::eHostVisible | Flags::eHostCoherent}
+    };
+    for (const auto &c : cases)
+    {
+        SCOPED_TRACE(vipu::c_str(c.usage));
+
+        const auto candidates = vipu::get_memory_type_candidates(m_memory_properties, requirements.memoryTypeBits, c.usage);
+        ASSERT_FALSE(candidates.empty());
+
+        Memory_allocation allocation = allocator.allocate(requirements, c.usage, Resource_tiling::linear);
+        ASSERT_TRUE(allocation.is_valid());
+        EXPECT_EQ(allocation.memory_type_index, candidates.front());
+        EXPECT_EQ(allocation.offset % requirements.alignment, 0u);
+
+        const vk::MemoryPropertyFlags flags = m_memory_properties.memoryTypes[allocation.memory_type_index].propertyFlags;
+        EXPECT_EQ(flags & c.required, c.required);
+        if (flags & Flags::eHostVisible)
+        {
+            ASSERT_NE(allocation.mapped, nullptr);
+            memset(allocation.mapped, 0xff, requirements.size);
+        }
+        allocator.free(allocation);
+        EXPECT_FALSE(allocation.is_valid());
+    }
+
+    // Memory type bits with no suitable type
+    vk::MemoryRequirements no_types = requirements;
+    no_types.memoryTypeBits = 0;
+    EXPECT_FALSE(allocator.allocate(no_types, Memory_usage::gpu_only, Resource_tiling::linear).is_valid());
+}
+
+TEST_F(Memory_allocator_test, keeps_linear_and_optimal_resources_on_separate_pages)
+{
+    Memory_allocator allocator{m_device.get(), m_memory_properties, m_granularity};
+
+    auto buffer = create_buffer(1000);
+    auto image  = create_image(64, 64);
+
+    Memory_allocation buffer_allocation = allocator.allocate_for_buffer(buffer.get(), Memory_usage::gpu_only);
+    Memory_allocation image_allocation  = allocator.allocate_for_image(image.get(), Memory_usage::gpu_only, Resource_tiling::optimal);
+    ASSERT_TRUE(buffer_allocation.is_valid());
+    ASSERT_TRUE(image_allocation.is_valid());
+
+    if (buffer_allocation.memory == image_allocation.memory)
+    {
+        const uint64_t buffer_first_page = buffer_allocation.offset / m_granularity;
+        const uint64_t buffer_last_page  = (buffer_allocation.offset + buffer_allocation.size - 1) / m_granularity;
+        const uint64_t image_first_page  = image_allocation.offset / m_granularity;
+        const uint64_t image_last_page   = (image_allocation.offset + image_allocation.size - 1) / m_granularity;
+        EXPECT_TRUE((buffer_last_page < image_first_page) || (image_last_page < buffer_first_page));
+    }
+
+    buffer.reset();
+    image.reset();
+    allocator.free(buffer_allocation);
+    allocator.free(image_allocation);
+}
+
+TEST_F(Memory_allocator_test, separates_tiling_by_granularity)
+{
+    const vk::MemoryRequirements requirements{256, 256, ~0u};
+
+    // Granularity above one byte keeps linear and optimal in separate blocks
+    {
+        Memory_allocator allocator{m_device.get(), m_memory_properties, 4096};
+        Memory_allocation linear  = allocator.allocate(requirements, Memory_usage::gpu_only, Resource_tiling::linear);
+        Memory_allocation optimal = allocator.allocate(requirements, Memory_usage::gpu_only, Resource_tiling::optimal);
+        ASSERT_TRUE(linear.is_valid() && optimal.is_valid());
+        EXPECT_EQ(linear.memory_type_index, optimal.memory_type_index);
+        EXPECT_NE(linear.memory, optimal.memory);
+        allocator.free(linear);
+        allocator.free(optimal);
+    }
+
+    // With granularity of one byte they share a block
+    {
+        Memory_allocator allocator{m_device.get(), m_memory_properties, 1};
+        Memory_allocation linear  = allocator.allocate(requirements, Memory_usage::gpu_only, Resource_tiling::linear);
+        Memory_allocation optimal = allocator.allocate(requirements, Memory_usage::gpu_only, Resource_tiling::optimal);
+        ASSERT_TRUE(linear.is_valid() && optimal.is_valid());
+        EXPECT_EQ(linear.memory, optimal.memory);
+        allocator.free(linear);
+        allocator.free(optimal);
+    }
+}
@@ -0,0 +1,187 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "graphics/shader_reflection.hpp"
+
+using Descriptor_binding = vipu::Descriptor_binding;
+using Shader_interface   = vipu::Shader_interface;
+using Vertex_attribute   = vipu::Vertex_attribute;
+
+namespace
+{
+
+// SPIR-V in src/test/data is assembled from the .spvasm next to it, with
+// spirv-as --target-env spv1.0. The .spvasm also shows equivalent GLSL.
+auto read_spirv(const std::string &name)
+-> std::vector<uint32_t>
+{
+    std::ifstream file{std::string{VIPU_TEST_DATA_DIR} + "/" + name, std::ios::binary};
+    const std::vector<char> bytes{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    std::vector<uint32_t> words(bytes.size() / sizeof(uint32_t));
+    memcpy(words.data(), bytes.data(), words.size() * sizeof(uint32_t));
+    return words;
+}
+
+auto reflect(const std::string &name)
+-> Shader_interface
+{
+    const std::vector<uint32_t> spirv = read_spirv(name);
+    EXPECT_FALSE(spirv.empty()) << name;
+
+    Shader_interface shader_interface;
+    EXPECT_TRUE(vipu::reflect_shader(spirv, shader_interface)) << name;
+    return shader_interface;
+}
+
+auto make_binding(uint32_t set, uint32_t binding, vk::DescriptorType type, uint32_t count, vk::ShaderStageFlags stages)
+-> Descriptor_binding
+{
+    Descriptor_binding result;
+    result.set     = set;
+    result.binding = binding;
+    result.type    = type;
+    result.count   = count;
+    result.stages  = stages;
+    return result;
+}
+
+} // anonymous namespace
+
+TEST(Shader_reflection, reflects_vertex_stage)
+{
+    const Shader_interface vertex = reflect("reflection.vert.spv");
+    EXPECT_EQ(vertex.stages, vk::ShaderStageFlags{vk::ShaderStageFlagBits::eVertex});
+
+    ASSERT_EQ(vertex.bindings.size(), 1u);
+    EXPECT_EQ(vertex.bindings[0].set,     0u);
+    EXPECT_EQ(vertex.bindings[0].binding, 0u);
+    EXPECT_EQ(vertex.bindings[0].type,    vk::DescriptorType::eUniformBuffer);
+    EXPECT_EQ(vertex.bindings[0].count,   1u);
+
+    // Only push.scale is used
+    ASSERT_EQ(vertex.push_constant_ranges.size(), 1u);
+    EXPECT_EQ(vertex.push_constant_ranges[0].offset, 16u);
+    EXPECT_EQ(vertex.push_constant_ranges[0].size,   4u);
+}
+
+TEST(Shader_reflection, expands_matrix_and_array_locations)
+{
+    const Shader_interface vertex = reflect("reflection.vert.spv");
+
+    // vec3 at 0, mat4 columns at 1..4, vec2[2] elements at 5..6
+    const struct
+    {
+        uint32_t   location;
+        vk::Format format;
+        uint32_t   size;
+    } expected[] = {
+        {0, vk::Format::eR32G32B32Sfloat,    12},
+        {1, vk::Format::eR32G32B32A32Sfloat, 16},
+        {2, vk::Format::eR32G32B32A32Sfloat, 16},
+        {3, vk::Format::eR32G32B32A32Sfloat, 16},
+        {4, vk::Format::eR32G32B32A32Sfloat, 16},
+        {5, vk::Format::eR32G32Sfloat,        8},
+        {6, vk::Format::eR32G32Sfloat,        8}
+    };
+    ASSERT_EQ(vertex.vertex_attributes.size(), std::size(expected));
+    for (size_t i = 0; i < std::size(expected); ++i)
+    {
+        EXPECT_EQ(vertex.vertex_attributes[i].location, expected[i].location);
+        EXPECT_EQ(vertex.vertex_attributes[i].format,   expected[i].format);
+        EXPECT_EQ(vertex.vertex_attributes[i].size,     expected[i].size);
+    }
+
+    const vipu::Vertex_input_layout layout = vipu::make_vertex_input_layout(vertex, 2);
+    EXPECT_EQ(layout.binding.binding,   2u);
+    EXPECT_EQ(layout.binding.stride,    92u);
+    EXPECT_EQ(layout.binding.inputRate, vk::VertexInputRate::eVertex);
+    ASSERT_EQ(layout.attributes.size(), std::size(expected));
+    uint32_t offset{0};
+    for (size_t i = 0; i < std::size(expected); ++i)
+    {
+        EXPECT_EQ(layout.attributes[i].location, expected[i].location);
+        EXPECT_EQ(layout.attributes[i].binding,  2u);
+        EXPECT_EQ(layout.attributes[i].format,   expected[i].format);
+        EXPECT_EQ(layout.attributes[i].offset,   offset);
+        offset += expected[i].size;
+    }
+}
+
+TEST(Shader_reflection, merges_bindings_of_stages)
+{
+    Shader_interface merged;
+    ASSERT_TRUE(vipu::merge_shader_interface(merged, reflect("reflection.vert.spv")));
+    ASSERT_TRUE(vipu::merge_shader_interface(merged, reflect("reflection.frag.spv")));
+
+    EXPECT_EQ(merged.stages, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
+
+    // Camera is used by both stages, albedo by fragment only
+    ASSERT_EQ(merged.bindings.size(), 2u);
+    EXPECT_EQ(merged.bindings[0].binding, 0u);
+    EXPECT_EQ(merged.bindings[0].type,    vk::DescriptorType::eUniformBuffer);
+    EXPECT_EQ(merged.bindings[0].stages,  vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
+    EXPECT_EQ(merged.bindings[1].binding, 1u);
+    EXPECT_EQ(merged.bindings[1].type,    vk::DescriptorType::eCombinedImageSampler);
+    EXPECT_EQ(merged.bindings[1].stages,  vk::ShaderStageFlags{vk::ShaderStageFlagBits::eFragment});
+
+    // Vertex attributes come from the vertex stage
+    EXPECT_EQ(merged.vertex_attributes.size(), 7u);
+}
+
+TEST(Shader_reflection, merges_push_constant_ranges_to_union)
+{
+    // Vertex uses push.scale at 16..20, fragment push.tint at 0..16
+    Shader_interface merged;
+    ASSERT_TRUE(vipu::merge_shader_interface(merged, reflect("reflection.vert.spv")));
+    ASSERT_TRUE(vipu::merge_shader_interface(merged, reflect("reflection.frag.spv")));
+
+    ASSERT_EQ(merged.push_constant_ranges.size(), 1u);
+    EXPECT_EQ(merged.push_constant_ranges[0].stageFlags, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
+    EXPECT_EQ(merged.push_constant_ranges[0].offset, 0u);
+    EXPECT_EQ(merged.push_constant_ranges[0].size,   20u);
+
+    // Disjoint ranges merge to one range covering the gap
+    Shader_interface a;
+    Shader_interface b;
+    a.push_constant_ranges.emplace_back(vk::ShaderStageFlagBits::eVertex,   0, 8);
+    b.push_constant_ranges.emplace_back(vk::ShaderStageFlagBits::eFragment, 64, 16);
+    ASSERT_TRUE(vipu::merge_shader_interface(a, b));
+    ASSERT_EQ(a.push_constant_ranges.size(), 1u);
+    EXPECT_EQ(a.push_constant_ranges[0].offset, 0u);
+    EXPECT_EQ(a.push_constant_ranges[0].size,   80u);
+}
+
+TEST(Shader_reflection, rejects_binding_type_mismatch)
+{
+    // Set 0 binding 0 is a uniform buffer in the vertex stage, and a
+    // storage buffer in the fragment stage
+    const Shader_interface fragment = reflect("reflection_mismatch.frag.spv");
+    ASSERT_EQ(fragment.bindings.size(), 1u);
+    EXPECT_EQ(fragment.bindings[0].type, vk::DescriptorType::eStorageBuffer);
+
+    Shader_interface merged;
+    ASSERT_TRUE(vipu::merge_shader_interface(merged, reflect("reflection.vert.spv")));
+    EXPECT_FALSE(vipu::merge_shader_interface(merged, fragment));
+}
+
+TEST(Shader_reflection, rejects_binding_count_mismatch)
+{
+    Shader_interface vertex;
+    Shader_interface fragment;
+    vertex  .bindings.push_back(make_binding(1, 3, vk::DescriptorType::eCombinedImageSampler, 4, vk::ShaderStageFlagBits::eVertex));
+    fragment.bindings.push_back(make_binding(1, 3, vk::DescriptorType::eCombinedImageSampler, 8, vk::ShaderStageFlagBits::eFragment));
+    EXPECT_FALSE(vipu::merge_shader_interface(vertex, fragment));
+}
+
+TEST(Shader_reflection, rejects_unparsable_code)
+{
+    const std::vector<uint32_t> garbage{0x07230203u, 0x00010000u, 0u, 4u, 0u, 0xffffffffu};
+    Shader_interface shader_interface;
+    EXPECT_FALSE(vipu::reflect_shader(garbage, shader_interface));
+}
@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "memory/tlsf_allocator.hpp"
+
+using Tlsf_allocator = vipu::Tlsf_allocator;
+
+TEST(Tlsf_allocator, aligns_offsets)
+{
+    Tlsf_allocator allocator{1024 * 1024};
+
+    const auto first = allocator.allocate(100);
+    ASSERT_TRUE(first.is_valid());
+    EXPECT_EQ(first.offset, 0u);
+
+    // Padding before the aligned offset is left as a free block
+    const auto second = allocator.allocate(100, 256);
+    ASSERT_TRUE(second.is_valid());
+    EXPECT_EQ(second.offset, 256u);
+
+    for (uint64_t alignment : {4096ull, 65536ull})
+    {
+        const auto allocation = allocator.allocate(300, alignment);
+        ASSERT_TRUE(allocation.is_valid());
+        EXPECT_EQ(allocation.offset % alignment, 0u);
+        EXPECT_GE(allocation.offset, second.offset + 100);
+    }
+    EXPECT_EQ(allocator.get_allocation_count(), 4u);
+    EXPECT_EQ(allocator.get_used_size(), 800u);
+}
+
+TEST(Tlsf_allocator, splits_and_merges)
+{
+    Tlsf_allocator allocator{1024};
+
+    auto a = allocator.allocate(256);
+    auto b = allocator.allocate(256);
+    auto c = allocator.allocate(256);
+    ASSERT_TRUE(a.is_valid() && b.is_valid() && c.is_valid());
+    EXPECT_EQ(a.offset, 0u);
+    EXPECT_EQ(b.offset, 256u);
+    EXPECT_EQ(c.offset, 512u);
+    EXPECT_EQ(allocator.get_free_block_count(), 1u);
+    EXPECT_EQ(allocator.get_largest_free_size(), 256u);
+
+    // b has used neighbours on both sides, so it stays a block of its own
+    allocator.free(b);
+    EXPECT_EQ(allocator.get_free_block_count(), 2u);
+    EXPECT_EQ(allocator.get_largest_free_size(), 256u);
+
+    // a merges with b
+    allocator.free(a);
+    EXPECT_EQ(allocator.get_free_block_count(), 2u);
+    EXPECT_EQ(allocator.get_largest_free_size(), 512u);
+
+    // c merges with a and b before it, and the tail after it
+    allocator.free(c);
+    EXPECT_EQ(allocator.get_free_block_count(), 1u);
+    EXPECT_EQ(allocator.get_largest_free_size(), 1024u);
+    EXPECT_EQ(allocator.get_used_size(), 0u);
+    EXPECT_EQ(allocator.get_allocation_count(), 0u);
+
+    // Merged range is usable as a whole
+    const auto whole = allocator.allocate(1024);
+    ASSERT_TRUE(whole.is_valid());
+    EXPECT_EQ(whole.offset, 0u);
+}
+
+TEST(Tlsf_allocator, reports_exhaustion)
+{
+    Tlsf_allocator allocator{4096};
+
+    EXPECT_FALSE(allocator.allocate(4097).is_valid());
+
+    std::vector<Tlsf_allocator::Allocation> allocations;
+    for (int i = 0; i < 4; ++i)
+    {
+        allocations.push_back(allocator.allocate(1024));
+        ASSERT_TRUE(allocations.back().is_valid());
+    }
+    EXPECT_FALSE(allocator.allocate(1).is_valid());
+    EXPECT_EQ(allocator.get_free_block_count(), 0u);
+
+    // Free space which can not hold the alignment padding is not enough
+    allocator.free(allocations[1]);
+    EXPECT_TRUE(allocator.allocate(512, 512).is_valid());
+    EXPECT_FALSE(allocator.allocate(512, 2048).is_valid());
+}
+
+TEST(Tlsf_allocator, ignores_invalid_free)
+{
+    Tlsf_allocator allocator{1024};
+    allocator.free(Tlsf_allocator::Allocation{});
+    EXPECT_EQ(allocator.get_free_block_count(), 1u);
+    EXPECT_EQ(allocator.get_largest_free_size(), 1024u);
+}
@@ -0,0 +1,194 @@
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "graphics/context.hpp"
+#include "graphics/memory_allocator.hpp"
+#include "graphics/physical_device.hpp"
+#include "graphics/queue.hpp"
+#include "graphics/upload_engine.hpp"
+#include "graphics/vulkan.hpp"
+
+using Buffer_upload     = vipu::Buffer_upload;
+using Memory_allocation = vipu::Memory_allocation;
+using Memory_allocator  = vipu::Memory_allocator;
+using Memory_usage      = vipu::Memory_usage;
+using Upload_engine     = vipu::Upload_engine;
+
+namespace
+{
+
+// Creates a device with timeline semaphores on lavapipe (Mesa llvmpipe).
+// Tests are skipped if it is not installed.
+class Upload_engine_test : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        try
+        {
+            m_dl = std::make_unique<vk::DynamicLoader>();
+        }
+        catch (const std::runtime_error &)
+        {
+            GTEST_SKIP() << "Vulkan loader not found";
+        }
+        VULKAN_HPP_DEFAULT_DISPATCHER.init(m_dl->getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr"));
+
+        const vk::ApplicationInfo application_info{"upload_engine_test", 0, nullptr, 0, VK_API_VERSION_1_1};
+        m_instance = vk::createInstanceUnique(vk::InstanceCreateInfo{vk::InstanceCreateFlags{}, &application_info});
+        VULKAN_HPP_DEFAULT_DISPATCHER.init(m_instance.get());
+
+        vk::PhysicalDevice physical_device;
+        for (auto candidate : m_instance->enumeratePhysicalDevices())
+        {
+            if (candidate.getProperties().deviceType == vk::PhysicalDeviceType::eCpu)
+            {
+                physical_device = candidate;
+                break;
+            }
+        }
+        if (!physical_device)
+        {
+            GTEST_SKIP() << "lavapipe not found";
+        }
+
+        const float queue_priority{1.0f};
+        const vk::DeviceQueueCreateInfo queue_create_info{vk::DeviceQueueCreateFlags{}, 0, 1, &queue_priority};
+        const char *extension_name = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+        vk::StructureChain<vk::DeviceCreateInfo,
+                           vk::PhysicalDeviceTimelineSemaphoreFeatures
+        > device_create_info{
+            vk::DeviceCreateInfo{vk::DeviceCreateFlags{}, 1, &queue_create_info, 0, nullptr, 1, &extension_name},
+            vk::PhysicalDeviceTimelineSemaphoreFeatures{VK_TRUE}
+        };
+        m_device = physical_device.createDeviceUnique(device_create_info.get<vk::DeviceCreateInfo>());
+        VULKAN_HPP_DEFAULT_DISPATCHER.init(m_device.get());
+
+        const vk::QueueFlags queue_flags = physical_device.getQueueFamilyProperties()[0].queueFlags;
+        m_queue            = std::make_unique<vipu::Queue>(m_device.get(), 0, 0, queue_flags, "transfer");
+        m_memory_allocator = std::make_unique<Memory_allocator>(m_device.get(),
+                                                                physical_device.getMemoryProperties(),
+                                                                physical_device.getProperties().limits.bufferImageGranularity);
+
+        // Default constructed Physical_device has zero limits, so the engine
+        // uses its minimum copy alignment
+        m_context.vk_device                          = m_device.get();
+        m_context.physical_device                    = &m_physical_device;
+        m_context.memory_allocator                   = m_memory_allocator.get();
+        m_context.transfer_queue                     = m_queue.get();
+        m_context.graphics_queue_family_index        = 0;
+        m_context.transfer_queue_family_index        = 0;
+        m_context.device_features.timeline_semaphore = true;
+    }
+
+    void TearDown() override
+    {
+        m_buffers.clear();
+        for (auto &allocation : m_allocations)
+        {
+            m_memory_allocator->free(allocation);
+        }
+    }
+
+    // Host visible, so that uploaded data can be read back
+    auto create_readback_buffer(uint64_t size)
+    -> vk::Buffer
+    {
+        m_buffers.push_back(m_device->createBufferUnique(
+            vk::BufferCreateInfo{vk::BufferCreateFlags{}, size, vk::BufferUsageFlagBits::eTransferDst}
+        ));
+        m_allocations.push_back(m_memory_allocator->allocate_for_buffer(m_buffers.back().get(), Memory_usage::gpu_to_cpu));
+        EXPECT_TRUE(m_allocations.back().is_valid());
+        EXPECT_NE(m_allocations.back().mapped, nullptr);
+        return m_buffers.back().get();
+    }
+
+    std::unique_ptr<vk::DynamicLoader> m_dl;
+    vk::UniqueInstance                 m_instance;
+    vk::UniqueDevice                   m_device;
+    vipu::Physical_device              m_physical_device;
+    std::unique_ptr<vipu::Queue>       m_queue;
+    std::unique_ptr<Memory_allocator>  m_memory_allocator;
+    vipu::Context                      m_context;
+    std::vector<vk::UniqueBuffer>      m_buffers;
+    std::vector<Memory_allocation>     m_allocations;
+};
+
+} // anonymous namespace
+
+TEST_F(Upload_engine_test, uploads_multiple_buffers)
+{
+    constexpr int      buffer_count{3};
+    constexpr uint64_t staging_size{64 * 1024};
+    constexpr uint64_t size        {24 * 1024};
+
+    // Buffers are copied in chunks of a quarter of the staging size, so the
+    // first batch always has several copies, and usually several buffers
+    Upload_engine upload_engine{m_context, staging_size};
+
+    std::vector<vk::Buffer> buffers;
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        buffers.push_back(create_readback_buffer(size));
+        std::vector<uint8_t> data(size);
+        for (uint64_t j = 0; j < size; ++j)
+        {
+            data[j] = static_cast<uint8_t>(i * 37 + j / 256 + j);
+        }
+        upload_engine.upload(Buffer_upload{buffers.back(), 0, std::move(data)});
+    }
+    upload_engine.wait_idle();
+    EXPECT_EQ(upload_engine.get_statistics().staged_bytes, buffer_count * size);
+
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        SCOPED_TRACE(i);
+        const auto *mapped = static_cast<const uint8_t *>(m_allocations[i].mapped);
+        for (uint64_t j = 0; j < size; ++j)
+        {
+            ASSERT_EQ(mapped[j], static_cast<uint8_t>(i * 37 + j / 256 + j));
+        }
+    }
+}
+
+TEST_F(Upload_engine_test, uploads_buffers_held_by_frame_budget_in_one_batch)
+{
+    constexpr int      buffer_count{4};
+    constexpr uint64_t size        {1000};
+
+    Upload_engine upload_engine{m_context, 1024 * 1024};
+
+    // Use up the frame budget, so that the following uploads are held back
+    // until the budget is lifted, and are then scheduled together
+    upload_engine.set_frame_budget(1);
+    upload_engine.upload(Buffer_upload{create_readback_buffer(1), 0, std::vector<uint8_t>(1, 0xff)});
+    upload_engine.wait_idle();
+    ASSERT_EQ(upload_engine.get_statistics().submitted_count, 1u);
+
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        std::vector<uint8_t> data(size);
+        for (uint64_t j = 0; j < size; ++j)
+        {
+            data[j] = static_cast<uint8_t>(i * 37 + j);
+        }
+        upload_engine.upload(Buffer_upload{create_readback_buffer(size), 0, std::move(data)});
+    }
+    upload_engine.set_frame_budget(0);
+    upload_engine.wait_idle();
+    EXPECT_EQ(upload_engine.get_statistics().submitted_count, 2u);
+
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        SCOPED_TRACE(i);
+        const auto *mapped = static_cast<const uint8_t *>(m_allocations[i + 1].mapped);
+        for (uint64_t j = 0; j < size; ++j)
+        {
+            ASSERT_EQ(mapped[j], static_cast<uint8_t>(i * 37 + j));
+        }
+    }
+}
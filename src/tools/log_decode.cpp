@@ -0,0 +1,253 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fmt/args.h"
+#include "fmt/format.h"
+#include "log/binary_log.hpp"
+
+using Binary_log = vipu::Binary_log;
+
+namespace
+{
+
+struct Site
+{
+    std::string category;
+    std::string format;
+};
+
+auto level_name(int level)
+-> const char *
+{
+    switch (level)
+    {
+        case 0:  return "all";
+        case 1:  return "trace";
+        case 2:  return "info";
+        case 3:  return "warn";
+        case 4:  return "error";
+        case 5:  return "fatal";
+        default: return "?";
+    }
+}
+
+auto read_file(const char *path, std::vector<uint8_t> &data)
+-> bool
+{
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    uint8_t buffer[65536];
+    size_t  count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+// Calls function(entry_header, payload, payload_size) for each complete entry
+template <typename Function>
+void for_each_entry(const std::vector<uint8_t> &data, size_t offset, Function function)
+{
+    while (offset + sizeof(Binary_log::Entry_header) <= data.size())
+    {
+        Binary_log::Entry_header header;
+        memcpy(&header, &data[offset], sizeof(header));
+        if ((header.size < sizeof(header)) || (offset + header.size > data.size()))
+        {
+            break;
+        }
+        function(header, &data[offset + sizeof(header)], header.size - sizeof(header));
+        offset += header.size;
+    }
+}
+
+// Returns false if the argument data is truncated
+auto decode_arguments(const uint8_t *p, const uint8_t *end, fmt::dynamic_format_arg_store<fmt::format_context> &store)
+-> bool
+{
+    while ((p < end) && (*p != 0))
+    {
+        auto type = static_cast<Binary_log::Argument_type>(*p++);
+        if (type == Binary_log::Argument_type::string)
+        {
+            uint32_t length;
+            if (p + sizeof(length) > end)
+            {
+                return false;
+            }
+            memcpy(&length, p, sizeof(length));
+            p += sizeof(length);
+            if (p + length > end)
+            {
+                return false;
+            }
+            store.push_back(std::string(reinterpret_cast<const char *>(p), length));
+            p += length;
+            continue;
+        }
+
+        uint64_t value;
+        if (p + sizeof(value) > end)
+        {
+            return false;
+        }
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        switch (type)
+        {
+            case Binary_log::Argument_type::i64:
+            {
+                store.push_back(static_cast<int64_t>(value));
+                break;
+            }
+            case Binary_log::Argument_type::u64:
+            {
+                store.push_back(value);
+                break;
+            }
+            case Binary_log::Argument_type::f64:
+            {
+                double f64;
+                memcpy(&f64, &value, sizeof(f64));
+                store.push_back(f64);
+                break;
+            }
+            case Binary_log::Argument_type::boolean:
+            {
+                store.push_back(value != 0);
+                break;
+            }
+            case Binary_log::Argument_type::character:
+            {
+                store.push_back(static_cast<char>(value));
+                break;
+            }
+            case Binary_log::Argument_type::pointer:
+            {
+                store.push_back(reinterpret_cast<const void *>(static_cast<uintptr_t>(value)));
+                break;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, const char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <binary log file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> data;
+    if (!read_file(argv[1], data))
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    Binary_log::File_header header;
+    if (data.size() < sizeof(header))
+    {
+        fprintf(stderr, "%s: file too short\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if ((header.magic != Binary_log::magic) || (header.version != Binary_log::version))
+    {
+        fprintf(stderr, "%s: not a binary log file, or unsupported version\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // Site entries are written before the first record using them, but
+    // collect them up front so the decoder does not depend on that.
+    std::unordered_map<uint32_t, Site> sites;
+    for_each_entry(data, header.header_size, [&sites](const Binary_log::Entry_header &entry, const uint8_t *p, size_t size)
+    {
+        Binary_log::Site_entry site;
+        if ((entry.type != static_cast<uint16_t>(Binary_log::Entry_type::site)) || (size < sizeof(site)))
+        {
+            return;
+        }
+        memcpy(&site, p, sizeof(site));
+        if (sizeof(site) + site.category_length + site.format_length > size)
+        {
+            return;
+        }
+        const char *text = reinterpret_cast<const char *>(p + sizeof(site));
+        sites[site.site_id] = Site{std::string(text, site.category_length),
+                                   std::string(text + site.category_length, site.format_length)};
+    });
+
+    size_t record_count{0};
+    size_t error_count {0};
+    for_each_entry(data, header.header_size, [&](const Binary_log::Entry_header &entry, const uint8_t *p, size_t size)
+    {
+        Binary_log::Record_entry record;
+        if ((entry.type != static_cast<uint16_t>(Binary_log::Entry_type::record)) || (size < sizeof(record)))
+        {
+            return;
+        }
+        memcpy(&record, p, sizeof(record));
+        ++record_count;
+
+        std::string text;
+        auto site = sites.find(record.site_id);
+        fmt::dynamic_format_arg_store<fmt::format_context> store;
+        if (site == sites.end())
+        {
+            text = fmt::format("<unknown site {}>\n", record.site_id);
+            ++error_count;
+        }
+        else if (!decode_arguments(p + sizeof(record), p + size, store))
+        {
+            text = fmt::format("<truncated arguments> {}", site->second.format);
+            ++error_count;
+        }
+        else
+        {
+            try
+            {
+                text = fmt::vformat(site->second.format, store);
+            }
+            catch (const fmt::format_error &error)
+            {
+                text = fmt::format("<{}> {}", error.what(), site->second.format);
+                ++error_count;
+            }
+        }
+
+        if (text.empty() || (text.back() != '\n'))
+        {
+            text.push_back('\n');
+        }
+
+        fmt::print("{:14.6f} {:>7} {:<5} {:<10} {}",
+                   static_cast<double>(record.timestamp_ns) / 1e9,
+                   record.thread_id,
+                   level_name(entry.level),
+                   (site != sites.end()) ? site->second.category : std::string{},
+                   text);
+    });
+
+    fprintf(stderr, "%zu records, %zu sites, %zu errors\n", record_count, sites.size(), error_count);
+
+    return (error_count == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}